@@ -270,18 +270,24 @@ int DtreeClient::remove(const TableId& table, const Key& key){
 
 int DtreeClient::BulkInsert(const TableId& table, const std::vector<Key>& keys,
                          const std::vector<ValueMap>& values){
+  DdTable *tab = _table_map[table];
   int idx = 0;
-  int res = begin();
+  int res = begin(); assert(!res);
+  res = DdBulkBegin(tab);
   for (auto &key : keys){
-    int retries = 10;
-    do {
-      res = insert(table, key, values[idx]);
-      if (res) std::this_thread::sleep_for(std::chrono::microseconds(500));
-      retries--;
-    } while (retries > 0 && res != 0);
+    if (res) break;
+    i64 ikey = MurmurHash64A(key.c_str(), (int)key.size());
+    int size = serialize(values[idx]);
+    res = DdBulkInsert(tab, ikey, _scratch, size);
     idx++;
   }
-  assert(!res);
+  if (!res) res = DdBulkEnd(tab);
+  if (res){ // discard partial load and retry
+    DdBulkEnd(tab);
+    _txcount--;
+    DdRollbackTx(_dbhandle);
+    return BulkInsert(table, keys, values);
+  }
   res = end();
   if (res) return BulkInsert(table, keys, values);
   return 0;
@@ -1672,6 +1672,7 @@ void test17delranges(int dela1, int dela2, int delb1, int delb2,
 // test17: conflicting and non-conflicting transactions
 void test17(){
   int i, res;
+  u64 v;
   COid coid;
   ListCell lc;
   ListCell lc1,lc2;
@@ -1731,6 +1732,35 @@ void test17(){
   res = t2.attrSet(coid, 2, 1); assert(res==0);
   res = t2.tryCommit(); assert(res==0);
   res = t1.tryCommit(); assert(res==0);
+
+  // attradd non-conflict: adds to the same attribute are summed
+  coid.oid = 0;
+  t1.start();
+  res = t1.vsuperget(coid,buf,0,0); assert(res==0);
+  v = buf->u.raw->Attrs[1];
+  t2.start();
+  res = t2.vsuperget(coid,buf,0,0); assert(res==0);
+  res = t1.attrAdd(coid, 1, 3); assert(res==0);
+  res = t1.attrAdd(coid, 1, 4); assert(res==0);
+  res = t2.attrAdd(coid, 1, (u64)-2); assert(res==0);
+  res = t1.vsuperget(coid,buf,0,0); assert(res==0);
+  assert(buf->u.raw->Attrs[1] == v+7); // sees its own adds
+  res = t1.tryCommit(); assert(res==0);
+  res = t2.tryCommit(); assert(res==0);
+  t1.start();
+  res = t1.vsuperget(coid,buf,0,0); assert(res==0);
+  assert(buf->u.raw->Attrs[1] == v+5);
+  res = t1.tryCommit(); assert(res==0);
+
+  // attradd and attrset conflict
+  t1.start();
+  res = t1.vsuperget(coid,buf,0,0); assert(res==0);
+  t2.start();
+  res = t2.vsuperget(coid,buf,0,0); assert(res==0);
+  res = t1.attrAdd(coid, 1, 1); assert(res==0);
+  res = t2.attrSet(coid, 1, 0); assert(res==0);
+  res = t1.tryCommit(); assert(res==0);
+  res = t2.tryCommit(); assert(res!=0);
   
   // listadd conflict
   coid.oid = 0;
@@ -1229,6 +1229,95 @@ void launch_test7(){
 }
 
 
+// test8: without concurrency, bulk load random keys into an empty table,
+// check the tree, read them, and insert more keys one at a time
+#define TEST8_NITEMS 10000
+#define TEST8_NEXTRA 1000
+#define TEST8_VAL "BULK"
+#define TEST8_LEN 5
+
+void test8(){
+  SimplePrng prng;
+  int i;
+  i64 key;
+  u64 itable;
+  DdTable *table;
+  int len;
+  bool done;
+  char buf[256];
+  int res;
+  Set<I64> allkeys;
+  COid coid;
+
+  itable = 8;
+  DdInit();
+  res = DdInitConnection(dbname, conn);
+  if (res){ fprintf(stderr, "Error connecting to %s: %d\n", dbname, res); exit(1); }
+
+  res = DdCreateTable(conn, itable, table);
+  if (res){ fprintf(stderr, "Error creating table %llx: %d\n",
+                    (long long)itable, res); exit(1); }
+
+  do {
+    allkeys.clear();
+    prng.SetSeed(8);
+    res = DdStartTx(conn); assert(res==0);
+    res = DdBulkBegin(table); assert(res==0);
+    for (i=0; i < TEST8_NITEMS; ++i){
+      key = prng.next32();
+      allkeys.insert(key);
+      res = DdBulkInsert(table, key, TEST8_VAL, TEST8_LEN); assert(res==0);
+    }
+    res = DdBulkEnd(table); assert(res==0);
+    res = DdCommitTx(conn);
+    done = res == 0;
+  } while (!done);
+
+  coid.cid = getCidTable(nameToDbid(dbname, false), itable);
+  coid.oid = 0;
+  checkTree(coid, &allkeys, true);
+
+  prng.SetSeed(8);
+  res = DdStartTx(conn); assert(res==0);
+  for (i=0; i < TEST8_NITEMS; ++i){
+    key = prng.next32();
+    res = DdLookup(table, key, buf, sizeof(buf), &len); assert(res==0);
+    assert(len==TEST8_LEN);
+    assert(memcmp(buf, TEST8_VAL, TEST8_LEN) == 0);
+  }
+  res = DdCommitTx(conn); assert(res==0);
+
+  // bulk loaded tree should accept regular inserts
+  for (i=0; i < TEST8_NEXTRA; ++i){
+    key = prng.next32();
+    allkeys.insert(key);
+    do {
+      res = DdStartTx(conn); assert(res==0);
+      res = DdInsert(table, key, TEST8_VAL, TEST8_LEN); assert(res==0);
+      res = DdCommitTx(conn);
+      done = res == 0;
+    } while (!done);
+  }
+
+  checkTree(coid, &allkeys, false);
+
+  DdCloseTable(table);
+  DdCloseConnection(conn);
+  DdUninit();
+}
+
+void launch_test8(){
+  pid_t pid;
+  int status;
+  pid = fork();
+  if (!pid){ // child
+    test8();
+    exit(0);
+  } else { // park
+    waitpid(pid, &status, 0);
+  }
+}
+
 int main(){
   printf("Test1\n");
   launch_test1();
@@ -1247,8 +1336,10 @@ int main(){
   launch_test7();
 #else
   printf("  Skipped (nodesplits disabled)\n");
-  printf("Done\n");
 #endif  
+  printf("Test8\n");
+  launch_test8();
+  printf("Done\n");
   
   exit(0);
 }  
@@ -70,6 +70,8 @@ int sqlite3BtreeOpen(
 
 int sqlite3BtreeClose(Btree*);
 int sqlite3BtreeSetCacheSize(Btree*,int);
+int sqlite3BtreeSetReadStaleness(Btree*,int); // YESQUEL CH: added
+int sqlite3BtreeGetReadStaleness(Btree*);     // YESQUEL CH: added
 int sqlite3BtreeSetSafetyLevel(Btree*,int,int,int);
 int sqlite3BtreeSyncDisabled(Btree*);
 int sqlite3BtreeSetPageSize(Btree *p, int nPagesize, int nReserve, int eFix);
@@ -189,6 +191,10 @@ int sqlite3BtreeDataSize(BtCursor*, u32 *pSize);
 int sqlite3BtreeData(BtCursor*, u32 offset, u32 amt, void*);
 void sqlite3BtreeSetCachedRowid(BtCursor*, sqlite3_int64);
 sqlite3_int64 sqlite3BtreeGetCachedRowid(BtCursor*);
+int sqlite3BtreeBulkBegin(BtCursor*); // YESQUEL CH: added
+int sqlite3BtreeBulkEnd(BtCursor*);   // YESQUEL CH: added
+int sqlite3BtreeScanPrefetch(BtCursor*); // YESQUEL CH: added
+int sqlite3BtreeRowPrefetch(BtCursor*, BtCursor*, i64, int); // YESQUEL CH: added
 
 char *sqlite3BtreeIntegrityCheck(Btree*, int *aRoot, int nRoot, int, int*);
 struct Pager *sqlite3BtreePager(Btree*);
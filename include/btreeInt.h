@@ -372,6 +372,8 @@ struct Btree {
   BtLock lock;       /* Object used to lock page 1 */
 #endif
   KVTransaction *tx; // YESQUEL CH: added this field
+  int readStaleness; // YESQUEL CH: added this field. How old, in ms, the
+                     // snapshot of read transactions may be
 };
 
 
@@ -531,6 +533,10 @@ struct BtCursor {
   //u8 atLast;                /* Cursor pointing to the last entry */ // YESQUEL CH: removed 
   //u8 validNKey;             /* True if info.nKey is valid */ // YESQUEL CH: removed
   u8 eState;                   /* One of the CURSOR_XXX constants (see below) */
+  struct DtBulkLoad *bulk;     /* bulk load in progress, if any */ // YESQUEL CH: added
+  struct DtScanPrefetch *prefetch; /* prefetching scan, if any */ // YESQUEL CH: added
+  struct DtRowPrefetch *rowfetch; /* rows fetched ahead, if any */ // YESQUEL CH: added
+  u8 wholeLeaves;              /* seeks read whole leaves, not just cells near key */ // YESQUEL CH: added
 #ifndef SQLITE_OMIT_INCRBLOB
   //  Pgno *aOverflow;           /* Cache of overflow page locations */ // YESQUEL CH: removed
   //  u8 isIncrblobHandle;       /* True if this cursor is an incr. io handle */ // YESQUEL CH: removed
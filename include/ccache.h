@@ -120,7 +120,9 @@
 // the clocks of clients and servers are not synchronized,
 // though in this case there might be liveness/progress problems.
 
+#include "options.h"
 #include "datastruct.h"
+#include "datastructmt.h"
 #include "gaiatypes.h"
 #include "os.h"
 #include "valbuf.h"
@@ -190,4 +192,58 @@ public:
   int set(int serverno, COid &coid, Ptr<Valbuf> buf);
 };
 
+#ifdef GAIA_STALE_READS
+// Cache of versions read from the servers, for transactions with a stale
+// snapshot (see GAIA_STALE_READS). Unlike ClientCache, it needs nothing from
+// the servers: a version with commit timestamp C read by a transaction with
+// start timestamp R is the value of the object at every timestamp in [C,R],
+// since the server delays the read until pending writes with smaller
+// timestamps are done, and makes later writes commit after R. A transaction
+// whose start timestamp falls in [C,R] can use the version as is.
+//
+// With GAIA_LEASES, the servers also give leases on the upper levels of
+// DTrees: a leased version is the value of the object until the lease ends,
+// which is in the future, so its readTs is the end of the lease. Leased
+// versions are valid at the start timestamp of new transactions.
+//
+// For each object, the cache keeps the version read with the largest readTs.
+// Like ClientCache, it stores and returns copies, since transactions may
+// change the versions they read (e.g., DTree splits).
+class VersionCache {
+private:
+  HashTableMT<COid, Ptr<Valbuf> > Cache;
+  static int auxLookup(COid &coid, Ptr<Valbuf> *vbufptr, int status,
+                       SkipList<COid, Ptr<Valbuf> > *b, u64 parm);
+  static int auxLookupRecent(COid &coid, Ptr<Valbuf> *vbufptr, int status,
+                             SkipList<COid, Ptr<Valbuf> > *b, u64 parm);
+  static int auxRefresh(COid &coid, Ptr<Valbuf> *vbufptr, int status,
+                        SkipList<COid, Ptr<Valbuf> > *b, u64 parm);
+
+public:
+  bool InUse; // whether some transaction used the cache or some server gave
+              // a lease. Until then, refresh does nothing, so other clients
+              // pay nothing for it
+  VersionCache() : Cache(VCACHE_HASHTABLE_SIZE) { InUse = false; }
+  ~VersionCache(){ Cache.clear(0,0); }
+
+  // Looks up a version of coid of the given type (0=value, 1=supervalue)
+  // valid at timestamp ts. If found, sets vbuf to it and returns 0.
+  // Otherwise, leaves vbuf untouched and returns non-0.
+  int lookup(COid &coid, int type, Timestamp &ts, Ptr<Valbuf> &vbuf);
+
+  // Returns whether lookup would find a version, without copying it
+  bool has(COid &coid, int type, Timestamp &ts);
+
+  // Like lookup, but finds a version valid at some timestamp >= oldest, for
+  // a transaction that has yet to choose its snapshot. The version is valid
+  // at max(oldest, vbuf->commitTs).
+  int lookupRecent(COid &coid, int type, Timestamp &oldest, Ptr<Valbuf> &vbuf);
+
+  // Stores a copy of vbuf, a whole version read from a server with its
+  // commitTs and readTs set, if its readTs is later than that of what the
+  // cache has for the object.
+  void refresh(Ptr<Valbuf> &vbuf);
+};
+#endif
+
 #endif
@@ -65,6 +65,10 @@ struct ServerInfo;
 class ObjectDirectory {
 private:
   ConfigState *Config;
+#ifdef GAIA_REPLICAS
+  u64 *ReplicaSafeD1; // for each server and replica, last known safe d1.
+                      // Just a hint: replicas refuse reads they cannot serve
+#endif
 
 public:
   // get server IPPort and server number (optionally) of a given object id,
@@ -73,11 +77,60 @@ public:
   void GetServerId(const COid& coid, IPPortServerno &ipps);
   //void GetServerId(const COid& coid, IPPort &ipport);
 
-  ObjectDirectory(ConfigState *cs){ Config = cs; }
+#ifdef GAIA_REPLICAS
+  // For a read of coid at ts, sets ipport to a replica of server serverno
+  // that can likely serve it and returns the replica's index. Returns -1 if
+  // there is none
+  int GetReplicaId(const COid &coid, int serverno, Timestamp &ts,
+                   IPPort &ipport);
+  // records safe timestamp d1 reported by a replica of server serverno, or
+  // by the server for all of its replicas if replica==-1
+  void reportReplicaSafe(int serverno, int replica, u64 safed1);
+#endif
+
+  ObjectDirectory(ConfigState *cs);
+  ~ObjectDirectory();
 };
 
 // stores a storage configuration, indicating names of storage servers, etc
 // It also includes the ObjectDirectory and the RPCTcp class to communicate with servers
+// Background commit phases of transactions (see GAIA_EARLY_COMMIT_ACK)
+class CommitQueue {
+private:
+  Semaphore Slots;      // free slots for transactions in flight
+  RWLock Lock;          // protects WaitingTs
+  Timestamp WaitingTs;  // largest waitingts reported by servers
+public:
+  CommitQueue() : Slots(GAIA_EARLY_COMMIT_MAXINFLIGHT) {
+    WaitingTs.setLowest();
+  }
+  // gets a slot for a transaction, waiting if all are in use
+  void acquire(void){ Slots.wait(INFINITE); }
+  // releases slot once commit phase of a transaction is done
+  void release(void){ Slots.signal(); }
+  // records a waitingts reported by a server
+  void reportWaitingTs(Timestamp &ts){
+    Lock.lock();
+    if (Timestamp::cmp(ts, WaitingTs) > 0) WaitingTs = ts;
+    Lock.unlock();
+  }
+  // returns largest waitingts reported since last call
+  Timestamp takeWaitingTs(void){
+    Timestamp ts;
+    Lock.lock();
+    ts = WaitingTs;
+    WaitingTs.setLowest();
+    Lock.unlock();
+    return ts;
+  }
+  // waits until no transactions are in flight
+  void drain(void){
+    int i;
+    for (i=0; i < GAIA_EARLY_COMMIT_MAXINFLIGHT; ++i) Slots.wait(INFINITE);
+    for (i=0; i < GAIA_EARLY_COMMIT_MAXINFLIGHT; ++i) Slots.signal();
+  }
+};
+
 class StorageConfig {
 private:
   // aux function: callback for shutdown rpc
@@ -96,6 +149,13 @@ public:
   ObjectDirectory *Od;
   Ptr<RPCTcp> Rpcc;
   ClientCache *CCache;
+#ifdef GAIA_STALE_READS
+  VersionCache VCache; // versions for transactions with a stale snapshot
+                       // and versions with leases (see GAIA_LEASES)
+#endif
+#ifdef GAIA_EARLY_COMMIT_ACK
+  CommitQueue CQ;  // commit phases sent in the background
+#endif
 
   // ping and wait for response once to each server (eg, to make sure
   // they are all up)
@@ -120,6 +180,9 @@ public:
      // uses a given RPCTcp object. Intended to be used at the server (who
      // wishes to make RPC calls to other servers)
   ~StorageConfig(){
+#ifdef GAIA_EARLY_COMMIT_ACK
+    CQ.drain(); // finish commits before disconnecting
+#endif
     if (CS && Rpcc.isset()) CS->disconnectHosts(Rpcc); // disconnect clients
     if (Od){ delete Od; Od=0; }
     if (CS){ delete CS; CS=0; }
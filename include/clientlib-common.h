@@ -96,7 +96,7 @@ public:
 struct PendingOpsEntry {
   ~PendingOpsEntry();
   PendingOpsEntry *next;
-  int type;   // 0 = add, 1 = delrange, 2 = attrset
+  int type;   // 0 = add, 1 = delrange, 2 = attrset, 3 = attradd
   int level;
   Ptr<RcKeyInfo> prki; // only valid if type==0 or 1. We put this here,
                        // instead of inside union, to avoid dealing with
@@ -107,7 +107,7 @@ struct PendingOpsEntry {
     struct { ListCell cell; } add;
     struct { ListCell cell1, cell2; int intervtype; }
       delrange;
-    struct { u32 attrid; u64 attrvalue; } attrset;
+    struct { u32 attrid; u64 attrvalue; } attrset; // also for attradd
   } u;
 };
 
@@ -143,10 +143,10 @@ private:
   // client really needs the full supervalue), we set TxCache[coid] and
   // then apply all the operations in PendingOps[coid].
 
-  int auxApplyOp(Ptr<Valbuf> vbuf, PendingOpsEntry *poe);
-  
-
 public:
+  // applies a pending ops entry to a valbuf. Returns 0 if ok, non-0 if error
+  static int auxApplyOp(Ptr<Valbuf> vbuf, PendingOpsEntry *poe);
+
   // ----- Operations that affect both cache and pendingOps ----------------
   void clear(); // clear entire cache and pendingops
   void abortLevel(int level); // remove entries with > level
@@ -69,6 +69,7 @@ private:
   int auxprepare(Timestamp &chosents);
   int auxcommit(int outcome, Timestamp committs);
   int auxsubtrans(int level, int action);
+  int auxattrop(COid coid, u32 attrid, u64 attrvalue, bool add);
 
 public:
   LocalTransaction();
@@ -101,6 +102,7 @@ public:
   int listDelRange(COid coid, u8 intervalType, ListCell *cell1,
                    ListCell *cell2, Ptr<RcKeyInfo> prki);
   int attrSet(COid coid, u32 attrid, u64 attrvalue);
+  int attrAdd(COid coid, u32 attrid, u64 delta); // adds delta to attribute
   int startSubtrans(int level);
   int abortSubtrans(int level);
   int releaseSubtrans(int level);
@@ -85,7 +85,16 @@ private:
   int readsTxCached;
   bool hasWrites;
   bool hasWritesCachable; // whether tx writes to cachable items
+#ifdef GAIA_LEASES
+  bool hasWritesLeased;   // whether tx writes to an object whose lease has
+                          // not ended, as reported by the prepare phase
+#endif
   int currlevel;          // current subtransaction level
+#ifdef GAIA_STALE_READS
+  int staleMs;            // if non-0, tx was started with startStale and its
+                          // first read will choose its snapshot
+  bool stale;             // whether tx reads from the cache of versions
+#endif
 
   char *piggy_buf;   // data to be piggybacked
   IPPortServerno piggy_server; // server holding coid to be written
@@ -116,6 +125,14 @@ private:
   //          GAIAERR_TX_ENDED = cannot read because transaction is aborted
   //          GAIAERR_WRONG_TYPE = wrong type
   int tryLocalRead(COid &coid, Ptr<Valbuf> &buf, int typ);
+#ifdef GAIA_STALE_READS
+  // Try to read a version of coid from the cache of versions of Sc, if tx
+  // has a stale snapshot or the version has a lease (see GAIA_LEASES).
+  // Returns 1 if read, 0 otherwise
+  int tryCachedRead(COid &coid, Ptr<Valbuf> &buf, int typ);
+  // Adds a version just read from a server to the cache of versions
+  void cacheRefresh(COid &coid, Ptr<Valbuf> &buf);
+#endif
 
   // ---------------------------- Prepare RPC ----------------------------------
 
@@ -156,6 +173,20 @@ private:
   //  or to smallest possible timestamp if no servers reported a legal timestamp
   int auxcommit(int outcome, Timestamp committs, Timestamp *waitingts);
 
+#ifdef GAIA_EARLY_COMMIT_ACK
+  struct CommitAsyncData {
+    CommitQueue *cq;
+    u32 pending;   // number of servers yet to reply
+  };
+
+  static void auxcommitasynccallback(char *data, int len, void *callbackdata);
+
+  // Commit part of two-phase commit, sent in the background. Returns
+  // without waiting for replies. Takes a slot from Sc->CQ (waiting if
+  // necessary), which is released when all servers reply
+  void auxcommitasync(int outcome, Timestamp committs);
+#endif
+
   // ---------------------------- Subtrans RPC ---------------------------------
 
   struct SubtransCallbackData {
@@ -166,6 +197,34 @@ private:
 
   static void auxsubtranscallback(char *data, int len, void *callbackdata);
   int auxsubtrans(int level, int action);
+
+  // ------------------------------ Read RPCs ----------------------------------
+
+  // process the reply of a READ or FULLREAD rpc, sent to the given replica
+  // of server or to server itself (replica==-1)
+  int auxvgetresp(COid &coid, IPPortServerno &server, char *resp,
+                  Ptr<Valbuf> &buf, int replica=-1);
+  int auxvsupergetresp(COid &coid, IPPortServerno &server, char *resp,
+                       Ptr<Valbuf> &buf, Ptr<Valbuf> base=Ptr<Valbuf>(),
+                       Ptr<RcKeyInfo> prki=Ptr<RcKeyInfo>(), int replica=-1);
+
+  struct ReadManyCallbackData {
+    Semaphore sem; // to wait for response
+    bool sent;     // whether an rpc was sent
+    IPPortServerno server;
+    int replica;   // replica of server where rpc was sent, -1 if none
+    char *resp;    // copy of the reply, 0 if error
+  };
+
+  static void auxreadmanycallback(char *data, int len, void *callbackdata);
+  // sends a READ (typ==0) or FULLREAD rpc for coid. If replicamiss<0, sends
+  // it to a replica of cd->server that can serve it, if any. Otherwise sends
+  // it to cd->server, saying whether a replica missed the object
+  void auxreadmanysend(COid &coid, int typ, ReadManyCallbackData *cd,
+                       int replicamiss);
+
+  // sets an attribute (add==false) or adds attrvalue to it (add==true)
+  int auxattrop(COid coid, u32 attrid, u64 attrvalue, bool add);
   
 
 public:
@@ -185,6 +244,23 @@ public:
   // having read.
   int startDeferredTs(void);
 
+#ifdef GAIA_STALE_READS
+  // start a transaction whose snapshot may be up to maxstalems old (at most
+  // GAIA_STALE_READS_MAX_MS), so that its reads can be served from versions
+  // that this client read recently. The first read chooses the snapshot: the
+  // oldest allowed timestamp at which a cached version of the object is
+  // valid, or the current time if the object is not cached. Meant for
+  // read-only transactions; a transaction that writes is more likely to abort
+  int startStale(int maxstalems);
+#endif
+
+#ifdef GAIA_LEASES
+  // returns whether a read of coid (typ 0=value, 1=supervalue) would be served
+  // from the cache of versions of Sc, e.g., because the version there has a
+  // lease that has not ended at the start timestamp
+  bool hasCachedVersion(COid &coid, int typ);
+#endif
+
   // write an object in the context of a transaction.
   // Returns status:
   //   0=no error
@@ -210,8 +286,25 @@ public:
   // what cell triggered the read of the supervalue (to trigger
   // load splits). It is legal to pass cell=0 and prki=(nullptr) to indicate
   // no particular cell, in which case these parameters are ignored.
+  // If base is given, *base may hold an earlier copy of coid read from the
+  // server, which the server then brings up to date by sending just the
+  // updates since then. On return, *base is set to buf if buf has exactly
+  // the server's version (without updates of this transaction), or cleared
+  // otherwise.
+  // If cellonly is set and coid is a dtree leaf, the server may send just
+  // the cells around cell, in which case buf->cellsBefore and
+  // buf->cellsAfter tell how many cells were left out. Such a buf is not
+  // cached by the transaction.
   int vsuperget(COid coid, Ptr<Valbuf> &buf, ListCell *cell,
-                Ptr<RcKeyInfo> prki);
+                Ptr<RcKeyInfo> prki, Ptr<Valbuf> *base=0,
+                bool cellonly=false);
+
+  // read n objects in parallel, rather than one after the other. typ is 0
+  // to read values (as in vget) or 1 to read supervalues (as in vsuperget).
+  // The value of coids[i] is placed in bufs[i], which is cleared if that
+  // read fails. Returns 0 if all reads succeeded, otherwise the error of
+  // some failed read.
+  int vgetMany(int n, COid *coids, Ptr<Valbuf> *bufs, int typ);
 
   static void readFreeBuf(char *buf); // frees a buffer returned by
                                       // readNewBuf() or get()
@@ -267,6 +360,10 @@ public:
   // sets an attribute
   int attrSet(COid coid, u32 attrid, u64 attrvalue);
 
+  // adds delta to an attribute. Unlike attrSet, adds of concurrent
+  // transactions to the same attribute do not conflict
+  int attrAdd(COid coid, u32 attrid, u64 delta);
+
   // start a subtransaction with the given level, which
   // must be greater than currlevel. Return 0 if ok, non-0 if error.
   int startSubtrans(int level);
@@ -104,6 +104,8 @@ inline u64 getCidTable(u64 dbid, u64 iTable){
 }
 
 void setRandomServerid(u64 *oid); // change oid to have a random serverid
+void setNeighborServerid(u64 *oid, u64 neighbor); // change oid to have the
+  // serverid of neighbor, within limits (see DTREE_LOCAL_PLACEMENT)
 void setOid(u64 *oid, u64 issuerid, u64 counter, u64 serverid); // constructs
   // oid from its components
 inline u64 getDbid(u64 cid){ return cid >> 32; } // return dbid of given cid
@@ -1092,7 +1092,10 @@ private:
   // leak.
   // Use instead the other copy method below
   // This is intended to be called only from the public copy constructor below
-  void copy(const SkipListBK &r, void (*copyvalue)(U, U&)){
+  // If copykey is non-zero, it is called to construct each key in place
+  // (with parm as its last argument) instead of T's copy constructor
+  void copy(const SkipListBK &r, void (*copyvalue)(U, U&),
+            void (*copykey)(T&, T*, void*)=0, void *parm=0){
     int i;
     SkipListNodeBK<T,U,Alloc> **missingprev, *ptr, *newnode;
     
@@ -1108,7 +1111,8 @@ private:
     while (ptr != r.Tail){
       newnode = SkipListNodeBK<T,U,Alloc>::newNode(ptr->nlevels);
       newnode->key = (T*) AMALLOC(sizeof(T));
-      new(newnode->key) T(*ptr->key);
+      if (copykey) copykey(*ptr->key, newnode->key, parm);
+      else new(newnode->key) T(*ptr->key);
       if (copyvalue) copyvalue(ptr->value, newnode->value);
       else newnode->value = ptr->value;
       
@@ -1184,6 +1188,13 @@ public:
   SkipListBK(const SkipListBK &r, void (*copyvalue)(U,U&)){
     copy(r, copyvalue);
   }
+
+  // copy constructor that calls copykey(key, newkey, parm) to construct the
+  // copy of each key in newkey
+  SkipListBK(const SkipListBK &r, void (*copyvalue)(U,U&),
+             void (*copykey)(T&, T*, void*), void *parm){
+    copy(r, copyvalue, copykey, parm);
+  }
   
   // Clear all items. If deleteitem == 1 then call delete on each key,
   // if deleteitem == 2, call delete on each value
@@ -56,6 +56,7 @@ class TaskInfo;
 using namespace std;
 
 enum LogEntryType { LEMultiWrite, LECommit, LEAbort, LEVoteYes };
+  // a LEMultiWrite record also records the yes vote of its transaction
 
 struct LogEntry {
   LogEntryType let; // for LECommit, LEAbort, LEVoteYes
@@ -63,12 +64,18 @@ struct LogEntry {
   Timestamp ts;
 };
 
-struct MultiWriteLogEntry {
-  LogEntryType let; // for LEMultiWrite
-  Tid tid;
-  Timestamp ts;
-  int ncoids;   // number of objects in this entry
-};
+// Format of log records. Each record has a fixed header followed by a
+// payload of the given length:
+//   u32 crc      CRC32C of the rest of the header and of the payload
+//   u32 len      length of payload
+//   u64 lsn      log sequence number, consecutive within a log file
+//   u8  version  DISKLOG_RECORD_VERSION
+//   u8  type     LogEntryType
+// Payloads store counts, lengths, ids, and values as varints. A record
+// whose version is wrong, whose length goes beyond the end of the data, or
+// whose crc does not match marks the end of the log (e.g., a torn write).
+#define DISKLOG_RECORD_VERSION 1
+#define DISKLOG_RECORD_HEADER 18 // size of record header
 
 struct WriteQueueItemBuf {
   int tofree; // whether to free buf afterwards
@@ -122,8 +129,13 @@ class DiskLog {
 private:
   int f; // file handle
 
-  char *RawWritebuf;     // unaligned buffer as returned by new()
-  char *Writebuf;        // aligned buffer to be used
+  // There are two write buffers. One is filled with new log entries while
+  // the other is being written and synced to disk by the sync thread, so
+  // that logging need not stop while a sync is in flight.
+  char *RawWritebufs[2]; // unaligned buffers as returned by new()
+  char *Writebufs[2];    // aligned buffers
+  int CurWritebuf;       // index of buffer being filled
+  char *Writebuf;        // aligned buffer being filled
   unsigned WritebufSize; // length of aligned buffer
   int WritebufLeft;      // number of bytes left in buffer
   char *WritebufPtr;     // current location in buffer
@@ -131,25 +143,69 @@ private:
 
   WriteQueueItem *WriteQueueHead, *WriteQueueTail;  // head and tail of
                                                    // write queue
+  WriteQueueItem *BatchHead, *BatchTail; // items written to Writebuf, to
+                         // be notified once Writebuf is synced to disk
+
+  char *RecBuf;          // buffer where a record is encoded
+  int RecBufSize;        // size of RecBuf
+  int RecLen;            // length of record in RecBuf
+  u64 NextLsn;           // lsn of next record
+
+  // batch handed to the sync thread
+  char *SyncBuf;         // buffer being written
+  int SyncLen;           // number of bytes to write (aligned)
+  u64 SyncOffset;        // offset in file where to write
+  WriteQueueItem *SyncItems; // items to notify once write is synced
+  int SyncBusy;          // whether batch was submitted and not yet reaped
+  int SyncDoneFlag;      // set by sync thread when batch is synced
+  int SyncExit;          // set to make sync thread exit
+  Semaphore SyncSubmit;  // signaled when a batch is submitted
+  Semaphore SyncDone;    // signaled when a batch is synced
+  TaskInfo *NotifyTask;  // task to wake up when a batch is synced
 
   void BufWrite(char *buf, int len);   // buffers a write to disk;
                                        // calls AlignWrite
   void auxwrite(char *buf, int len);   // writes an aligned buffer
-  void BufFlush(void);                 // flushes write done
+  void BufFlush(void);                 // submits buffered writes to disk,
+                                       // switching to the other buffer
+
+  void addToBatch(WriteQueueItem *head, WriteQueueItem *tail); // adds items
+                                       // to the batch of Writebuf
+  void reapSync(bool wait);  // if submitted batch has been synced, notifies
+                             // its items. If wait is set, wait for the sync
+  static void notifyItems(WriteQueueItem *wqi); // notifies and frees items
 
   void writeWqi(WriteQueueItem *wqi);  // writes a WriteQueueItem
-                                       // (calls BufWrite several times)
+                                       // as one log record
+  // functions to encode a record in RecBuf and write it with BufWrite
+  void recStart(void);                 // starts a new record
+  void recPut(const void *buf, int len); // appends bytes
+  void recPutVarint(u64 v);            // appends a varint
+  void recPutCell(ListCell *cell, int celltype); // appends a cell
+  void recEnd(int type);               // fills header and writes record
 
   static int PROGShipDiskReqs(TaskInfo *ti);
 
   int diskLogThreadNo;  // if diskLogThread is running, its thread number
   static OSTHREAD_FUNC diskLogThread(void *parm);  // example of a thread
                                                    // to run disklog
+  int syncThreadNo;     // thread number of sync thread, -1 if none
+
+  // The log can be striped across several files, each with its own DiskLog
+  // object and threads. Records of a transaction go to the stripe given by
+  // the hash of its tid, so they stay in order; records of different
+  // transactions can be merged by their timestamps.
+  int Stripe;           // index of this stripe
+  DiskLog *NextStripe;  // next stripe, owned by this object
+  static OSTHREAD_FUNC syncThread(void *parm); // thread that writes batches
+                                               // to disk and syncs them
 
 public:
   DiskLog(const char *logname);
   ~DiskLog();
-  void launch(void);  // creates disklog thread. If the thread is to do
+  void addStripe(const char *logname); // adds a file to stripe the log.
+                      // Must be called before launch().
+  void launch(void);  // creates disklog and sync threads of all stripes. If the thread is to do
        // other work, then caller should create the thread herself and then
        // invoke init() below within the thread.
   
@@ -173,6 +229,11 @@ public:
   // log an abort record
   static void logAbortAsync(Tid tid, Timestamp ts);
 
+  // Checks if buf (with len bytes) starts with a complete and valid record.
+  // Returns the length of the record if so, otherwise 0. Recovery should
+  // stop at the first record that is not valid.
+  static int checkRecord(char *buf, int len);
+
   // runs a test that logs consecutive integers from 0 to niter-1,
   // flushing batches of increasingly larger sizes
   void test(int niter);
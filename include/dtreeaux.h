@@ -92,11 +92,20 @@ public:
   bool isRoot(){ return raw->coid.oid==0; } // root is oid 0
   bool isLeaf(){ return (Flags() & DTREENODE_FLAG_LEAF) != 0; }
   bool isInner(){ return !isLeaf(); }
+  // a leaf may have only some of its cells (see auxReadReal). Returns
+  // whether index, from searching the cells it has for a key, is also the
+  // place of the key among all cells
+  bool coversIndex(int index){
+    return (index > 0 || raw->cellsBefore == 0) &&
+           (index < Ncells() || raw->cellsAfter == 0);
+  }
   bool isIntKey(){ 
     assert(((Flags() & DTREENODE_FLAG_INTKEY) != 0) ==
-           (raw->u.raw->CellType==0));
+           (raw->u.raw->CellType!=1));
     return (Flags() & DTREENODE_FLAG_INTKEY) != 0;
   }
+  // whether the tree of this node may keep rows inline in leaf cells
+  bool hasInlineRows(){ return raw->u.raw->CellType==2; }
 
   //void newEmpty(COid coid, bool intKey);   // create new empty node
   //                                   // intKey==true iff node stores integers
@@ -108,10 +117,11 @@ public:
 
 // prototype definitions
 int auxReadReal(KVTransaction *tx, COid coid, DTreeNode &outptr,
-                ListCell *cell, Ptr<RcKeyInfo> prki);
+                ListCell *cell, Ptr<RcKeyInfo> prki, bool cellonly=false);
 int auxReadCache(COid coid, DTreeNode &outptr);
 void auxRemoveCache(COid coid);
 int auxReadCacheOrReal(KVTransaction *tx, COid coid, DTreeNode &outptr,
-                       int &real, ListCell *cell, Ptr<RcKeyInfo> prki);
+                       int &real, ListCell *cell, Ptr<RcKeyInfo> prki,
+                       bool cellonly=false);
 
 #endif
@@ -69,8 +69,11 @@ const int NULL_RPCNO = 0,
           SHUTDOWN_RPCNO = 12,
           STARTSPLITTER_RPCNO = 13,
           FLUSHFILE_RPCNO = 14,
-          LOADFILE_RPCNO = 15;
+          LOADFILE_RPCNO = 15,
           // RPC 16 is used by storageserver-splitter.h when STORAGESERVER_SPLITTER is defined (see also splitter-client.h)
+          TXSTATUS_RPCNO = 17,
+          REPLICATE_RPCNO = 18,
+          ATTRADD_RPCNO = 19;
 
 // error codes
 #define GAIAERR_GENERIC         -1 // generic error code
@@ -90,6 +93,9 @@ const int NULL_RPCNO = 0,
 #define GAIAERR_NO_MEMORY      -12 // insufficient memory
 #define GAIAERR_CELL_OUTRANGE  -13 // cell does not belong to this coid
 #define GAIAERR_ATTR_OUTRANGE  -14 // attribute id out of range
+#define GAIAERR_REPLICA_BEHIND -15 // replica cannot serve reads at this
+                                   // timestamp yet (see GAIA_REPLICAS)
+#define GAIAERR_REPLICA_MISS   -16 // replica does not have the object
 #define GAIAERR_WRONG_TYPE     -99 // trying to read value but got supervalue,
                                    // or vice-versa
 
@@ -231,6 +237,8 @@ struct ReadRPCParm {
   Cid cid;       // container id
   Oid oid;       // object id
   int len;       // length
+  int replicamiss; // set if a replica of the server did not have the object;
+                   // the server then ships it to its replicas
 };
 
 class ReadRPCData : public Marshallable {
@@ -251,6 +259,8 @@ struct ReadRPCResp {
   u64 versionNoForCache;         // version number for cache
   Timestamp tsForCache;          // timestamp for cache
   Timestamp reserveTsForCache;   // reserve timestamp for cache
+  u64 replicasafed1;             // reads with a smaller timestamp d1 can go
+                                 // to the replicas (see GAIA_REPLICAS)
 };
 
 class ReadRPCRespData : public Marshallable {
@@ -311,6 +321,10 @@ struct PrepareRPCParm {
   int  readset_len;       // size of readset array below. Used in GAIA_OCC only
   COid *readset;          // used in GAIA_OCC only
 
+  int nparticipants;      // size of participants array below
+  IPPort *participants;   // servers in the transaction, so that a server can
+                          // find out the outcome from the others if the
+                          // client goes away. Used in GAIA_RESOLVE_ORPHANS
 };
 
 class PrepareRPCData : public Marshallable {
@@ -318,10 +332,13 @@ public:
   PrepareRPCParm *data;
   int deletedata;
   int deletereadset;
+  int deleteparticipants;
   char *freedatabuf;
-  PrepareRPCData()  { deletedata = 0; deletereadset = 0; freedatabuf = 0; }
+  PrepareRPCData()  { deletedata = 0; deletereadset = 0; deleteparticipants = 0;
+                      freedatabuf = 0; }
   ~PrepareRPCData(){ 
     if (deletereadset) delete [] data->readset;
+    if (deleteparticipants) delete [] data->participants;
     if (deletedata){ delete data; }
     if (freedatabuf) delete freedatabuf;
   }
@@ -338,6 +355,8 @@ struct PrepareRPCResp {
   u64 versionNoForCache;       // version number for cache
   Timestamp tsForCache;        // timestamp for cache
   Timestamp reserveTsForCache; // reserve timestamp for cache
+  int leased;                  // whether tx updates an object whose lease
+                               // has not ended (see GAIA_LEASES)
 };
 
 class PrepareRPCRespData : public Marshallable {
@@ -417,6 +436,55 @@ public:
   void demarshall(char *buf);
 };
 
+// ----------------------------- TXSTATUS RPC ----------------------------------
+// Sent by a server to the other servers of a transaction that voted yes
+// but whose outcome never arrived (see GAIA_RESOLVE_ORPHANS)
+
+#define TXSTATUS_PREPARED  0 // voted yes, outcome not known yet
+#define TXSTATUS_COMMITTED 1 // committed with the given timestamp
+#define TXSTATUS_ABORTED   2 // aborted, voted no, or had not voted (and now
+                             // will vote no)
+
+struct TxStatusRPCParm {
+  Tid tid;               // transaction id
+};
+
+class TxStatusRPCData : public Marshallable {
+public:
+  TxStatusRPCParm *data;
+  int freedata;
+  TxStatusRPCData()  { freedata = 0; }
+  ~TxStatusRPCData(){ if (freedata){ delete data; } }
+  int marshall(iovec *bufs, int maxbufs){
+    assert(maxbufs >= 1);
+    bufs[0].iov_base = (char*) data;
+    bufs[0].iov_len = sizeof(TxStatusRPCParm);
+    return 1;
+  }
+  void demarshall(char *buf){ data = (TxStatusRPCParm*) buf; }
+};
+
+struct TxStatusRPCResp {
+  int status;           // see TXSTATUS_... above
+  Timestamp committs;   // commit timestamp if status is TXSTATUS_COMMITTED,
+                        // proposed commit timestamp if TXSTATUS_PREPARED
+};
+
+class TxStatusRPCRespData : public Marshallable {
+public:
+  TxStatusRPCResp *data;
+  int freedata;
+  TxStatusRPCRespData(){ freedata = 0; }
+  ~TxStatusRPCRespData(){ if (freedata){ delete data; } }
+  int marshall(iovec *bufs, int maxbufs){
+    assert(maxbufs >= 1);
+    bufs[0].iov_base = (char*) data;
+    bufs[0].iov_len = sizeof(TxStatusRPCResp);
+    return 1;
+  }
+  void demarshall(char *buf){ data = (TxStatusRPCResp*) buf; }
+};
+
 // ---------------------------- SHUTDOWN RPC ----------------------------------
 struct ShutdownRPCParm {
   int reserved;  // reserved for future use
@@ -748,6 +816,17 @@ public:
   void demarshall(char *buf);
 };
 
+// ------------------------------- ATTRADD RPC -------------------------------
+// RPC to add a delta to an attribute of a Value. Uses the same parameters
+// as ATTRSET, with attrvalue being the (two's complement) delta. Adds of
+// different transactions to the same attribute do not conflict; they are
+// summed at commit time.
+
+typedef AttrSetRPCParm AttrAddRPCParm;
+typedef AttrSetRPCData AttrAddRPCData;
+typedef AttrSetRPCResp AttrAddRPCResp;
+typedef AttrSetRPCRespData AttrAddRPCRespData;
+
 
 // ------------------------------ ATTRGET RPC ----------------------------------
 // RPC to get the value of an attribute of a Value
@@ -793,12 +872,19 @@ public:
 struct FullReadRPCParm {
   Tid tid;            // transaction id
   Timestamp ts;       // timestamp
+  Timestamp cachedts; // commit timestamp of the client's copy of the object,
+                      // or illegal if it has none. If the server still has
+                      // the updates since then, it replies with just those
   Cid cid;            // container id
   Oid oid;            // object id
   int cellPresent;    // whether cell information is present
-  ListCell cell;      // if cellPresent: desired cell. This is used only to
+  ListCell cell;      // if cellPresent: desired cell. This is used to
                       // keep stats of which cell caused the read, to be used
-                      // for load splits
+                      // for load splits, and for cellOnly below
+  int cellOnly;       // if set and object is a dtree leaf, the server may
+                      // reply with just the cells around cell
+  int replicamiss;    // set if a replica of the server did not have the
+                      // object; the server then ships it to its replicas
   Ptr<RcKeyInfo> prki;// cell type
   ~FullReadRPCParm(){ cell.Free(); }
 };
@@ -822,18 +908,29 @@ public:
 
 struct FullReadRPCResp {
   int status;                  // operation status, -99 if not supervalue
-  int dummy;                   // dummy parameter
+  int delta;                   // if set, celloids has the list deltas since
+                               // the cachedts in the request (see
+                               // TucoidsToDeltas) rather than the whole list
   Timestamp readts;            // timestamp of value
+  Timestamp leasets;           // if legal, the version read is the value of
+                               // the object until this timestamp (see
+                               // GAIA_LEASES)
   u16 nattrs;                  // number of 64-bit attribute values
   u8  celltype;                // type of cells: 0=int, 1=nKey+pKey
-  u32 ncelloids;               // number of (cell,oid) pairs in list
+  u32 ncelloids;               // number of (cell,oid) pairs in list, or of
+                               // deltas if delta is set
   u32 lencelloids;             // length in bytes of (cell,oid) pairs
+  u32 cellsbefore;             // # of cells of the object left out of
+                               // the reply before celloids (see cellOnly)
+  u32 cellsafter;              // # of cells left out after celloids
   u64 *attrs;                  // value of attributes
   char *celloids;              // list with celloids
   Ptr<RcKeyInfo> prki;         // keyinfo if available
   u64 versionNoForCache;       // version number for cache
   Timestamp tsForCache;        // timestamp for cache
   Timestamp reserveTsForCache; // reserve timestamp for cache
+  u64 replicasafed1;           // reads with a smaller timestamp d1 can go
+                               // to the replicas (see GAIA_REPLICAS)
 };
 
 class FullReadRPCRespData : public Marshallable {
@@ -921,4 +1018,71 @@ public:
   void demarshall(char *buf);
 };
 
+// ------------------------------ REPLICATE RPC -------------------------------
+// Sent by a server to its replicas with the value of an object at some
+// timestamp, or with just a new safe timestamp (see replica-server.h)
+
+struct ReplicateRPCParm {
+  u64 epoch;          // replication epoch of server. A replica that gets a
+                      // higher epoch drops all its objects
+  u64 cutoffd1;       // in the epoch, the replica ignores versions and reads
+                      // whose timestamp d1 is smaller than this
+  u64 safed1;         // if type==-1: all commits whose timestamp d1 is
+                      // smaller than this have reached the replica
+  u64 incarnation;    // if type==-1: incarnation of the replica that has
+                      // them, or 0 if not known yet (then safed1 is ignored)
+  Cid cid;            // container id
+  Oid oid;            // object id
+  Timestamp ts;       // timestamp of value
+  int type;           // 0=value, 1=supervalue, -1=no value (just safed1)
+  int len;            // if type==0: length of buf
+  u16 nattrs;         // if type==1: number of 64-bit attribute values
+  u8  celltype;       //             type of cells: 0=int, 1=nKey+pKey
+  u32 ncelloids;      //             number of (cell,oid) pairs in list
+  u32 lencelloids;    //             length in bytes of (cell,oid) pairs
+  char *buf;          // if type==0: value
+  u64 *attrs;         // if type==1: value of attributes
+  char *celloids;     //             list with celloids
+  Ptr<RcKeyInfo> prki;//             key info
+};
+
+class ReplicateRPCData : public Marshallable {
+private:
+  char *serializeKeyinfoBuf;  // buffer allocated at marshall() to serialize
+                              // RcKeyInfo, at the server sending the RPC
+public:
+  ReplicateRPCParm *data;
+  int freedata;
+  Ptr<TxUpdateCoid> tucoid; // holds the value being sent, at the server
+                            // sending the RPC
+  ReplicateRPCData(){ serializeKeyinfoBuf = 0; freedata = 0; }
+  ~ReplicateRPCData(){
+    if (serializeKeyinfoBuf) free(serializeKeyinfoBuf);
+    if (freedata) delete data;
+  }
+  int marshall(iovec *bufs, int maxbufs);
+  void demarshall(char *buf);
+};
+
+struct ReplicateRPCResp {
+  int status;       // 0 if ok, GAIAERR_REPLICA_BEHIND if epoch is old or
+                    // incarnation does not match
+  u64 incarnation;  // incarnation of replica, chosen when it starts
+};
+
+class ReplicateRPCRespData : public Marshallable {
+public:
+  ReplicateRPCResp *data;
+  int freedata;
+  ReplicateRPCRespData(){ freedata = 0; }
+  ~ReplicateRPCRespData(){ if (freedata){ delete data; } }
+  int marshall(iovec *bufs, int maxbufs){
+    assert(maxbufs >= 1);
+    bufs[0].iov_base = (char*) data;
+    bufs[0].iov_len = sizeof(ReplicateRPCResp);
+    return 1;
+  }
+  void demarshall(char *buf){ data = (ReplicateRPCResp*) buf; }
+};
+
 #endif
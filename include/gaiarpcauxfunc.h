@@ -43,12 +43,13 @@
 #include "record.h"
 #include "supervalue.h"
 
+class TxUpdateCoid;
 
 // returns the serialized size in bytes of a cell
-int CellSize(ListCellPlus *lc);
+int CellSize(ListCellPlus *lc, int celltype);
 
 // returns the serialized size in bytes of a list of cells
-int ListCellsSize(SkipListBK<ListCellPlus,int> &cells);
+int ListCellsSize(SkipListBK<ListCellPlus,int> &cells, int celltype);
 
 // converts serialized celloids into items put inside skiplist of cells
 void CelloidsToListCells(char *celloids, int ncelloids, int celltype,
@@ -56,8 +57,16 @@ void CelloidsToListCells(char *celloids, int ncelloids, int celltype,
                          Ptr<RcKeyInfo> *pprki);
 
 // converts listcells to serialized celloids
-char *ListCellsToCelloids(SkipListBK<ListCellPlus,int> &cells, int &ncelloids,
-                          int &lencelloids);
+char *ListCellsToCelloids(SkipListBK<ListCellPlus,int> &cells, int celltype,
+                          int &ncelloids, int &lencelloids);
+
+// converts the list operations in a sequence of tucoids to serialized deltas
+char *TucoidsToDeltas(Ptr<TxUpdateCoid> *tucoids, int ntucoids,
+                      int &ndeltas, int &lendeltas);
+
+// extracts one delta from serialized deltas; returns pointer to the next one
+char *DeltasGetOne(char *ptr, int &type, int &intervaltype, ListCell *cell1,
+                   ListCell *cell2);
 
 int marshall_keyinfo(Ptr<RcKeyInfo> prki, iovec *bufs, int maxbufs,
                      char **retbuf);
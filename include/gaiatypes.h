@@ -145,6 +145,10 @@ public:
   void setLowest(void);
   void setHighest(void);
 
+  // sets timestamp to one of the lowest timestamps that are bigger than all
+  // timestamps whose first word (see getd1) is at most d1
+  void setAfterd1(u64 d1);
+
   // sets timestamp as an illegal timestamp. It is also the real lowest
   // timestamp.
   void setIllegal(void){ d[0] = d[1] = 0; }
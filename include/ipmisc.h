@@ -124,6 +124,9 @@ public:
    // return my own ip address
   static u32 getMyIP(u32 preferip=0, u32 prefermask=0);
 
+  // return whether ip is an address of this host (including loopback)
+  static bool isLocal(u32 ip);
+
   // Return printable string for given ip.
   // Returned value is overwritten on each call.  
   static char *ipToStr(u32 ip); 
@@ -64,11 +64,14 @@ void KVInterfaceInit(void);
 
 struct GlobalCacheEntry {
   Ptr<Valbuf> vbuf;
+  Timestamp realTs; // commitTs of vbuf if vbuf is exactly a version read
+                    // from the server, illegal otherwise
 };
 
 class GlobalCache {
 private:
   static int auxExtractVbuf(COid &coid, GlobalCacheEntry *gce, int status, SkipList<COid,GlobalCacheEntry> *b, u64);
+  static int auxExtractRealVbuf(COid &coid, GlobalCacheEntry *gce, int status, SkipList<COid,GlobalCacheEntry> *b, u64);
   static int auxReplaceVbuf(COid &coid, GlobalCacheEntry *gce, int status, SkipList<COid,GlobalCacheEntry> *b, u64);
   HashTableMT<COid,GlobalCacheEntry> Cache;
 public:
@@ -80,14 +83,19 @@ public:
   // Returns 0 if item was found, non-zero if not found.
   int lookup(COid &coid, Ptr<Valbuf> &vbuf);
 
+  // like lookup, but finds the entry only if it is exactly a version read
+  // from the server (as opposed to a version updated by the client)
+  int lookupReal(COid &coid, Ptr<Valbuf> &vbuf);
+
   // Remove a coid from the cache.
   // Returns 0 if item was found and removed, non-zero if not found
   int remove(COid &coid);
 
   // Refresh cache if given vbuf is newer than what is in there.
-  // If refreshing, make a new copy of the buffer.
+  // If refreshing, make a new copy of the buffer. real indicates whether
+  // vbuf is exactly a version read from the server.
   // Returns 0 if item was refreshed, non-zero if it was not.
-  int refresh(Ptr<Valbuf> &vbuf);
+  int refresh(Ptr<Valbuf> &vbuf, bool real=false);
 };
 
 extern GlobalCache GCache;
@@ -145,7 +153,8 @@ int memKVput2(KVTransaction *tx, COid &coid,  char *data1, int len1,
 int memKVput3(KVTransaction *tx, COid &coid,  char *data1, int len1,
               char *data2, int len2, char *data3, int len3);
 
-int beginTx(KVTransaction **txp, bool remote=true, bool deferred=false);
+int beginTx(KVTransaction **txp, bool remote=true, bool deferred=false,
+            int stalems=0);
 int commitTx(KVTransaction *tx, Timestamp *retcommitts=0);
 int abortTx(KVTransaction *tx);
 int freeTx(KVTransaction *tx);
@@ -163,9 +172,16 @@ int KVput2(KVTransaction *tx, COid coid,  char *data1, int len1,
 int KVput3(KVTransaction *tx, COid coid,  char *data1, int len1,
            char *data2, int len2, char *data3, int len3);
 
+// base and cellonly are as in Transaction::vsuperget
 int KVreadSuperValue(KVTransaction *tx, COid coid, Ptr<Valbuf> &buf,
-                     ListCell *cell, Ptr<RcKeyInfo> prki);
+                     ListCell *cell, Ptr<RcKeyInfo> prki,
+                     Ptr<Valbuf> *base=0, bool cellonly=false);
 int KVwriteSuperValue(KVTransaction *tx, COid coid, SuperValue *sv);
+
+// reads n values (typ=0) or supervalues (typ=1) in parallel, placing the
+// result for coids[i] in bufs[i]. Returns 0 if all reads succeeded
+int KVreadMany(KVTransaction *tx, int n, COid *coids, Ptr<Valbuf> *bufs,
+               int typ);
 #if DTREE_SPLIT_LOCATION != 1
   int KVlistadd(KVTransaction *tx, COid coid, ListCell *cell,
                 Ptr<RcKeyInfo> prki, int flags);
@@ -178,6 +194,14 @@ int KVwriteSuperValue(KVTransaction *tx, COid coid, SuperValue *sv);
 int KVlistdelrange(KVTransaction *tx, COid coid, u8 intervalType,
                    ListCell *cell1, ListCell *cell2, Ptr<RcKeyInfo> prki);
 int KVattrset(KVTransaction *tx, COid coid, u32  attrid, u64 attrval);
+// adds delta to an attribute. Concurrent adds to the same attribute do not
+// conflict, so this is the way to update counters
+int KVattradd(KVTransaction *tx, COid coid, u32  attrid, u64 delta);
+
+// returns whether supervalue coid can be read from a client cache that is
+// consistent with the transaction's snapshot (e.g., because a server gave a
+// lease on it), without contacting the servers
+int KVcachedSuperValue(KVTransaction *tx, COid coid);
 
 int KVtxreadonly(KVTransaction *tx); // return whether transaction is
                                      // read-only so far
@@ -113,16 +113,62 @@ public:
   }
 };
 
+#ifdef LOG_LOCKFREE_READS
+// Newest committed version of an object, published for reads that do not
+// lock the object (see LogInMemory::readCOidFast). It does not change once
+// published. When withdrawn, it is freed only after every reader that might
+// have seen it is done (see LogInMemory::retireReadView).
+struct LooimReadView {
+  Timestamp ts;              // timestamp of version
+  Ptr<TxUpdateCoid> tucoid;  // checkpoint with contents of version
+  u64 retireepoch;           // read epoch when view was withdrawn
+  LooimReadView *next;       // linklist of withdrawn views
+};
+#endif
+
 // entry for a given COid in LogInMemory
 class LogOneObjectInMemory {
 private:
   RWLock object_lock; // lock for object
 public:
-  LogOneObjectInMemory(){ LastRead.setLowest(); }
+  LogOneObjectInMemory(){
+    LastRead.setLowest();
+#ifdef LOG_LOCKFREE_READS
+    readview = 0;
+    LastReadFast = 0;
+#endif
+#ifdef GAIA_LEASES
+    LeaseTs.setLowest();
+#endif
+  }
   LinkList<SingleLogEntryInMemory> logentries;
   LinkList<SingleLogEntryInMemory> pendingentries;
 
   Timestamp LastRead; // Largest timestamp of a read on object
+#ifdef LOG_LOCKFREE_READS
+  // Version that can be read without the object lock, or 0 if none. It is
+  // set only while there are no pending entries and no log entries after it.
+  // Changed only with the object lock held in write mode.
+  LooimReadView * volatile readview;
+  u64 LastReadFast; // largest first word of the timestamp of a read done
+                    // without the object lock. Updated atomically.
+#endif
+#ifdef GAIA_LEASES
+  Timestamp LeaseTs; // end of the latest lease given on object (see
+                     // LogInMemory::grantLease). Also reflected in LastRead
+#endif
+
+  // Largest timestamp of a read on object, including reads done without the
+  // object lock. Those reads record only the first word of their timestamp,
+  // so this may be a bit bigger than the actual largest read. Assumes the
+  // object lock is held in write mode and readview is 0.
+  Timestamp getLastRead(){
+#ifdef LOG_LOCKFREE_READS
+    u64 fast = LastReadFast;
+    if (fast >= LastRead.getd1()) LastRead.setAfterd1(fast);
+#endif
+    return LastRead;
+  }
 
   // convenience methods to lock/unlock looim
 #ifndef SKIP_LOOIM_LOCKS
@@ -150,9 +196,30 @@ private:
   // auxilliary functions
   static void getAndLockaux(int res, LogOneObjectInMemory **looimptr);
 
+#ifdef LOG_LOCKFREE_READS
+  // Publishes a version of an object for reads without the object lock.
+  // Assumes looim->object_lock is held in write mode.
+  void publishReadView(LogOneObjectInMemory *looim, Timestamp ts,
+                       Ptr<TxUpdateCoid> tucoid);
+
+  // Tries to read an object without locking it, using the version published
+  // in its looim. Returns 0 if it succeeds, non-zero if the caller should
+  // take the regular path.
+  int readCOidFast(COid& coid, Timestamp ts, Ptr<TxUpdateCoid> &rettucoid,
+                   Timestamp *readts);
+#endif
+
 public:
   LogInMemory(DiskStorage *ds);
 
+#ifdef LOG_LOCKFREE_READS
+  // Withdraws the version published for reads without the object lock, if
+  // any. This must be done before adding log or pending entries, and before
+  // reading the LastRead timestamp to pick a commit timestamp.
+  // Assumes looim->object_lock is held in write mode.
+  static void retireReadView(LogOneObjectInMemory *looim);
+#endif
+
   // Return entry for an object and locks it for reading or writing.
   // If entry does not exist, create it, reading object from disk
   // to set the sole entry in the log.
@@ -191,6 +258,9 @@ public:
     wheretoadd = &looim->logentries;
 
     sleim->tucoid = tucoid;
+#ifdef LOG_LOCKFREE_READS
+    retireReadView(looim);
+#endif
 
     // find position where to add while maintaining sorted order
     for (sleim2 = wheretoadd->rGetFirst(); sleim2 != wheretoadd->rGetLast();
@@ -210,7 +280,9 @@ public:
           TxListItem *tli = tucoid->Litems.getFirst();
           if (tli->type == 0){
             TxListAddItem *tliadd = dynamic_cast<TxListAddItem*>(tli);
-            if (sleim2->tucoid->WriteSV->cells.belongs(&tliadd->item)){
+            ListCellPlus *found = sleim2->tucoid->WriteSV->cells.
+              keyInInterval(&tliadd->item, &tliadd->item, 4); // [item,item]
+            if (found && ListCell::samePayload(*found, tliadd->item)){
               //printf("auxAddSleimToLogentries: Item already there!\n");
               delete sleim;
               goto end; // item already there, nothing to do
@@ -262,6 +334,9 @@ public:
     wheretoadd = &looim->pendingentries;
 
     sleim->tucoid = tucoid;
+#ifdef LOG_LOCKFREE_READS
+    retireReadView(looim);
+#endif
 
     // find position where to add while maintaining sorted order
     for (sleim2 = wheretoadd->rGetFirst(); sleim2 != wheretoadd->rGetLast();
@@ -306,6 +381,23 @@ public:
   int readCOid(COid& coid, Timestamp ts, Ptr<TxUpdateCoid> &rettucoid,
                Timestamp *readts, void *deferredhandle);
 
+  // Collects the updates to coid committed after sincets and up to ts, so
+  // that a holder of the version at sincets can bring it to the version at
+  // ts by applying them in order, as readCOid does. Puts at most maxtucoids
+  // of them in tucoids and returns their number. Returns -1 if the log no
+  // longer has an entry at sincets, if some update is a full write, or if
+  // there are more than maxtucoids updates.
+  int readCOidDeltas(COid& coid, Timestamp sincets, Timestamp ts,
+                     Ptr<TxUpdateCoid> *tucoids, int maxtucoids);
+
+#ifdef GAIA_LEASES
+  // Gives a lease until leasets on the version of coid at versionts, if it
+  // is the newest version and no transaction is preparing to change the
+  // object: updates to the object will then commit after leasets.
+  // Returns 0 if the lease was given, non-0 otherwise.
+  int grantLease(COid& coid, Timestamp versionts, Timestamp leasets);
+#endif
+
   // after writing, twi or twsvi will be owned by LogInMemory. Caller should
   // have allocated it and should not free it.
   int writeCOid(COid& coid, Timestamp ts, Ptr<TxUpdateCoid> tucoid);
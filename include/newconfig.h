@@ -39,6 +39,9 @@
 #define _NEWCONFIG_H
 
 #define DEFAULT_PORT 12121
+#define MAX_LOGFILES 8 // max number of log files per host. The log is striped
+                       // across them, each written by its own thread
+#define MAX_REPLICAS 4 // max number of read-only replicas per server
 
 #include <list>
 #include "inttypes.h"
@@ -51,8 +54,10 @@ using namespace std;
 struct ServerHT {
   int id;
   IPPort ipport;
-  ServerHT(int i, IPPort ipp){ id=i; ipport=ipp; }
-  ServerHT(){}
+  int nreplicas;                  // number of read-only replicas of server
+  IPPort replicas[MAX_REPLICAS];  // their IPs and ports
+  ServerHT(int i, IPPort ipp){ id=i; ipport=ipp; nreplicas=0; }
+  ServerHT(){ nreplicas=0; }
   // stuff for HashTable
   ServerHT *prev, *next, *sprev, *snext;
   int GetKey(){ return id; }
@@ -69,7 +74,9 @@ public:
   IPPort ipport;   // IP and port of host
   char *hostname;  // name of host
   int port;        // port number
-  char *logfile;   // name of log file
+  char *logfile;   // name of (first) log file
+  int nlogfiles;   // number of log files
+  char *logfiles[MAX_LOGFILES]; // names of log files
   char *storedir;  // name of directory where objects are stored.
                    // Should end with '/'
 
@@ -90,6 +97,8 @@ private:
   list<int> errRepeatedGroups;
   list<pair<IPPort,char*>> errRepeatedIPPort;
   list<int> errRepeatedServer;
+  list<pair<int,IPPort>> replicaDecls; // (server, replica) pairs, attached to
+                                       // servers in check()
   
 public:
   HashTableBK<IPPort,HostConfig> Hosts;
@@ -105,6 +114,10 @@ public:
   void addHost(HostConfig *toadd);
   void addServer(int server, char *hostname, int port, u32 preferip,
                  u32 prefermask);
+  void addReplica(int server, char *hostname, int port, u32 preferip,
+                  u32 prefermask);
+  // returns the server of which ipport is a replica, or -1 if none
+  int replicaOf(IPPort ipport);
   
   void setNgroups(int ngroups){ Ngroups = ngroups; }
   void setStripeMethod(int value){ StripeMethod = value; }
@@ -115,6 +115,107 @@
 #define GAIA_WRITE_ON_PREPARE_MAX_BYTES 4096
 // Max # of bytes to piggyback on prepare phase if GAIA_WRITE_ON_PREPARE is set
 
+#define GAIA_READMANY_WINDOW 256
+// Max # of reads that a batched read (Transaction::vgetMany) keeps outstanding
+// at once
+
+#define GAIA_EARLY_COMMIT_ACK
+// If defined, Transaction::tryCommit returns as soon as the prepare phase
+// decides the outcome, and the commit phase is sent to servers in the
+// background. Servers defer reads of the transaction's objects until the
+// commit arrives, and the commit goes on the same connection ahead of the
+// client's later requests, so later transactions still see its writes
+
+#define GAIA_EARLY_COMMIT_MAXINFLIGHT 64
+// Max # of transactions whose commit phase is in the background at once,
+// for each StorageConfig. Further commits wait for a slot
+
+#define GAIA_DELTA_READS
+// If defined, a client re-reading an inner node that it has in its node
+// cache sends the commit timestamp of its copy, and the server replies with
+// just the list updates committed since then, if its in-memory log still
+// has them
+
+#define GAIA_DELTA_READS_MAXENTRIES 32
+// Max # of log entries that a server sends as deltas in a read reply. If
+// more entries are needed, it sends the whole node instead
+
+#define GAIA_POINT_READS
+// If defined, a read-only dtree cursor seeking a key asks the server for
+// just the cells of the leaf around that key, rather than the whole leaf.
+// The cursor reads the whole leaf only if it later moves past those cells
+
+#define GAIA_POINT_READS_CELLS 4
+// # of cells that a server sends for such a read: the last cell smaller than
+// the key followed by the next cells. Leaves with at most this many cells
+// are sent whole
+
+#define GAIA_RESOLVE_ORPHANS
+// If defined, a client sends the list of servers in a transaction with its
+// prepare. If a server has a transaction that voted yes but whose outcome
+// does not arrive within GAIA_RESOLVE_ORPHANS_MS (e.g., the client died),
+// the server asks the other servers about it. If one of them committed or
+// aborted the transaction, or had not voted yet (it will now vote no), the
+// server tells all of them to commit or abort it, which wakes up reads
+// deferred on its pending updates. If all of them voted yes, the server
+// commits it with the timestamp that the client would have chosen. If some
+// server does not answer, the server asks again later
+
+#define GAIA_RESOLVE_ORPHANS_MS 3000
+// How long a server waits for the outcome of a transaction that voted yes
+// before asking the other servers about it, and between later attempts
+
+#define GAIA_RESOLVE_ORPHANS_KEEP_MS 60000
+// How long a server remembers the outcome of a transaction that spans
+// several servers, to answer servers asking about it
+
+#define GAIA_REPLICAS
+// If defined, a server with "replica" entries in the configuration file
+// ships the value of each object that it commits to those replicas, which
+// keep the values in memory and serve reads of them. The server
+// periodically tells the replicas a safe timestamp: all commits with smaller
+// timestamps have reached them, and no later commit will get a smaller
+// timestamp. Clients send reads at timestamps below the safe timestamp of a
+// replica to the replica, and send the read to the server if the replica
+// does not have the object
+
+#define GAIA_REPLICAS_SAFETS_MS 10
+// How often a server with replicas advances their safe timestamp. Snapshot
+// reads can go to replicas once they are about this old
+
+#define GAIA_STALE_READS
+// If defined, a client can start a transaction whose snapshot is up to a
+// given number of ms old (Transaction::startStale, PRAGMA read_staleness).
+// Such transactions read objects from a client cache of versions
+// (VersionCache in ccache.h) when a cached version is valid at their
+// snapshot, without contacting the servers
+
+#define GAIA_STALE_READS_MAX_MS 5000
+// Largest staleness that a transaction may ask for
+
+#define VCACHE_HASHTABLE_SIZE 1024
+#define VCACHE_BUCKET_MAX 64
+// Number of buckets of the cache of versions, and maximum number of objects
+// in each bucket. When a bucket is full, the object whose version was read
+// longest ago is evicted
+
+#define GAIA_LEASES
+// If defined, a server that reads the newest version of an inner DTree node
+// of height at least GAIA_LEASES_MIN_HEIGHT, while no transaction is
+// preparing to change it, gives the reader a lease: no update to the node
+// will commit with a timestamp before the lease ends, GAIA_LEASES_MS from
+// now. Clients keep leased nodes in their cache of versions (see
+// GAIA_STALE_READS), so transactions that start before the lease ends read
+// them without contacting the server. A transaction that updates a node
+// with a lease commits after the lease ends, and its client waits until
+// then before returning. Needs GAIA_STALE_READS
+
+#define GAIA_LEASES_MS 250
+// Length of a lease
+
+#define GAIA_LEASES_MIN_HEIGHT 2
+// Smallest height of the nodes that get leases (leaves have height 0)
+
 #define PENDINGTX_HASHTABLE_SIZE 101
 // Size of hash table for pending transactions. Each hash table bucket
 // consists of a skiplist. The hash table is mostly useful for
@@ -144,9 +245,12 @@
 #define SERVER_DEFAULT_PORT 11223
 // Default port number for storage server
 
-#define CLIENT_WORKERTHREADS 1
-// Number of worker threads for client. The system was designed to work
-// with more than 1 client worker threads but it has not been tested.
+#define CLIENT_WORKERTHREADS 4
+// Number of worker threads for client, capped at the number of processors.
+// Worker threads receive RPC replies and run their callbacks. The client
+// opens one connection to each server per worker thread, and the RPCs of
+// an application thread always use the same connection (chosen by the
+// hash id of the RPC, see FLAG_HID)
 
 #define SERVER_WORKERTHREADS 1
 // Number of worker threads for server. The system was designed to work
@@ -160,6 +264,36 @@
 #define TCP_RECLEN_DEFAULT 64000
 // Size of buffers to receive network data
 
+#define TCP_BATCH_MAXMSGS 64
+// Max # of RPC messages (requests or replies, possibly of different
+// transactions) that the TCP layer packs into one batch frame when several
+// are queued for the same connection. Set to 1 to disable batch frames
+
+#define TCP_BATCH_WINDOW_US 20
+// If the last send of a TCP worker thread packed several messages, the
+// thread keeps collecting messages for up to this many microseconds before
+// sending again, so that they go in the same batch. This happens only under
+// load, so it does not add latency when traffic is light. Set to 0 to disable
+
+#define TCP_SHM
+// If defined, a client connecting to a server on the same host talks to it
+// through ring buffers in shared memory instead of TCP loopback. The
+// connection is set up over a Unix socket, falling back to TCP if that
+// fails
+
+#define TCP_SHM_RINGSIZE (1<<20)
+// Size in bytes of each ring buffer (one per direction) of a shared-memory
+// connection. Must be a power of 2
+
+#define TCP_SHM_IDLE_SPIN 200
+// Number of idle iterations that a TCP worker thread with shared-memory
+// connections keeps polling their rings before going to sleep. While it
+// polls, peers do not need to ring its doorbell. There is no spinning on
+// single-processor machines
+
+//#define TCP_SHM_HUGETLB
+// If defined, try to back shared-memory connections with huge pages
+
 
 // IN-MEMORY LOG OPTIONS ----------------------------------------------------
 
@@ -175,6 +309,25 @@
 #define LOG_CHECKPOINT_MIN_DELRANGEITEMS 1
 // Store checkpoint in in-memory log if find at least this many delrange items.
 
+#define LOG_LOCKFREE_READS
+// If defined, once a read brings an object up to date and no transaction is
+// preparing to change it, the storage server publishes that version in the
+// object's log entry, and later reads at or after that version take it
+// without locking the object. Any new pending or committed update withdraws
+// the published version.
+
+#define LOG_LOCKFREE_READS_MAXTHREADS 256
+// Max number of server threads that can read without locks. Additional
+// threads always lock the object.
+
+#define LOG_LOCKFREE_READS_RECLAIM 64
+// A thread frees the published versions it has withdrawn once it has this
+// many of them (and no lock-free reader may still be looking at them)
+
+#define LOG_LOCKFREE_READS_LOOIMCACHE 256
+// Number of entries in the per-thread cache that maps COids to their log
+// entries, which lets lock-free reads skip the hash table lock.
+
 #define COID_CACHE_HASHTABLE_SIZE 1159523
 // Size of hash table for keeping the in-memory log.
 
@@ -204,7 +357,8 @@
 
 #define WRITEBUFSIZE (64*1024*1024)
 // Size of buffer used to group together writes that need to be flushed
-// to disk.
+// to disk. Two such buffers are allocated, so that one can be filled while
+// the other is being synced.
 
 
 // DISTRIBUTED B-TREE OPTIONS -------------------------------------------------
@@ -251,6 +405,46 @@
 #define DTREE_OPTIMISTIC_INSERT
 // Use optimization of optimistic inserts.
 
+#define DTREE_LOCAL_PLACEMENT
+// If defined, the node created by a split goes to the server of the node
+// being split, which is its right sibling, instead of a random server. This
+// way adjacent leaves form runs on the same server. See the two caps below.
+
+#define DTREE_LOCAL_PLACEMENT_MAXRUN 32
+// Max # of nodes in a row that a splitter thread places on the same server.
+// The next node goes to a random server, which starts a new run.
+
+#define DTREE_LOCAL_PLACEMENT_MAXLOAD 150
+// A splitter thread stops placing nodes on the server of their sibling once
+// that server got more than this percentage of the average # of nodes per
+// server that the thread placed
+
+#define DTREE_BULKLOAD_FILL 75
+// Percentage of DTREE_SPLIT_SIZE and DTREE_SPLIT_SIZE_BYTES up to which the
+// bulk loader fills the nodes it builds. Leaving some room avoids splits
+// when keys are later inserted into a bulk-loaded tree.
+
+#define DTREE_BULKLOAD_MAX_CELLS 4000000
+// Maximum number of keys that a bulk load buffers at the client. Once this
+// is reached, the buffered keys are written to the tree and subsequent keys
+// are inserted one at a time.
+
+#define DTREE_SCAN_PREFETCH
+// If defined, full scans of a table to build an index read the leaves under
+// each inner node, and the rows of those leaves, with parallel batched reads
+// rather than one read at a time.
+
+#define DTREE_INLINE_ROW_MAX 128
+// If defined, tables created afterwards keep rows of up to this many bytes
+// inline in their leaf cells, instead of in separate data objects, so that
+// reading a leaf also reads its rows. Larger rows keep a data object.
+
+#define DTREE_ROW_PREFETCH 64
+// If defined, an index scan that looks up the row of each index entry in the
+// table fetches the rows of up to this many of the following index entries
+// with parallel batched reads. The batch starts small and doubles while the
+// scan keeps consuming it.
+
 //#define ALL_SPLITS_UNCONDITIONAL
 // If defined, splitter server always tries to split a node, even if a recent
 // identical request was made
@@ -291,6 +485,10 @@
 #error DTREE_LOADSPLITS works only when DTREE_SPLIT_LOCATION=2
 #endif
 
+#if defined(GAIA_LEASES) && !defined(GAIA_STALE_READS)
+#error GAIA_LEASES needs the cache of versions of GAIA_STALE_READS
+#endif
+
 #if YS_SCHEMA_CACHE == 2
 #define GAIA_CLIENT_CONSISTENT_CACHE
 // If set, enable the consistent client cache in the key-value storage system.
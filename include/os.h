@@ -61,6 +61,8 @@
 #define CompareSwap32(ptr32,cmp32,val32) __sync_val_compare_and_swap((u32*)ptr32,cmp32,val32)
 #define CompareSwap64(ptr64,cmp64,val64) __sync_val_compare_and_swap((u64*)ptr64,cmp64,val64)
 #define CompareSwapPtr(ptr,cmp,val) __sync_val_compare_and_swap((void**)ptr,(void*)cmp,(void*)val)
+#define AtomicOr64(ptr64,val64) __sync_fetch_and_or((u64*)ptr64,val64)
+#define AtomicExchange64(ptr64,val64) __atomic_exchange_n((u64*)ptr64,val64,__ATOMIC_SEQ_CST)
 #define MemBarrier __sync_synchronize
 
 
@@ -44,6 +44,7 @@
 #include "debug.h"
 #include "gaiatypes.h"
 #include "util.h"
+#include "ipmisc.h"
 
 #include "supervalue.h"
 #include "datastruct.h"
@@ -61,7 +62,7 @@ class TxUpdateCoid;
 struct TxListItem {
   COid coid;
   i16 type;  // 0=ListAdd, 1=ListDelRange, 2=TxWriteItem, 3=TxWriteSVItem,
-             // 4=SetAttr, 5=TxReadItem
+             // 4=SetAttr, 5=TxReadItem, 6=AttrAdd
   i16 level;
   i16 where; // where item is **!**
   TxListItem *next, *prev; // so items can be included in LinkList<>
@@ -225,6 +226,17 @@ struct TxSetAttrItem : public TxListItem {
   bool applyItemToTucoid(Ptr<TxUpdateCoid> tucoid, bool cancapture);
 };
 
+// information about an attradd item, which adds delta to an attribute
+struct TxAttrAddItem : public TxListItem {
+  u32 attrid;
+  u64 delta;
+  TxAttrAddItem(const COid &coidinit, u32 aid, u64 d, int l) :
+    TxListItem(coidinit, 6, l)
+  { attrid = aid; delta = d; }
+  void printShort(COid coidtomatch);
+  bool applyItemToTucoid(Ptr<TxUpdateCoid> tucoid, bool cancapture);
+};
+
 // information about a transaction read item
 struct TxReadItem : public TxListItem {
   TxReadItem(const COid &coidinit, int l) :
@@ -271,7 +283,8 @@ public:
 // A TxUpdateCoid object (or tucoid, in short) expresses all the updates done
 // on a single coid by a transaction. Those updates might consist of
 // overwriting the entire coid (in which case Writevalue or WriteSV get set),
-// setting individual attributes (in which case SetAttrs and Attrs get set),
+// setting individual attributes or adding to them (in which case SetAttrs
+// and Attrs get set),
 // adding or removing items/cells (in which case Litems get set).
 //
 // We combine several tucoids of different coids into PendingTxInfo, which
@@ -299,7 +312,9 @@ public:
   // If justfree is true, then just free entries (do not zero them out)
   void clearUpdates(bool justfree=false);
 
-  u8 SetAttrs[GAIA_MAX_ATTRS];// which attributes have been set. 
+  u8 SetAttrs[GAIA_MAX_ATTRS];// which attributes have been set: 1 if set to
+                              // Attrs[i], 2 if Attrs[i] is a delta to add
+                              // to the attribute (see TxAttrAddItem)
   u64 Attrs[GAIA_MAX_ATTRS];  // to what values they have been set. These Attr
                               // changes are on top
                               // of any writes that have occurred
@@ -336,6 +351,10 @@ public:
 #define PTISTATUS_VOTEDYES     1 // transaction prepared and vote was yes
 #define PTISTATUS_VOTEDNO      2 // transaction prepared and vote was no
 #define PTISTATUS_CLEAREDABORT 3 // transaction aborted
+#define PTISTATUS_COMMITTED    4 // outcome is commit, kept to answer other
+                                 // servers (see GAIA_RESOLVE_ORPHANS)
+#define PTISTATUS_ABORTED      5 // outcome is abort, kept to answer other
+                                 // servers (see GAIA_RESOLVE_ORPHANS)
 
 
 // information for a single pending transaction; holds the writeset of the
@@ -350,7 +369,16 @@ public:
   SkipList<COid,Ptr<TxRawCoid> > coidinfo; // for each coid, what updates
                                               // were done to it
   bool updatesCachable; // whether tx updates cachable data
+  bool updatesLeased;   // whether tx updates an object whose lease has not
+                        // ended (see GAIA_LEASES)
   int status;    // see status codes PTISTATUS_...
+  int nparticipants;    // servers in transaction, as sent by client on
+  IPPort *participants; // prepare. Used to find out the outcome if the
+                        // client goes away (see GAIA_RESOLVE_ORPHANS)
+  Timestamp committs;   // commit timestamp if status is PTISTATUS_COMMITTED,
+                        // proposed commit timestamp if PTISTATUS_VOTEDYES
+  Timestamp replicats;  // proposed commit timestamp held back from replicas
+                        // until tx ends, or illegal (see GAIA_REPLICAS)
 
   // Delete all tucoid items in coidinfo.
   // This is called when transaction aborts.
@@ -366,8 +394,12 @@ public:
     status = PTISTATUS_INPROGRESS;
     refcount = 0;
     updatesCachable = false;
+    updatesLeased = false;
+    nparticipants = 0;
+    participants = 0;
+    replicats.setIllegal();
   }
-  ~PendingTxInfo(){ }
+  ~PendingTxInfo(){ if (participants) delete [] participants; }
 };
 
 class PendingTx {
@@ -0,0 +1,91 @@
+//
+// replica-server.h
+//
+// Read-only replicas of a storage server (see GAIA_REPLICAS). The server
+// ships the value of each object it commits to its replicas, which keep the
+// values in memory and serve reads below a safe timestamp that the server
+// advances periodically. Messages belong to an epoch of the server; when a
+// message to a replica fails, or the replica restarts, the server starts a
+// new epoch and the replica drops everything it had.
+//
+
+/*
+  Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef _REPLICA_SERVER_H
+#define _REPLICA_SERVER_H
+
+#include "options.h"
+#include "inttypes.h"
+#include "gaiatypes.h"
+#include "newconfig.h"
+#include "pendingtx.h"
+#include "gaiarpcaux.h"
+
+#if defined(GAIA_REPLICAS) && defined(STORAGESERVER_SPLITTER) && \
+    !defined(LOCALSTORAGE)
+#define SERVER_REPLICAS // uses the splitter's connections to the replicas
+#endif
+
+#ifdef SERVER_REPLICAS
+
+#define REPLICA_ROLE_NONE    0 // server without replicas
+#define REPLICA_ROLE_PRIMARY 1 // server with replicas
+#define REPLICA_ROLE_REPLICA 2 // replica of some server
+extern int ReplicaRole;
+
+// sets role of this host from the configuration
+void replicaInit(ConfigState *cs, IPPort myipport);
+// to be called at initialization of each server worker thread
+void replicaInitThread(void);
+
+// ---------------------------- server with replicas --------------------------
+// Called when a transaction votes yes. Moves proposecommitts past the
+// timestamps that replicas may consider safe, and holds back the safe
+// timestamp until the transaction ends
+void replicaPrepared(Timestamp &proposecommitts);
+// Called when a transaction that voted yes commits or aborts. If it commits,
+// ships the new values of the objects it wrote
+void replicaEnded(Ptr<PendingTxInfo> pti, bool committed, Timestamp &committs);
+// Ships the value of coid read at ts, after a replica did not have it
+void replicaShipRead(COid &coid, Timestamp &ts, Ptr<TxUpdateCoid> tucoid);
+
+// ------------------------------------ replica -------------------------------
+// Reads coid at ts. Returns 0 and sets tucoid and readts if found,
+// GAIAERR_REPLICA_BEHIND if ts is not in the range the replica can serve,
+// GAIAERR_REPLICA_MISS if the replica does not have the object at ts
+int replicaRead(COid &coid, Timestamp &ts, Ptr<TxUpdateCoid> &tucoid,
+                Timestamp &readts);
+// Applies a REPLICATE RPC from the server. Returns status for the reply
+int replicaApply(ReplicateRPCParm *parm, u64 &incarnation);
+
+// At a replica, reads with a smaller timestamp d1 than this can go to it. At
+// a server with replicas, the same for all of its replicas. 0 otherwise
+u64 replicaSafeD1(void);
+
+#endif
+#endif
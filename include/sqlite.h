@@ -10397,6 +10397,8 @@ struct AuthContext {
 #define OPFLAG_APPEND        0x08    /* This is likely to be an append */
 #define OPFLAG_USESEEKRESULT 0x10    /* Try to avoid a seek in BtreeInsert() */
 #define OPFLAG_CLEARCACHE    0x20    /* Clear pseudo-table cache in OP_Column */
+#define OPFLAG_BULKLOAD      0x40    /* OP_OpenWrite: bulk load if tree empty */ // YESQUEL CH: added
+#define OPFLAG_PREFETCH      0x80    /* OP_OpenRead: prefetch full scan */ // YESQUEL CH: added
 
 /*
  * Each trigger present in the database schema is stored as an instance of
@@ -52,6 +52,7 @@ int fullreadRpcStub(RPCTaskInfo *rti);
 int listaddRpcStub(RPCTaskInfo *rti);
 int listdelrangeRpcStub(RPCTaskInfo *rti);
 int attrsetRpcStub(RPCTaskInfo *rti);
+int attraddRpcStub(RPCTaskInfo *rti);
 int prepareRpcStub(RPCTaskInfo *rti);
 int commitRpcStub(RPCTaskInfo *rti);
 int subtransRpcStub(RPCTaskInfo *rti);
@@ -59,4 +60,12 @@ int shutdownRpcStub(RPCTaskInfo *rti);
 int startsplitterRpcStub(RPCTaskInfo *rti);
 int flushfileRpcStub(RPCTaskInfo *rti);
 int loadfileRpcStub(RPCTaskInfo *rti);
+#if defined(GAIA_RESOLVE_ORPHANS) && defined(STORAGESERVER_SPLITTER) && \
+    !defined(LOCALSTORAGE)
+int txstatusRpcStub(RPCTaskInfo *rti);
+#endif
+#if defined(GAIA_REPLICAS) && defined(STORAGESERVER_SPLITTER) && \
+    !defined(LOCALSTORAGE)
+int replicateRpcStub(RPCTaskInfo *rti);
+#endif
 #endif
@@ -54,6 +54,7 @@ Marshallable *fullreadRpc(FullReadRPCData *d, void *handle, bool &defer);
 Marshallable *listaddRpc(ListAddRPCData *d, void *&state);
 Marshallable *listdelrangeRpc(ListDelRangeRPCData *d);
 Marshallable *attrsetRpc(AttrSetRPCData *d);
+Marshallable *attraddRpc(AttrAddRPCData *d);
 Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify);
 Marshallable *commitRpc(CommitRPCData *d);
 Marshallable *subtransRpc(SubtransRPCData *d);
@@ -61,6 +62,14 @@ Marshallable *shutdownRpc(ShutdownRPCData *d);
 Marshallable *startsplitterRpc(StartSplitterRPCData *d);
 Marshallable *flushfileRpc(FlushFileRPCData *d);
 Marshallable *loadfileRpc(LoadFileRPCData *d);
+#if defined(GAIA_RESOLVE_ORPHANS) && defined(STORAGESERVER_SPLITTER) && \
+    !defined(LOCALSTORAGE)
+Marshallable *txstatusRpc(TxStatusRPCData *d);
+#endif
+#if defined(GAIA_REPLICAS) && defined(STORAGESERVER_SPLITTER) && \
+    !defined(LOCALSTORAGE)
+Marshallable *replicateRpc(ReplicateRPCData *d);
+#endif
 
 // Auxilliary function to be used by server implementation
 // Wake up a task that was deferred, by sending a wake-up message to it
@@ -58,16 +58,25 @@ public:
   i64 nKey;
   char *pKey;
   u64 value;
-  ListCell(){ pKey = 0; }
+  char *pData;  // row stored inline in cell (leaves of CellType 2 nodes only)
+  int nData;    // length of pData; 0 iff pData == 0
+  ListCell(){ pKey = 0; pData = 0; nData = 0; }
   ListCell(const ListCell& c){ copy(c); }
   ListCell &operator=(const ListCell &c){ copy(c); return *this; }
   static bool equal(const ListCell &l, const ListCell &r){ 
     return &l==&r || (l.nKey == r.nKey && l.value == r.value &&
                       (l.pKey == 0)==(r.pKey == 0) &&
-                      (l.pKey==0 || memcmp(l.pKey,r.pKey,(int)l.nKey)==0));
+                      (l.pKey==0 || memcmp(l.pKey,r.pKey,(int)l.nKey)==0) &&
+                      samePayload(l, r));
+  }
+  // whether two cells have the same inline row (or both have none)
+  static bool samePayload(const ListCell &l, const ListCell &r){
+    return l.nData == r.nData &&
+      (l.nData == 0 || memcmp(l.pData, r.pData, l.nData)==0);
   }
   
-  int size(){ return myVarintLen(nKey) + sizeof(u64) + (int)(pKey ? nKey : 0); }
+  int size(){ return myVarintLen(nKey) + sizeof(u64) + (int)(pKey ? nKey : 0) +
+                     (pData ? myVarintLen(nData) + nData : 0); }
   void copy(const ListCell &c){
     nKey = c.nKey;
     value = c.value;
@@ -76,11 +85,26 @@ public:
       pKey = (char*) malloc((int)nKey); 
       memcpy(pKey, c.pKey, (int)nKey);
     } else pKey=0;
+    copyPayload(c);
+  }
+  void copyPayload(const ListCell &c){
+    nData = c.nData;
+    if (c.pData){
+      assert(nData > 0);
+      pData = (char*) malloc(nData);
+      memcpy(pData, c.pData, nData);
+    } else pData=0;
   }
 
   void Free(){
     if (pKey) free(pKey);
     pKey = 0;
+    FreePayload();
+  }
+  void FreePayload(){
+    if (pData) free(pData);
+    pData = 0;
+    nData = 0;
   }
 };
 
@@ -130,6 +154,9 @@ protected:
 public:
   UnpackedRecord *pIdxKey;
   RcKeyInfoPtr pprki;
+  u32 *sharedrc; // if set, pKey and pData are shared with copies of this
+                 // cell in other versions of a supervalue (see share()), and
+                 // *sharedrc is the number of cells sharing them
 
   // Fresh ListCell, but use a given pprki.
   // Intended to be used when creating a new ListCellPlus
@@ -139,6 +166,7 @@ public:
     ListCell(), pprki(pprki_arg, false)   // do not free the RcKeyInfo
   {
     pIdxKey = 0;
+    sharedrc = 0;
   }
 
   // Copy from another ListCell or ListCellPlus, but use a given pprki.
@@ -149,6 +177,7 @@ public:
     ListCell(r), pprki(pprki_arg, false)   // do not free the RcKeyInfo
   {
     pIdxKey = 0;
+    sharedrc = 0;
   }
 
   // create with a private RcKeyInfo, copying from a ListCell.
@@ -159,14 +188,54 @@ public:
       pprki(new Ptr<RcKeyInfo>(srcprki), true)
   { 
     pIdxKey = 0;
+    sharedrc = 0;
+  }
+
+  // copies key and data; the copy does not share them with r
+  ListCellPlus(const ListCellPlus &r) : ListCell(r), pprki(r.pprki)
+  {
+    pIdxKey = 0;
+    sharedrc = 0;
   }
 
   ListCellPlus operator=(const ListCellPlus &r){ assert(0); return *this; }
 
+  // Constructs in dst a copy of src that shares src's pKey and pData rather
+  // than copying them, and that uses the given pprki. Intended for copying
+  // the cells of a TxWriteSVItem, whose versions differ in few cells. Cells
+  // are immutable once in a TxWriteSVItem, so sharing their bytes is safe.
+  // The last argument is a Ptr<RcKeyInfo>*, as this function is passed to
+  // SkipListBK's copy constructor.
+  static void share(ListCellPlus &src, ListCellPlus *dst, void *pprki_arg){
+    new(dst) ListCellPlus((Ptr<RcKeyInfo>*) pprki_arg);
+    dst->nKey = src.nKey;
+    dst->value = src.value;
+    if (!src.pKey && !src.pData) return; // nothing to share
+    if (!src.sharedrc){ // first copy: src starts counting
+      u32 *rc = new u32(1);
+      if (CompareSwapPtr(&src.sharedrc, 0, rc) != 0)
+        delete rc; // another copy of src started counting concurrently
+    }
+    AtomicInc32(src.sharedrc);
+    dst->sharedrc = src.sharedrc;
+    dst->pKey = src.pKey;
+    dst->pData = src.pData;
+    dst->nData = src.nData;
+  }
 
   void Free(){
     if (pIdxKey){ myVdbeDeleteUnpackedRecord(pIdxKey); pIdxKey = 0; }
-    ListCell::Free();
+    if (sharedrc){
+      if (AtomicDec32(sharedrc) == 0){ // last cell sharing bytes
+        delete sharedrc;
+        ListCell::Free();
+      } else { // bytes still used by other cells
+        pKey = 0;
+        pData = 0;
+        nData = 0;
+      }
+      sharedrc = 0;
+    } else ListCell::Free();
   }
 
   ~ListCellPlus(){ Free(); }
@@ -215,7 +284,7 @@ public:
 class SuperValue {
 public:
   i16 Nattrs;       // number of 64-bit attribute values
-  u8  CellType;     // 0=int, 1=nKey+pKey
+  u8  CellType;     // 0=int, 1=nKey+pKey, 2=int with inline rows
   i32 Ncells;       // number of (cell,oid) pairs in list
   i32 CellsSize;    // size of cells combined
   u64 *Attrs;       // value of attributes
@@ -60,6 +60,13 @@ class TaskScheduler;
                           // the event loop to retry sending overflow messages
 #define TASKSCHEDULER_FULL_ALMOST_QUEUE 1024 // number below which a send queue
                                              // is considered to be almost full
+#define TASKSCHEDULER_TIMERWHEEL_BITS 6 // log2 of number of slots in each
+                                        // level of the timer wheel
+#define TASKSCHEDULER_TIMERWHEEL_LEVELS 3 // number of levels of timer wheel.
+            // Level l has slots of 2^(BITS*l) ms, so the wheel holds timers up
+            // to 2^(BITS*LEVELS) ms ahead; later ones go to an overflow list
+#define TASKSCHEDULER_IDLE_SPIN 200 // number of idle iterations of the event
+                                    // loop in run() before thread sleeps
 #define CHANNEL_MAXSENDMSGRETRY 100 // max number of retries when queue is full
                                     // before deferring send
 #define CHANNEL_SENDMSGRETRY_REPORT_WAIT 1000 // number of sending retry at
@@ -193,6 +200,10 @@ private:
   LinkList<TaskMsgDataEntry> *MoreMessages; // If non-zero, more messages
                                           // waiting to be delivered to task
   void *TaskData;        // task specific data given when task is created
+  LinkList<TaskInfo> *TimerList; // if timed waiting, list of timer wheel
+                                 // holding task
+  int TimerLevel;        // level of timer wheel of TimerList (LEVELS for
+                         // overflow list, -1 for list of due tasks)
 
 
 public:
@@ -230,9 +241,27 @@ private:
   LinkList<TaskInfo> NewTasks;     // newly created tasks
   LinkList<TaskInfo> RunningTasks; // tasks that are running
   LinkList<TaskInfo> WaitingTasks; // tasks that are waiting on some message
-  LinkList<TaskInfo> TimedWaitingTasks; // tasks that are waiting for a time
-  u64 TimeOfNextTimedWaiting;  // time when the earliest TimedWaitingTask needs
-                               // to execute
+
+  // Tasks waiting for a time are kept in a hierarchical timer wheel. A task
+  // that wakes up at time t (in ms) is kept at the lowest level l whose span
+  // covers t, in slot (t >> BITS*l) mod 2^BITS. When time reaches a multiple
+  // of 2^(BITS*l), the tasks in the corresponding slot of level l move down
+  // to lower levels (cascade). So adding, removing, and waking up a task take
+  // constant time, rather than a scan of all timed waiting tasks.
+  LinkList<TaskInfo> TimerWheel[TASKSCHEDULER_TIMERWHEEL_LEVELS]
+                               [1<<TASKSCHEDULER_TIMERWHEEL_BITS];
+  LinkList<TaskInfo> TimerOverflow; // tasks beyond the span of the wheel
+  LinkList<TaskInfo> TimerDue; // tasks whose time passed when they were added
+  int NTimerLevel[TASKSCHEDULER_TIMERWHEEL_LEVELS+1]; // number of tasks in
+                               // each level; last entry is for TimerOverflow
+  int NTimedWaiting;  // number of timed waiting tasks
+  u64 WheelTime;      // next time (in ms) to be processed by the wheel
+  void timerAdd(TaskInfo *ti);    // adds timed waiting task to wheel
+  void timerRemove(TaskInfo *ti); // removes timed waiting task from wheel
+  void timerCascade(LinkList<TaskInfo> *list, int level); // re-adds tasks
+  void timerAdvance(u64 now); // wakes up tasks whose time is up to now
+  u64 timerNextWakeUp(); // returns a time no later than when the next timed
+                         // waiting task wakes up, ULLONG_MAX if none
   ChannelManager *CManager; // object that holds the channels
   u8 ThreadNo;
   LinkList<TaskMsgEntry> OverflowQueue; // queue to place messages when send
@@ -243,6 +272,9 @@ private:
   TaskMsg MessageBuf[DEFAULT_CHANNEL_SIZE*2];  // temporary buffer for storing
                               // incoming messages in processIncomingMessages()
 
+  u64 ReadyChannels[TASKSCHEDULER_MAX_THREADS/64]; // bit i is set if
+          // channel from thread i may have messages. Set by senders, cleared
+          // by this thread, so that it need not poll every channel
   int Asleep;       // set to true if thread got idle and went to sleep
   int SleepEventFd; // eventfd for sleeping on when thread gets idle. If Asleep
                     // is true, thread needs to be waked up by wake()
@@ -305,11 +337,18 @@ public:
         CManager->printWaiting();
       }
     }
+    dstts->setChannelReady(ThreadNo);
     dstts->wake();
   }
   
   void exitThread(){ ForceEnd = 1; wake(); }
 
+  // marks the channel from srcthread as having messages. Called by the sender
+  // after it enqueues a message
+  void setChannelReady(int srcthread){
+    AtomicOr64(&ReadyChannels[srcthread/64], (u64)1 << (srcthread%64));
+  }
+
   // returns 0 if no incoming messages, != 0 otherwise
   // Useful to determine if thread can go to sleep or not
   int hasIncomingMessages(); 
@@ -329,7 +368,10 @@ public:
   // Otherwise return -1, meaning we can sleep forever
   int findSleepTimeout();
 
-  void setAsleep(int as){ Asleep = as; }   // sets asleep flag
+  void setAsleep(int as){ // sets asleep flag
+    Asleep = as;
+    if (as) MemBarrier(); // check for messages must not precede the store
+  }
   
   // Go to sleep until waken up. This is to be called by the scheduler loop of
   // the current thread.
@@ -479,11 +521,15 @@ public:
   }
 
   // returns the index of threadno within tclass
-  // fails assert if threadno does not belong to class
+  // fails assert if threadno does not belong to class. The threadnos of a
+  // class need not be consecutive, since other threads may get created
+  // while the class is being launched
   int indexWithinClass(int tclass, int threadno){
-    int i = threadno - hashThread(tclass,0);
-    assert(i < getNThreads(tclass));
-    return i;
+    int i, n = getNThreads(tclass);
+    for (i=0; i < n; ++i)
+      if (getThread(tclass, i) == threadno) return i;
+    assert(0);
+    return -1;
   }
 };
 
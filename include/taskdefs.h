@@ -64,6 +64,7 @@
 // tcpdatagram.h
 #define IMMEDIATEFUNC_SEND 11
 #define IMMEDIATEFUNC_ADDIPPORTFD 12
+#define IMMEDIATEFUNC_DELSHMCONN 13
 // grpctcp.h
 #define IMMEDIATEFUNC_SENDTOSEND 21
 // disklog-win.h
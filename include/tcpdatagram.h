@@ -64,6 +64,7 @@ struct DatagramMsg {
 
 #define FLAG_HID(hid) ((hid)<<16)//given hid, returns corresponding bits in flag
 #define FLAG_GET_HID(flag) ((flag)>>16) // extract hid bits from flag
+#define FLAG_BATCH 0x1  // message is a batch frame (see below)
 
 // wire format for RPC header
 struct DatagramMsgHeader {
@@ -77,6 +78,12 @@ struct DatagramMsgHeader {
   u32 xid;  // unique per-sender identifier for request
 };
 
+// A batch frame is a header with flags=FLAG_BATCH, req=number of messages
+// in the batch, xid=0, and size=total size of the messages, followed by the
+// messages themselves, each with its own header. Batch frames are formed
+// by the sender when several messages are queued for a connection, and
+// they are transparent to handleMsg.
+
 
 
 #define REQ_HEADER_COOKIE 0xbebe    // cookie added to beginning of datagram
@@ -94,6 +101,38 @@ using namespace Concurrency::diagnostic;
 #endif
 class MsgBuffer;
 
+// Ring buffer in shared memory carrying a byte stream in one direction of a
+// shared-memory connection (see TCP_SHM). There is one producer process and
+// one consumer process. Fields are padded to separate cache lines.
+struct ShmRing {
+  u64 head;               // bytes written so far (written by producer)
+  char pad1[56];
+  u64 tail;               // bytes read so far (written by consumer)
+  char pad2[56];
+  u32 consumerPolling;    // consumer checks ring often; no doorbell needed
+  u32 producerWaiting;    // producer waits for space; wants a doorbell
+  char pad3[56];
+  char data[TCP_SHM_RINGSIZE];
+};
+
+// State of a shared-memory connection at one end. Each end has an eventfd
+// (doorbell) that the other end writes to when it adds data to the ring
+// that this end reads, or frees space in the ring that this end writes.
+struct ShmConn {
+  char *base;          // mapping with both rings
+  int maplen;          // length of mapping
+  ShmRing *sendring;   // ring where we write
+  ShmRing *recvring;   // ring where we read
+  int wakefd;          // our doorbell
+  int peerfd;          // doorbell of the other end
+  ShmConn(){ base = 0; maplen = 0; wakefd = peerfd = -1; }
+  ~ShmConn();
+  void ring(void);     // rings doorbell of the other end
+  int write(iovec *bufs, int nbufs); // writes to sendring, returns # bytes
+                                     // written (0 if ring is full)
+  int read(char *buf, int len); // reads from recvring, returns # bytes read
+};
+
 // This is a buffer that tracks a buffer and a refcount for it.
 // When the refcount reaches zero, the buffer is freed with free().
 // The buffer being tracked should be allocated with malloc()
@@ -127,16 +166,24 @@ private:
     DatagramMsg dmsg;
     DatagramMsgHeader header; // space for wire RPC header,
                               // to be included in iovec to send
+    DatagramMsgHeader batchheader; // header of batch frame, if entry
+                                   // starts one
     iovec bufs[MAXIOVECSERIALIZE];
     int nbufs;
     int nbytes; // number of bytes in all iovecs
+    int batched; // whether entry was already placed in a batch frame (or
+                 // decided to go alone); this does not change afterwards
     SendQueueEntry *next;
-    SendQueueEntry(DatagramMsg &dm){ nbufs=0; dmsg = dm; marshallRPC(); }
+    SendQueueEntry(DatagramMsg &dm){
+      nbufs=0; batched=0; dmsg = dm; marshallRPC();
+    }
   };
   struct TCPStreamState {
-    int fd;
+    int fd;       // for shared-memory connections, the Unix socket used to
+                  // set up the connection
     IPPort ipport;
     int handlerid;
+    ShmConn *shm; // non-null for shared-memory connection
     ReceiveState rstate; // current receive state
     SLinkList<SendQueueEntry> sendQueue; // send queue
     int sendQueueBytesSkip; // how many bytes to skip from send queue (because
@@ -145,9 +192,10 @@ private:
        // of this item, it would have been removed from sendQueue
     int sendeagain; // whether got EAGAIN the last time we
                     // tried to write to socket
-    TCPStreamState(){ fd = -1; sendQueueBytesSkip = 0; sendeagain = 0; }
+    TCPStreamState(){ fd = -1; shm = 0; sendQueueBytesSkip = 0; sendeagain = 0; }
     ~TCPStreamState(){
       if (fd >= 0) close(fd);
+      if (shm) delete shm;
       if (rstate.Buf) free(rstate.Buf);
       SendQueueEntry *sqe;
       while (!sendQueue.empty()){
@@ -169,9 +217,12 @@ private:
     }
   };
   
-  SkipList<IPPort,TCPStreamState*> IPPortMap; // maps ip-port to TCPStreamState
+  SkipList<IPPort,TCPStreamState*> *IPPortMap; // for each worker, maps
+                      // ip-port to TCPStreamState of connections of the worker
   Set<TCPStreamStatePtr> *PendingSendsBeforeEpoll; // connections with pending
                              // data to be sent before epoll
+  Set<TCPStreamStatePtr> *ShmConns; // shared-memory connections of each
+                                    // worker
   bool ForceEndThreads; // when set to true, threads will exit asap
   
   // entry in linked list
@@ -201,10 +252,20 @@ private:
 
   // stuff for receiving
   void updateState(int handlerid, ReceiveState &s, IPPort src, int len);
+  // number of messages in a received message (>1 for a batch frame)
+  static int countMsgs(DatagramMsgHeader *header){
+    return (header->flags & FLAG_BATCH) ? (int) header->req : 1;
+  }
+  // calls handleMsg for a received message, or for each message in it if
+  // it is a batch frame
+  void deliverMsg(int handlerid, IPPort src, TaskMultiBuffer *tmb,
+                  char *buf);
   static OSTHREAD_FUNC receiveThread(void *parm);
 
   // worker thread
   Semaphore workerInitSync; // used to wait for all workers to start
+  Semaphore workerRegSync;  // used by workers to wait until launch() has
+                            // registered all of them in gContext
   virtual void startupWorkerThread(); // workerThread calls this upon startup
   virtual void finishWorkerThread();   // workerThread calls this when ending
   static OSTHREAD_FUNC workerThread(void *parm);
@@ -215,25 +276,52 @@ private:
   static int marshallRPC(iovec *iovecbuf, int bufsleft, RPCSendEntry *rse);
   static void immediateFuncSend(TaskMsgData &msgdata, TaskScheduler *ts,
                                 int srcthread);
-  void sendTss(TCPStreamState *tss);
+  void assignBatches(TCPStreamState *tss); // groups queued entries into
+                                           // batch frames
+  int sendTss(TCPStreamState *tss); // returns # of messages sent
   
   
   // called whenever a client connect()s or a server accept()s
-  void startReceiving(IPPort ipport, int fd, int handlerid, int workerno);
+  void startReceiving(IPPort ipport, int fd, int handlerid, int workerno,
+                      ShmConn *shm=0);
+
+  // shared-memory connections
+  int receiveShm(TCPStreamState *tss); // reads what is available in ring
+                                       // of tss. Returns whether got data
+  static int shmListen(int port); // returns Unix socket listening for
+                                  // shared-memory connections on port
+  static ShmConn *shmConnect(IPPort dest, int &fd); // sets up a connection
+               // with server at dest, returns 0 if cannot
+  static ShmConn *shmAccept(int fd); // sets up connection at server
+  void closeShm(TCPStreamState *tss); // closes connection; called by worker
+                                      // thread of tss
+  static void immediateFuncDelShmConn(TaskMsgData &msgdata, TaskScheduler *ts,
+                                      int srcthread);
 
   // Client-specific stuff
   int chooseWorkerForClient(IPPort client); // given client, returns which
                                             // worker thread should handle it
+  int ClientConns; // number of connections a client opens to each server
+  // key in IPPortMap of the conn-th connection to server dest. The
+  // connection number goes in the high bits of the port, which are unused
+  static IPPort connKey(IPPort dest, int conn){
+    dest.port |= (u32) conn << 16;
+    return dest;
+  }
+  int clientconnect1(IPPort dest, IPPort key); // opens one connection
 
   // Server-specific stuff
   struct NewServer {
     int fd;         // fd where we are supposed to listen and accept
     int handlerid;  // id of handler for incoming server messages,
                     // passed to handleMsg()
+    int shm;        // whether fd is a Unix socket for shared-memory
+                    // connections
   };
   OSThread_t ServerThr; // thread for listening for new connections
   static OSTHREAD_FUNC serverThread(void *parm);
   int ClientCount;
+  u32 ShmClientCount; // used to give an IPPort to shared-memory clients
   int ServerEventFd;
   BoundedQueue<NewServer*> newServerQueue;
 
@@ -269,7 +357,9 @@ public:
   // initializes clients. Must be called once before clientconnect()
   void clientinit(){ initThreadContext("CLIENT",0); }
 
-  // connects to a server. Must be called before the client can send to it
+  // connects to a server. Must be called before the client can send to it.
+  // Opens one connection per worker thread; messages with the same hash id
+  // (see FLAG_HID) go on the same connection, so they arrive in order
   int clientconnect(IPPort dest);
 
   // disconnects from server
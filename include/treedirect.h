@@ -80,6 +80,15 @@ int DdCommitTx(DdConnection *conn); // Try to commit a transaction. Returns 0
   // if committed, -1 if aborted.
 int DdInsert(DdTable *table, i64 key, const char *value, int valuelen);
   // Insert on a table. The key is key, value is value with length valuelen
+int DdBulkBegin(DdTable *table); // Start a bulk load on an empty table.
+  // Subsequent DdBulkInsert calls buffer the keys and DdBulkEnd builds the
+  // tree bottom-up with full nodes. Must be called within a transaction, and
+  // the new tree becomes visible when the transaction commits. If the table
+  // is not empty, DdBulkInsert behaves like DdInsert.
+int DdBulkInsert(DdTable *table, i64 key, const char *value, int valuelen);
+  // Insert on a table during a bulk load. Keys need not be sorted, but
+  // sorted keys avoid a sort in DdBulkEnd.
+int DdBulkEnd(DdTable *table); // End a bulk load, writing the tree.
 Oid DdGetOid(DdTable *table, i64 key);
   // Get oid of leaf node storing a given key
 int DdUpdate(DdTable *table, i64 key, char *buf, int buflen,
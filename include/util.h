@@ -49,6 +49,10 @@ void DumpData(char *ptr, int i, int firstoff=0);
 // prints a buffer in a short format
 void DumpDataShort(char *ptr, int n);
 
+// Computes the CRC32C (Castagnoli) of buf, continuing from crc (use 0 for
+// a new checksum). Uses the SSE4.2 crc32 instruction if the CPU has it.
+u32 crc32c(u32 crc, const void *buf, int len);
+
 #ifdef GETOPT
 // command-line argument processing
 extern int optind;  // current argv being processed
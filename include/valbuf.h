@@ -60,6 +60,9 @@ public:
                       // There is a guarantee that the node was not written
                       // after commitTs and before readTs.
   int len;
+  int cellsBefore;    // if type=1 and only some cells were read (see
+  int cellsAfter;     // Transaction::vsuperget), # of cells of the supervalue
+                      // left out before and after those. Otherwise 0
   union {
     char *buf;        // if type=0. Must be allocated with
                       // Transaction::allocReadBuf() since it will be freed with
@@ -112,3 +112,97 @@ int ClientCache::set(int serverno, COid &coid, Ptr<Valbuf> buf){
   ccps->lock.unlock();
   return retval;
 }
+
+#ifdef GAIA_STALE_READS
+struct VersionCacheLookupParm {
+  int type;
+  Timestamp *ts;
+  Ptr<Valbuf> *vbuf;
+};
+
+// auxiliary function to be called by lookup. Extracts the version if it is
+// valid at the given timestamp
+int VersionCache::auxLookup(COid &coid, Ptr<Valbuf> *vbufptr, int status,
+                            SkipList<COid, Ptr<Valbuf> > *b, u64 parm){
+  VersionCacheLookupParm *lp = (VersionCacheLookupParm *) parm;
+  if (status) return -1; // not found
+  Ptr<Valbuf> &vbuf = *vbufptr;
+  if (vbuf->type != lp->type) return -1;
+  if (Timestamp::cmp(vbuf->commitTs, *lp->ts) > 0 ||
+      Timestamp::cmp(*lp->ts, vbuf->readTs) > 0) return -1; // not valid at ts
+  if (lp->vbuf) *lp->vbuf = new Valbuf(**vbufptr); // make a copy
+  return 0;
+}
+
+int VersionCache::lookup(COid &coid, int type, Timestamp &ts,
+                         Ptr<Valbuf> &vbuf){
+  VersionCacheLookupParm lp;
+  lp.type = type;
+  lp.ts = &ts;
+  lp.vbuf = &vbuf;
+  return Cache.lookupApply(coid, auxLookup, (u64) &lp);
+}
+
+bool VersionCache::has(COid &coid, int type, Timestamp &ts){
+  VersionCacheLookupParm lp;
+  lp.type = type;
+  lp.ts = &ts;
+  lp.vbuf = 0;
+  return Cache.lookupApply(coid, auxLookup, (u64) &lp) == 0;
+}
+
+// auxiliary function to be called by lookupRecent. Extracts the version if
+// it is valid at some timestamp >= the given one
+int VersionCache::auxLookupRecent(COid &coid, Ptr<Valbuf> *vbufptr,
+                                  int status, SkipList<COid, Ptr<Valbuf> > *b,
+                                  u64 parm){
+  VersionCacheLookupParm *lp = (VersionCacheLookupParm *) parm;
+  if (status) return -1; // not found
+  Ptr<Valbuf> &vbuf = *vbufptr;
+  if (vbuf->type != lp->type) return -1;
+  if (Timestamp::cmp(vbuf->readTs, *lp->ts) < 0) return -1; // too old
+  *lp->vbuf = new Valbuf(**vbufptr); // make a copy
+  return 0;
+}
+
+int VersionCache::lookupRecent(COid &coid, int type, Timestamp &oldest,
+                               Ptr<Valbuf> &vbuf){
+  VersionCacheLookupParm lp;
+  lp.type = type;
+  lp.ts = &oldest;
+  lp.vbuf = &vbuf;
+  return Cache.lookupApply(coid, auxLookupRecent, (u64) &lp);
+}
+
+// auxiliary function to be called by refresh. Inserts or replaces the entry
+// of coid, evicting from the bucket the version read longest ago if the
+// bucket is full
+int VersionCache::auxRefresh(COid &coid, Ptr<Valbuf> *vbufptr, int status,
+                             SkipList<COid, Ptr<Valbuf> > *b, u64 parm){
+  Ptr<Valbuf> *vbuf = (Ptr<Valbuf> *) parm;
+  if (status == 0){ // there already; keep the one read later
+    if (Timestamp::cmp((*vbufptr)->readTs, (*vbuf)->readTs) < 0)
+      *vbufptr = new Valbuf(**vbuf); // make a copy of data
+    return 0;
+  }
+  if (b->getNitems() >= VCACHE_BUCKET_MAX){
+    SkipListNode<COid, Ptr<Valbuf> > *ptr, *oldest;
+    Ptr<Valbuf> dummy;
+    oldest = b->getFirst();
+    for (ptr = b->getNext(oldest); ptr != b->getLast(); ptr = b->getNext(ptr))
+      if (Timestamp::cmp(ptr->value->readTs, oldest->value->readTs) < 0)
+        oldest = ptr;
+    COid oldcoid = oldest->key;
+    b->lookupRemove(oldcoid, 0, dummy);
+  }
+  b->insert(coid, new Valbuf(**vbuf)); // make a copy of data
+  return 0;
+}
+
+void VersionCache::refresh(Ptr<Valbuf> &vbuf){
+  if (!InUse) return;
+  assert(vbuf->immutable && !vbuf->readTs.isIllegal());
+  assert(!vbuf->cellsBefore && !vbuf->cellsAfter); // only whole versions
+  Cache.lookupApply(vbuf->coid, auxRefresh, (u64) &vbuf);
+}
+#endif
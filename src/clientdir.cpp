@@ -48,10 +48,14 @@
 #include "debug.h"
 #include "clientdir.h"
 #include "gaiarpcaux.h"
+#include "coid.h"
 
 StorageConfig::StorageConfig(const char *configfile) {
+  int nworkers = CLIENT_WORKERTHREADS;
+  if (nworkers > getNProcessors()) nworkers = getNProcessors();
+  if (nworkers < 1) nworkers = 1;
   Rpcc = new RPCTcp();
-  Rpcc->launch(CLIENT_WORKERTHREADS);
+  Rpcc->launch(nworkers);
   
   CS = ConfigState::ParseConfig(configfile);
   if (!CS) exit(1); // cannot read config file
@@ -394,6 +398,20 @@ static inline unsigned GetServerNumber(const COid &coid, int nservers,
   return 0;
 }
 
+ObjectDirectory::ObjectDirectory(ConfigState *cs){
+  Config = cs;
+#ifdef GAIA_REPLICAS
+  ReplicaSafeD1 = new u64[cs->Nservers * MAX_REPLICAS];
+  memset(ReplicaSafeD1, 0, cs->Nservers * MAX_REPLICAS * sizeof(u64));
+#endif
+}
+
+ObjectDirectory::~ObjectDirectory(){
+#ifdef GAIA_REPLICAS
+  delete [] ReplicaSafeD1;
+#endif
+}
+
 void ObjectDirectory::GetServerId(const COid& coid, IPPortServerno &ipps){
   unsigned serverno;
 
@@ -404,6 +422,36 @@ void ObjectDirectory::GetServerId(const COid& coid, IPPortServerno &ipps){
   ipps.serverno = serverno;
 }
 
+#ifdef GAIA_REPLICAS
+int ObjectDirectory::GetReplicaId(const COid &coid, int serverno,
+                                  Timestamp &ts, IPPort &ipport){
+  ServerHT *s = Config->Servers[serverno];
+  u64 *safed1 = ReplicaSafeD1 + serverno * MAX_REPLICAS;
+  int i, replica;
+
+  if (!s->nreplicas || ts.isIllegal() || IsCoidCachable(coid)) return -1;
+  // spread objects of the server over its replicas
+  replica = (int)(COid::hash(coid) % s->nreplicas);
+  for (i=0; i < s->nreplicas; ++i){
+    if (safed1[replica] > ts.getd1()){
+      ipport = s->replicas[replica];
+      return replica;
+    }
+    if (++replica == s->nreplicas) replica = 0;
+  }
+  return -1;
+}
+
+void ObjectDirectory::reportReplicaSafe(int serverno, int replica,
+                                        u64 safed1){
+  ServerHT *s = Config->Servers[serverno];
+  u64 *d1 = ReplicaSafeD1 + serverno * MAX_REPLICAS;
+  if (replica >= 0){ d1[replica] = safed1; return; }
+  for (int i=0; i < s->nreplicas; ++i)
+    if (d1[i] < safed1) d1[i] = safed1;
+}
+#endif
+
 // void ObjectDirectory::GetServerId(const COid& coid, IPPort &ipport){
 //   unsigned serverno;
 
@@ -190,6 +190,7 @@ PendingOpsEntry::~PendingOpsEntry(){
     u.delrange.cell2.Free(); // free cell2
     break;
   case 2:
+  case 3:
     break;
   default:
     assert(0);
@@ -305,6 +306,11 @@ int TxCache::auxApplyOp(Ptr<Valbuf> vbuf, PendingOpsEntry *poe){
     u64 attrvalue = poe->u.attrset.attrvalue;
     if (attrid >= (unsigned)vbuf->u.raw->Nattrs){ return GAIAERR_ATTR_OUTRANGE; }
     vbuf->u.raw->Attrs[attrid] = attrvalue;
+  } else if (poe->type == 3){ // attradd
+    u32 attrid = poe->u.attrset.attrid;
+    u64 delta = poe->u.attrset.attrvalue;
+    if (attrid >= (unsigned)vbuf->u.raw->Nattrs){ return GAIAERR_ATTR_OUTRANGE; }
+    vbuf->u.raw->Attrs[attrid] += delta;
   } else { // bad type
     assert(0);
     printf("clientlib.cpp: bad type in PendingOps\n");
@@ -475,6 +481,11 @@ void TxCache::addPendingOps(COid &coid, PendingOpsEntry *poe){
   if (res) *polptr = new PendingOpsList; // not found, so create new item
   pol = *polptr;
 
+  // a keyinfo allocated by sqlite is freed when its statement ends, but
+  // pending ops live until the transaction ends, so keep our own copy
+  if (poe->prki.isset() && (poe->prki->refcount & 0x4000000))
+    poe->prki = CloneKeyInfo(&*poe->prki);
+
   // insert add entry into pending ops
   pol->add(poe);
 }
@@ -252,6 +252,7 @@ int LocalTransaction::vget(COid coid, Ptr<Valbuf> &buf){
   rpcdata->data->cid = coid.cid;
   rpcdata->data->oid = coid.oid;
   rpcdata->data->len = -1;  // requested max bytes to read
+  rpcdata->data->replicamiss = 0;
 
   do {
     rpcresp = (ReadRPCRespData*) readRpc(rpcdata, (void*) &readwait, defer);
@@ -321,11 +322,14 @@ int LocalTransaction::vsuperget(COid coid, Ptr<Valbuf> &buf, ListCell *cell,
   // fill out parameters
   rpcdata->data->tid = Id;
   rpcdata->data->ts = StartTs;
+  rpcdata->data->cachedts.setIllegal();
   rpcdata->data->cid = coid.cid;
   rpcdata->data->oid = coid.oid;
   rpcdata->data->prki = prki;
   if (cell) rpcdata->data->cell = *cell;
   else memset(&rpcdata->data->cell, 0, sizeof(ListCell));
+  rpcdata->data->cellOnly = 0;
+  rpcdata->data->replicamiss = 0;
 
   do {
     rpcresp = (FullReadRPCRespData *) fullreadRpc(rpcdata, (void*) &readwait,
@@ -372,12 +376,22 @@ int LocalTransaction::vsuperget(COid coid, Ptr<Valbuf> &buf, ListCell *cell,
     u64 nkey;
     ptr += myGetVarint((unsigned char*) ptr, &nkey);
     sv->Cells[i].nKey = nkey;
-    if (r->celltype == 0) sv->Cells[i].pKey = 0; // integer cell, set pKey=0
+    if (r->celltype != 1) sv->Cells[i].pKey = 0; // integer cell, set pKey=0
     else { // non-integer key, so extract pKey (nkey has its length)
       sv->Cells[i].pKey = new char[(int)nkey];
       memcpy(sv->Cells[i].pKey, ptr, (int)nkey);
       ptr += (int)nkey;
     }
+    if (r->celltype == 2){ // extract inline row, if any
+      u64 ndata;
+      ptr += myGetVarint((unsigned char*) ptr, &ndata);
+      sv->Cells[i].nData = (int) ndata;
+      if (ndata){
+        sv->Cells[i].pData = (char*) malloc((size_t)ndata);
+        memcpy(sv->Cells[i].pData, ptr, (size_t)ndata);
+        ptr += ndata;
+      }
+    }
     // extract childOid
     sv->Cells[i].value = *(Oid*)ptr;
     ptr += sizeof(u64); // space for 64-bit value in cell
@@ -449,6 +463,10 @@ int LocalTransaction::auxprepare(Timestamp &chosents){
   rpcdata->data->piggy_oid = 0;  
   rpcdata->data->piggy_len = -1;  
   rpcdata->data->piggy_buf = 0;  
+  rpcdata->data->readset_len = 0;
+  rpcdata->data->readset = 0;
+  rpcdata->data->nparticipants = 0; // no other servers to ask about outcome
+  rpcdata->data->participants = 0;
 
   rpcresp = (PrepareRPCRespData*) prepareRpc(rpcdata, state, 0);
   if (!rpcresp){ 
@@ -734,12 +752,15 @@ int LocalTransaction::writeSuperValue(COid coid, SuperValue *sv){
   // calculate space needed for cells
   len = 0;
   for (i=0; i < sv->Ncells; ++i){
-    if (sv->CellType == 0){ // int key
+    if (sv->CellType != 1){ // int key
       len += myVarintLen(sv->Cells[i].nKey);
       assert(sv->Cells[i].pKey==0);
     }
     else len += myVarintLen(sv->Cells[i].nKey) +
            (int) sv->Cells[i].nKey; // non-int key
+    if (sv->CellType == 2) // inline row
+      len += myVarintLen(sv->Cells[i].nData) + sv->Cells[i].nData;
+    else assert(sv->Cells[i].pData==0);
     len += sizeof(u64); // space for 64-bit value in cell
   }
   // fill celloids
@@ -750,11 +771,18 @@ int LocalTransaction::writeSuperValue(COid coid, SuperValue *sv){
   ptr = cells;
   for (i=0; i < sv->Ncells; ++i){
     ptr += myPutVarint((unsigned char*)ptr, sv->Cells[i].nKey);
-    if (sv->CellType == 0) ; // int key, do nothing
+    if (sv->CellType != 1) ; // int key, do nothing
     else { // non-int key, copy content in pKey
       memcpy(ptr, sv->Cells[i].pKey, (int) sv->Cells[i].nKey);
       ptr += sv->Cells[i].nKey;
     }
+    if (sv->CellType == 2){ // inline row
+      ptr += myPutVarint((unsigned char*)ptr, sv->Cells[i].nData);
+      if (sv->Cells[i].nData){
+        memcpy(ptr, sv->Cells[i].pData, sv->Cells[i].nData);
+        ptr += sv->Cells[i].nData;
+      }
+    }
     // copy childOid
     memcpy(ptr, &sv->Cells[i].value, sizeof(u64));
     ptr += sizeof(u64);
@@ -805,9 +833,11 @@ int LocalTransaction::listAdd(COid coid, ListCell *cell, Ptr<RcKeyInfo> prki,
   
   if (flags & 1){
     if (vbuf->u.raw->Ncells >= 1){
-      int matches;
-      myCellSearchNode(vbuf, cell->nKey, cell->pKey, 0, prki, &matches);
-      if (matches) return 0; // found
+      int matches=0, index;
+      index = myCellSearchNode(vbuf, cell->nKey, cell->pKey, 0, prki,
+                               &matches);
+      if (matches && ListCell::samePayload(vbuf->u.raw->Cells[index], *cell))
+        return 0; // found
     }
     flags &= ~1; // don't check again in listaddRpc, we already read the value
   }
@@ -975,8 +1005,19 @@ int LocalTransaction::listDelRange(COid coid, u8 intervalType, ListCell *cell1,
   return respstatus;
 }
 
-// adds a cell to a supervalue
+// sets an attribute of a supervalue
 int LocalTransaction::attrSet(COid coid, u32 attrid, u64 attrvalue){
+  return auxattrop(coid, attrid, attrvalue, false);
+}
+
+// adds delta to an attribute of a supervalue
+int LocalTransaction::attrAdd(COid coid, u32 attrid, u64 delta){
+  return auxattrop(coid, attrid, delta, true);
+}
+
+// sets an attribute (add==false) or adds attrvalue to it (add==true)
+int LocalTransaction::auxattrop(COid coid, u32 attrid, u64 attrvalue,
+                                bool add){
   AttrSetRPCData *rpcdata;
   AttrSetRPCRespData *rpcresp;
   int respstatus;
@@ -1012,7 +1053,8 @@ int LocalTransaction::attrSet(COid coid, u32 attrid, u64 attrvalue){
   rpcdata->data->attrid = attrid;  
   rpcdata->data->attrvalue = attrvalue; 
 
-  rpcresp = (AttrSetRPCRespData *) attrsetRpc(rpcdata);
+  if (add) rpcresp = (AttrSetRPCRespData *) attraddRpc(rpcdata);
+  else rpcresp = (AttrSetRPCRespData *) attrsetRpc(rpcdata);
   delete rpcdata;
 
   if (!rpcresp){ // error contacting server
@@ -1030,7 +1072,8 @@ int LocalTransaction::attrSet(COid coid, u32 attrid, u64 attrvalue){
       vbufincache = 0; // this new vbuf is not in cache, store it below
     }
     
-    vbuf->u.raw->Attrs[attrid] = attrvalue;
+    if (add) vbuf->u.raw->Attrs[attrid] += attrvalue;
+    else vbuf->u.raw->Attrs[attrid] = attrvalue;
     if (!vbufincache)
       txCache.setCache(coid, currlevel, vbuf);
   }
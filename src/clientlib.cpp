@@ -55,6 +55,7 @@
 #include "clientlib-common.h"
 #include "clientdir.h"
 #include "gaiarpcaux.h"
+#include "gaiarpcauxfunc.h"
 #include "newconfig.h"
 #include "supervalue.h"
 #include "record.h"
@@ -98,7 +99,14 @@ int Transaction::start(){
   State = 0;  // valid
   hasWrites = false;
   hasWritesCachable = false;
+#ifdef GAIA_LEASES
+  hasWritesLeased = false;
+#endif
   currlevel = 0;
+#ifdef GAIA_STALE_READS
+  staleMs = 0;
+  stale = false;
+#endif
   if (piggy_buf) delete piggy_buf;
   piggy_len = -1;
   piggy_buf = 0;
@@ -118,9 +126,31 @@ int Transaction::startDeferredTs(void){
   txCache.clear();
   State = 0;  // valid
   hasWrites = false;
+#ifdef GAIA_LEASES
+  hasWritesLeased = false;
+#endif
+#ifdef GAIA_STALE_READS
+  staleMs = 0;
+  stale = false;
+#endif
   return 0;
 }
 
+#ifdef GAIA_STALE_READS
+// start a transaction whose snapshot may be up to maxstalems old. The
+// snapshot is chosen by the first read (see tryCachedRead)
+int Transaction::startStale(int maxstalems){
+  start();
+  if (maxstalems > GAIA_STALE_READS_MAX_MS)
+    maxstalems = GAIA_STALE_READS_MAX_MS;
+  if (maxstalems > 0){
+    staleMs = maxstalems;
+    Sc->VCache.InUse = true; // start filling the cache of versions
+  }
+  return 0;
+}
+#endif
+
 static int ioveclen(iovec *bufs, int nbufs){
   int len = 0;
   for (int i=0; i < nbufs; ++i)len += bufs[i].iov_len;
@@ -290,17 +320,125 @@ int Transaction::tryLocalRead(COid &coid, Ptr<Valbuf> &buf, int typ){
   else return 0;
 }
 
+#ifdef GAIA_STALE_READS
+// Try to read a version of coid from the cache of versions, if the
+// transaction has a stale snapshot or if coid is a supervalue that may have
+// a lease. The first read of a transaction started with startStale chooses
+// the snapshot: the oldest allowed timestamp at which a cached version is
+// valid, or the start timestamp (the time of startStale) if there is no
+// such version.
+// Returns 1 if read, 0 otherwise
+int Transaction::tryCachedRead(COid &coid, Ptr<Valbuf> &buf, int typ){
+  int res;
+  if (staleMs){ // first read, choose snapshot
+    Timestamp oldest;
+    oldest.setOld(staleMs);
+    staleMs = 0;
+    stale = true;
+    if (txCache.hasPendingOps(coid)) return 0;
+    res = Sc->VCache.lookupRecent(coid, typ, oldest, buf);
+    if (res) return 0; // keep start timestamp
+    if (Timestamp::cmp(oldest, buf->commitTs) < 0) StartTs = buf->commitTs;
+    else StartTs = oldest;
+    return 1;
+  }
+  if (!stale){
+#ifdef GAIA_LEASES
+    // a recent start timestamp falls in the validity of a cached version
+    // mostly when the version has a lease, and only supervalues get those
+    if (typ != 1 || StartTs.isIllegal() || !Sc->VCache.InUse) return 0;
+#else
+    return 0;
+#endif
+  }
+  if (txCache.hasPendingOps(coid)) return 0;
+  res = Sc->VCache.lookup(coid, typ, StartTs, buf);
+  return res ? 0 : 1;
+}
+
+#ifdef GAIA_LEASES
+bool Transaction::hasCachedVersion(COid &coid, int typ){
+  if (State || staleMs || StartTs.isIllegal() || !Sc->VCache.InUse ||
+      !stale && typ != 1 || txCache.hasPendingOps(coid)) return false;
+  return Sc->VCache.has(coid, typ, StartTs);
+}
+#endif
+
+// Adds a version just read from a server to the cache of versions, unless
+// the transaction is about to apply its own updates to it
+void Transaction::cacheRefresh(COid &coid, Ptr<Valbuf> &buf){
+  if (!Sc->VCache.InUse || buf->cellsBefore || buf->cellsAfter ||
+      txCache.hasPendingOps(coid)) return;
+  Sc->VCache.refresh(buf);
+}
+#endif
+
+// Process the reply of a READ rpc for coid sent to server. Fills buf and
+// returns the status in the reply. Takes ownership of resp.
+int Transaction::auxvgetresp(COid &coid, IPPortServerno &server, char *resp,
+                             Ptr<Valbuf> &buf, int replica){
+  ReadRPCRespData rpcresp;
+  int respstatus;
+  Valbuf *vbuf;
+
+  rpcresp.demarshall(resp);
+
+#ifdef GAIA_CLIENT_CONSISTENT_CACHE
+  // refresh client cache metadata
+  if (replica < 0)
+    Sc->CCache->report(server.serverno, rpcresp.data->versionNoForCache,
+                     rpcresp.data->tsForCache, rpcresp.data->reserveTsForCache);
+#endif
+#ifdef GAIA_REPLICAS
+  Sc->Od->reportReplicaSafe(server.serverno, replica,
+                            rpcresp.data->replicasafed1);
+#endif
+  
+  respstatus = rpcresp.data->status;
+  if (respstatus){ free(resp); buf = 0; return respstatus; }
+
+  if (StartTs.isIllegal()){ // if tx had no start timestamp, set it
+    u64 readtsage = rpcresp.data->readts.age();
+    if (readtsage > MAX_DEFERRED_START_TS){
+      //dprintf(1,"Deferred: beyond max deferred age by %lld ms\n",
+      //        (long long)readtsage);
+      StartTs.setOld(MAX_DEFERRED_START_TS);
+    }
+    else StartTs = rpcresp.data->readts;
+  }
+
+  // fill out buf (returned value to user) with reply from RPC
+  vbuf = new Valbuf;
+  vbuf->type = 0;
+  vbuf->coid = coid;
+  vbuf->immutable = true;
+  vbuf->commitTs = rpcresp.data->readts;
+  vbuf->readTs = StartTs;
+  vbuf->len = rpcresp.data->len;
+  vbuf->u.buf = rpcresp.data->buf;
+  buf = vbuf;
+
+#ifdef GAIA_CLIENT_CONSISTENT_CACHE
+  if (IsCoidCachable(coid)){
+    Sc->CCache->set(server.serverno, coid, new Valbuf(*vbuf)); // copy valbuf
+                                                        // for consistent cache
+  }
+#endif
+  return 0;
+}
+
 int Transaction::vget(COid coid, Ptr<Valbuf> &buf){
   IPPortServerno server;
   int reslocalread;
 
   ReadRPCData *rpcdata;
-  ReadRPCRespData rpcresp;
   char *resp;
   int respstatus=0;
-
-  Valbuf *vbuf;  
   int res;
+#ifdef GAIA_REPLICAS
+  IPPort replicaipport;
+  int replica, replicamiss=0;
+#endif
 
   Sc->Od->GetServerId(coid, server);
 
@@ -319,6 +457,10 @@ int Transaction::vget(COid coid, Ptr<Valbuf> &buf){
   ReadSet.insert(coid);
 #endif
 
+#ifdef GAIA_STALE_READS
+  if (tryCachedRead(coid, buf, 0)) goto skiprpc; // got version from cache
+#endif
+
 #ifdef GAIA_CLIENT_CONSISTENT_CACHE
   if (IsCoidCachable(coid)){
     int rescache;
@@ -331,6 +473,12 @@ int Transaction::vget(COid coid, Ptr<Valbuf> &buf){
   }
 #endif
 
+#ifdef GAIA_REPLICAS
+  // snapshot reads go to a replica if it has caught up with StartTs
+  replica = Sc->Od->GetReplicaId(coid, server.serverno, StartTs,
+                                 replicaipport);
+ retry:
+#endif
   rpcdata = new ReadRPCData;
   rpcdata->data = new ReadRPCParm;
   rpcdata->freedata = true; 
@@ -341,76 +489,225 @@ int Transaction::vget(COid coid, Ptr<Valbuf> &buf){
   rpcdata->data->cid = coid.cid;
   rpcdata->data->oid = coid.oid;
   rpcdata->data->len = -1;  // requested max bytes to read
-
+  rpcdata->data->replicamiss = 0;
+
+#ifdef GAIA_REPLICAS
+  rpcdata->data->replicamiss = replicamiss;
+  if (replica >= 0)
+    resp = Sc->Rpcc->syncRPC(replicaipport, READ_RPCNO,
+                             FLAG_HID(TID_TO_RPCHASHID(Id)), rpcdata);
+  else
+#endif
   resp = Sc->Rpcc->syncRPC(server.ipport, READ_RPCNO,
                            FLAG_HID(TID_TO_RPCHASHID(Id)), rpcdata);
 
   if (!resp){ // error contacting server
+#ifdef GAIA_REPLICAS
+    if (replica >= 0){ // try the server instead
+      Sc->Od->reportReplicaSafe(server.serverno, replica, 0);
+      replica = -1;
+      goto retry;
+    }
+#endif
     //State=-2; // mark transaction as aborted due to I/O error
     buf = 0;
     return GAIAERR_SERVER_TIMEOUT;
   }
 
+#ifdef GAIA_REPLICAS
+  respstatus = auxvgetresp(coid, server, resp, buf, replica);
+  if (replica >= 0 && (respstatus == GAIAERR_REPLICA_BEHIND ||
+                       respstatus == GAIAERR_REPLICA_MISS)){
+    // replica cannot serve read; ask server, which sends object to replica
+    replicamiss = respstatus == GAIAERR_REPLICA_MISS;
+    replica = -1;
+    goto retry;
+  }
+#else
+  respstatus = auxvgetresp(coid, server, resp, buf);
+#endif
+  if (respstatus) return respstatus;
+#ifdef GAIA_STALE_READS
+  cacheRefresh(coid, buf);
+#endif
+
+ skiprpc:
+  res = txCache.applyPendingOps(coid, buf, readsTxCached<MAX_READS_TO_TXCACHE);
+  if (res<0) return res;
+  if (readsTxCached < MAX_READS_TO_TXCACHE || res > 0) ++readsTxCached;
+
+  return respstatus;
+}
+
+// Process the reply of a FULLREAD rpc for coid sent to server. Fills buf and
+// returns the status in the reply. Frees resp. If the reply has deltas, they
+// are applied to a copy of base, using prki to compare cells.
+int Transaction::auxvsupergetresp(COid &coid, IPPortServerno &server,
+                                  char *resp, Ptr<Valbuf> &buf,
+                                  Ptr<Valbuf> base, Ptr<RcKeyInfo> prki,
+                                  int replica){
+  FullReadRPCRespData rpcresp;
+  int respstatus;
+
   rpcresp.demarshall(resp);
 
 #ifdef GAIA_CLIENT_CONSISTENT_CACHE
   // refresh client cache metadata
-  Sc->CCache->report(server.serverno, rpcresp.data->versionNoForCache,
+  if (replica < 0)
+    Sc->CCache->report(server.serverno, rpcresp.data->versionNoForCache,
                      rpcresp.data->tsForCache, rpcresp.data->reserveTsForCache);
 #endif
+#ifdef GAIA_REPLICAS
+  Sc->Od->reportReplicaSafe(server.serverno, replica,
+                            rpcresp.data->replicasafed1);
+#endif
   
   respstatus = rpcresp.data->status;
   if (respstatus){ free(resp); buf = 0; return respstatus; }
 
+  FullReadRPCResp *r = rpcresp.data; // for convenience
+  Timestamp readuntil; // version is the value of the object until then
+
   if (StartTs.isIllegal()){ // if tx had no start timestamp, set it
-    u64 readtsage = rpcresp.data->readts.age();
+    i64 readtsage = rpcresp.data->readts.age();
     if (readtsage > MAX_DEFERRED_START_TS){
-      //dprintf(1,"Deferred: beyond max deferred age by %lld ms\n",
+      //printf("\nDeferred: beyond max deferred age by %lld ms ",
       //        (long long)readtsage);
       StartTs.setOld(MAX_DEFERRED_START_TS);
     }
     else StartTs = rpcresp.data->readts;
   }
 
-  // fill out buf (returned value to user) with reply from RPC
-  vbuf = new Valbuf;
-  vbuf->type = 0;
-  vbuf->coid = coid;
-  vbuf->immutable = true;
-  vbuf->commitTs = rpcresp.data->readts;
-  vbuf->readTs = StartTs;
-  vbuf->len = rpcresp.data->len;
-  vbuf->u.buf = rpcresp.data->buf;
-  buf = vbuf;
-
-#ifdef GAIA_CLIENT_CONSISTENT_CACHE
-  if (IsCoidCachable(coid)){
-    Sc->CCache->set(server.serverno, coid, new Valbuf(*vbuf)); // copy valbuf
-                                                        // for consistent cache
+  readuntil = StartTs;
+#ifdef GAIA_LEASES
+  if (!r->leasets.isIllegal() && Timestamp::cmp(r->leasets, StartTs) > 0){
+    readuntil = r->leasets;
+    Sc->VCache.InUse = true; // start keeping leased versions
   }
 #endif
 
- skiprpc:
-  res = txCache.applyPendingOps(coid, buf, readsTxCached<MAX_READS_TO_TXCACHE);
-  if (res<0) return res;
-  if (readsTxCached < MAX_READS_TO_TXCACHE || res > 0) ++readsTxCached;
+  if (r->delta){ // reply has the updates to base since its version
+    assert(base.isset());
+    if (r->prki.isset()) prki = r->prki;
+    buf = new Valbuf(*base);
+    buf->immutable = true;
+    buf->commitTs = r->readts;
+    buf->readTs = readuntil;
+    SuperValue *sv = buf->u.raw;
+    if (sv->Nattrs != r->nattrs){
+      delete [] sv->Attrs;
+      sv->Nattrs = r->nattrs;
+      sv->Attrs = new u64[sv->Nattrs];
+    }
+    memcpy(sv->Attrs, r->attrs, sizeof(u64) * sv->Nattrs);
+    if (prki.isset()) sv->prki = prki;
+
+    char *ptr = r->celloids;
+    respstatus = 0;
+    for (int i=0; i < (int) r->ncelloids; ++i){
+      PendingOpsEntry *poe = new PendingOpsEntry;
+      ListCell cell1, cell2;
+      int intervtype;
+      ptr = DeltasGetOne(ptr, poe->type, intervtype, &cell1, &cell2);
+      poe->prki = prki;
+      if (poe->type == 0) new(&poe->u.add.cell) ListCell(cell1);
+      else {
+        new(&poe->u.delrange.cell1) ListCell(cell1);
+        new(&poe->u.delrange.cell2) ListCell(cell2);
+        poe->u.delrange.intervtype = intervtype;
+        cell2.Free();
+      }
+      cell1.Free();
+      if (!respstatus) respstatus = TxCache::auxApplyOp(buf, poe);
+      delete poe;
+    }
+    if (respstatus) buf = 0;
+    free(resp);
+    return respstatus;
+  }
 
-  return respstatus;
+  Valbuf *vbuf = new Valbuf;
+  vbuf->type = 1;
+  vbuf->coid = coid;
+  vbuf->immutable = true;
+  vbuf->commitTs = r->readts;
+  vbuf->readTs = readuntil;
+  vbuf->len = 0; // not applicable for supervalue
+  SuperValue *sv = new SuperValue;
+  vbuf->u.raw = sv;
+
+  sv->Nattrs = r->nattrs;
+  sv->CellType = r->celltype;
+  sv->Ncells = r->ncelloids;
+  sv->CellsSize = r->lencelloids;
+  sv->Attrs = new u64[sv->Nattrs]; assert(sv->Attrs);
+  memcpy(sv->Attrs, r->attrs, sizeof(u64) * sv->Nattrs);
+  sv->Cells = new ListCell[sv->Ncells];
+  // fill out cells
+  char *ptr = r->celloids;
+  for (int i=0; i < sv->Ncells; ++i){
+    // extract nkey
+    u64 nkey;
+    ptr += myGetVarint((unsigned char*) ptr, &nkey);
+    sv->Cells[i].nKey = nkey;
+    if (r->celltype != 1) sv->Cells[i].pKey = 0; // integer cell, set pKey=0
+    else { // non-integer key, so extract pKey (nkey has its length)
+      sv->Cells[i].pKey = new char[(unsigned)nkey];
+      memcpy(sv->Cells[i].pKey, ptr, (unsigned)nkey);
+      ptr += nkey;
+    }
+    if (r->celltype == 2){ // extract inline row, if any
+      u64 ndata;
+      ptr += myGetVarint((unsigned char*) ptr, &ndata);
+      sv->Cells[i].nData = (int) ndata;
+      if (ndata){
+        sv->Cells[i].pData = (char*) malloc((size_t)ndata);
+        memcpy(sv->Cells[i].pData, ptr, (size_t)ndata);
+        ptr += ndata;
+      }
+    }
+    // extract childOid
+    sv->Cells[i].value = *(Oid*)ptr;
+    ptr += sizeof(u64); // space for 64-bit value in cell
+  }
+  sv->prki = r->prki;
+  vbuf->cellsBefore = r->cellsbefore;
+  vbuf->cellsAfter = r->cellsafter;
+  buf = vbuf;
+  free(resp); // free response buffer
+  return 0;
 }
 
 int Transaction::vsuperget(COid coid, Ptr<Valbuf> &buf, ListCell *cell,
-                           Ptr<RcKeyInfo> prki){
+                           Ptr<RcKeyInfo> prki, Ptr<Valbuf> *base,
+                           bool cellonly){
   IPPortServerno server;
   int reslocalread;
   FullReadRPCData *rpcdata;
-  FullReadRPCRespData rpcresp;
   char *resp;
   int respstatus;
   int res;
+  Ptr<Valbuf> deltabase;
+#ifdef GAIA_REPLICAS
+  IPPort replicaipport;
+  int replica, replicamiss=0;
+#endif
 
   Sc->Od->GetServerId(coid, server);  
   if (State){ buf = 0; return GAIAERR_TX_ENDED; }
   
+  if (base){
+#ifdef GAIA_DELTA_READS
+    // use base for deltas only if we can compare its cells
+    deltabase = *base;
+    if (deltabase.isset() && deltabase->u.raw->CellType == 1 &&
+        !deltabase->u.raw->prki.isset() && !prki.isset())
+      deltabase = 0;
+    if (deltabase.isset() && !prki.isset()) prki = deltabase->u.raw->prki;
+#endif
+    *base = 0;
+  }
+  
   reslocalread = tryLocalRead(coid, buf, 1);
   if (reslocalread < 0) return reslocalread;
   if (reslocalread == 1){
@@ -424,6 +721,16 @@ int Transaction::vsuperget(COid coid, Ptr<Valbuf> &buf, ListCell *cell,
   ReadSet.insert(coid);
 #endif
 
+#ifdef GAIA_STALE_READS
+  if (tryCachedRead(coid, buf, 1)) goto skiprpc; // got version from cache
+#endif
+
+#ifdef GAIA_REPLICAS
+  // snapshot reads go to a replica if it has caught up with StartTs
+  replica = Sc->Od->GetReplicaId(coid, server.serverno, StartTs,
+                                 replicaipport);
+ retry:
+#endif
   rpcdata = new FullReadRPCData;
   rpcdata->data = new FullReadRPCParm;
   rpcdata->freedata = true; 
@@ -431,6 +738,8 @@ int Transaction::vsuperget(COid coid, Ptr<Valbuf> &buf, ListCell *cell,
   // fill out parameters
   rpcdata->data->tid = Id;
   rpcdata->data->ts = StartTs;
+  if (deltabase.isset()) rpcdata->data->cachedts = deltabase->commitTs;
+  else rpcdata->data->cachedts.setIllegal();
   rpcdata->data->cid = coid.cid;
   rpcdata->data->oid = coid.oid;
   rpcdata->data->prki = prki;
@@ -442,81 +751,222 @@ int Transaction::vsuperget(COid coid, Ptr<Valbuf> &buf, ListCell *cell,
     rpcdata->data->cellPresent = 0;
     memset(&rpcdata->data->cell, 0, sizeof(ListCell));
   }
-
+  // part of the cells will not do if tx has updates to apply to them
+  rpcdata->data->cellOnly = cellonly && !txCache.hasPendingOps(coid);
+  rpcdata->data->replicamiss = 0;
+
+#ifdef GAIA_REPLICAS
+  rpcdata->data->replicamiss = replicamiss;
+  if (replica >= 0)
+    resp = Sc->Rpcc->syncRPC(replicaipport, FULLREAD_RPCNO,
+                             FLAG_HID(TID_TO_RPCHASHID(Id)), rpcdata);
+  else
+#endif
   resp = Sc->Rpcc->syncRPC(server.ipport, FULLREAD_RPCNO,
                            FLAG_HID(TID_TO_RPCHASHID(Id)), rpcdata);
 
   if (!resp){ // error contacting server
+#ifdef GAIA_REPLICAS
+    if (replica >= 0){ // try the server instead
+      Sc->Od->reportReplicaSafe(server.serverno, replica, 0);
+      replica = -1;
+      goto retry;
+    }
+#endif
     //State=-2; // mark transaction as aborted due to I/O error
     buf = 0;
     return GAIAERR_SERVER_TIMEOUT;
   }
 
-  rpcresp.demarshall(resp);
+#ifdef GAIA_REPLICAS
+  respstatus = auxvsupergetresp(coid, server, resp, buf, deltabase, prki,
+                                replica);
+  if (replica >= 0 && (respstatus == GAIAERR_REPLICA_BEHIND ||
+                       respstatus == GAIAERR_REPLICA_MISS)){
+    // replica cannot serve read; ask server, which sends object to replica
+    replicamiss = respstatus == GAIAERR_REPLICA_MISS;
+    replica = -1;
+    goto retry;
+  }
+#else
+  respstatus = auxvsupergetresp(coid, server, resp, buf, deltabase, prki);
+#endif
+  if (respstatus) return respstatus;
+  if (buf->cellsBefore || buf->cellsAfter) return 0; // not whole, no caching
+#ifdef GAIA_STALE_READS
+  cacheRefresh(coid, buf);
+#endif
 
-#ifdef GAIA_CLIENT_CONSISTENT_CACHE
-  // refresh client cache metadata
-  Sc->CCache->report(server.serverno, rpcresp.data->versionNoForCache,
-                     rpcresp.data->tsForCache, rpcresp.data->reserveTsForCache);
+ skiprpc:
+  // buf has exactly the server's version unless tx has updates to apply
+  if (base && !txCache.hasPendingOps(coid)) *base = buf;
+  res = txCache.applyPendingOps(coid, buf, readsTxCached<MAX_READS_TO_TXCACHE);
+  if (res<0) return res;
+  if (readsTxCached < MAX_READS_TO_TXCACHE || res > 0) ++readsTxCached;
+  return respstatus;
+}
+
+// ------------------------------ Batched reads --------------------------------
+
+// static method
+void Transaction::auxreadmanycallback(char *data, int len, void *callbackdata){
+  ReadManyCallbackData *rmcd = (ReadManyCallbackData*) callbackdata;
+  if (data){ // keep a copy of the reply, as data is freed on return
+    rmcd->resp = (char*) malloc(len);
+    memcpy(rmcd->resp, data, len);
+  } else rmcd->resp = 0; // indicates an error
+  rmcd->sem.signal();
+  return; // free buffer
+}
+
+void Transaction::auxreadmanysend(COid &coid, int typ,
+                                  ReadManyCallbackData *cd, int replicamiss){
+  IPPort ipport = cd->server.ipport;
+
+  cd->replica = -1;
+#ifdef GAIA_REPLICAS
+  if (replicamiss < 0)
+    cd->replica = Sc->Od->GetReplicaId(coid, cd->server.serverno, StartTs,
+                                       ipport);
 #endif
-  
-  respstatus = rpcresp.data->status;
-  if (respstatus){ free(resp); buf = 0; return respstatus; }
+  if (typ == 0){
+    ReadRPCData *rpcdata = new ReadRPCData;
+    rpcdata->data = new ReadRPCParm;
+    rpcdata->freedata = true; 
+    rpcdata->data->tid = Id;
+    rpcdata->data->ts = StartTs;
+    rpcdata->data->cid = coid.cid;
+    rpcdata->data->oid = coid.oid;
+    rpcdata->data->len = -1;  // requested max bytes to read
+    rpcdata->data->replicamiss = replicamiss > 0;
+    Sc->Rpcc->asyncRPC(ipport, READ_RPCNO,
+                       FLAG_HID(TID_TO_RPCHASHID(Id)), rpcdata,
+                       auxreadmanycallback, cd);
+  } else {
+    FullReadRPCData *rpcdata = new FullReadRPCData;
+    rpcdata->data = new FullReadRPCParm;
+    rpcdata->freedata = true; 
+    rpcdata->data->tid = Id;
+    rpcdata->data->ts = StartTs;
+    rpcdata->data->cachedts.setIllegal();
+    rpcdata->data->cid = coid.cid;
+    rpcdata->data->oid = coid.oid;
+    rpcdata->data->cellPresent = 0;
+    memset(&rpcdata->data->cell, 0, sizeof(ListCell));
+    rpcdata->data->cellOnly = 0;
+    rpcdata->data->replicamiss = replicamiss > 0;
+    Sc->Rpcc->asyncRPC(ipport, FULLREAD_RPCNO,
+                       FLAG_HID(TID_TO_RPCHASHID(Id)), rpcdata,
+                       auxreadmanycallback, cd);
+  }
+}
 
-  FullReadRPCResp *r = rpcresp.data; // for convenience
+int Transaction::vgetMany(int n, COid *coids, Ptr<Valbuf> *bufs, int typ){
+  IPPortServerno server;
+  ReadManyCallbackData *rmcd;
+  int i, start, end, res, status;
 
-  if (StartTs.isIllegal()){ // if tx had no start timestamp, set it
-    i64 readtsage = rpcresp.data->readts.age();
-    if (readtsage > MAX_DEFERRED_START_TS){
-      //printf("\nDeferred: beyond max deferred age by %lld ms ",
-      //        (long long)readtsage);
-      StartTs.setOld(MAX_DEFERRED_START_TS);
-    }
-    else StartTs = rpcresp.data->readts;
+  if (State) return GAIAERR_TX_ENDED;
+  if (n <= 0) return 0;
+
+  status = 0;
+  start = 0;
+#ifdef GAIA_STALE_READS
+  if (StartTs.isIllegal() || staleMs){
+#else
+  if (StartTs.isIllegal()){
+#endif
+    // the first read chooses the start timestamp of the transaction, so it
+    // cannot be sent in parallel with the others
+    if (typ) res = vsuperget(coids[0], bufs[0], 0, Ptr<RcKeyInfo>());
+    else res = vget(coids[0], bufs[0]);
+    if (res){ bufs[0] = 0; status = res; }
+    start = 1;
   }
 
-  Valbuf *vbuf = new Valbuf;
-  vbuf->type = 1;
-  vbuf->coid = coid;
-  vbuf->immutable = true;
-  vbuf->commitTs = r->readts;
-  vbuf->readTs = StartTs;
-  vbuf->len = 0; // not applicable for supervalue
-  SuperValue *sv = new SuperValue;
-  vbuf->u.raw = sv;
+  rmcd = new ReadManyCallbackData[GAIA_READMANY_WINDOW];
+  for (; start < n; start = end){
+    end = start + GAIA_READMANY_WINDOW;
+    if (end > n) end = n;
+
+    // send the reads that cannot be served locally
+    for (i = start; i < end; ++i){
+      ReadManyCallbackData *cd = &rmcd[i-start];
+      cd->sent = false;
+      res = tryLocalRead(coids[i], bufs[i], typ);
+      if (res < 0){ bufs[i] = 0; if (!status) status = res; continue; }
+      if (res == 1) continue; // read completed already
+#ifdef GAIA_STALE_READS
+      if (tryCachedRead(coids[i], bufs[i], typ)){ // got version from cache
+        txCache.applyPendingOps(coids[i], bufs[i],
+                                readsTxCached<MAX_READS_TO_TXCACHE);
+        if (readsTxCached < MAX_READS_TO_TXCACHE) ++readsTxCached;
+        continue;
+      }
+#endif
+#ifdef GAIA_CLIENT_CONSISTENT_CACHE
+      if (typ == 0 && IsCoidCachable(coids[i])){ // use the consistent cache
+        res = vget(coids[i], bufs[i]);
+        if (res){ bufs[i] = 0; if (!status) status = res; }
+        continue;
+      }
+#endif
+      Sc->Od->GetServerId(coids[i], server);
+#ifdef GAIA_OCC
+      Servers.insert(server); 
+      ReadSet.insert(coids[i]);
+#endif
+      cd->server = server;
+      cd->sent = true;
+      auxreadmanysend(coids[i], typ, cd, -1);
+    }
 
-  sv->Nattrs = r->nattrs;
-  sv->CellType = r->celltype;
-  sv->Ncells = r->ncelloids;
-  sv->CellsSize = r->lencelloids;
-  sv->Attrs = new u64[sv->Nattrs]; assert(sv->Attrs);
-  memcpy(sv->Attrs, r->attrs, sizeof(u64) * sv->Nattrs);
-  sv->Cells = new ListCell[sv->Ncells];
-  // fill out cells
-  char *ptr = r->celloids;
-  for (int i=0; i < sv->Ncells; ++i){
-    // extract nkey
-    u64 nkey;
-    ptr += myGetVarint((unsigned char*) ptr, &nkey);
-    sv->Cells[i].nKey = nkey;
-    if (r->celltype == 0) sv->Cells[i].pKey = 0; // integer cell, set pKey=0
-    else { // non-integer key, so extract pKey (nkey has its length)
-      sv->Cells[i].pKey = new char[(unsigned)nkey];
-      memcpy(sv->Cells[i].pKey, ptr, (unsigned)nkey);
-      ptr += nkey;
+    // collect the replies
+    for (i = start; i < end; ++i){
+      ReadManyCallbackData *cd = &rmcd[i-start];
+      if (!cd->sent) continue;
+      cd->sem.wait(INFINITE);
+#ifdef GAIA_REPLICAS
+      if (cd->replica >= 0 && !cd->resp){ // try the server instead
+        Sc->Od->reportReplicaSafe(cd->server.serverno, cd->replica, 0);
+        auxreadmanysend(coids[i], typ, cd, 0);
+        cd->sem.wait(INFINITE);
+      }
+#endif
+      if (!cd->resp) res = GAIAERR_SERVER_TIMEOUT;
+      else if (typ == 0) res = auxvgetresp(coids[i], cd->server, cd->resp,
+                                           bufs[i], cd->replica);
+      else res = auxvsupergetresp(coids[i], cd->server, cd->resp, bufs[i],
+                                  Ptr<Valbuf>(), Ptr<RcKeyInfo>(),
+                                  cd->replica);
+#ifdef GAIA_REPLICAS
+      if (cd->replica >= 0 && (res == GAIAERR_REPLICA_BEHIND ||
+                               res == GAIAERR_REPLICA_MISS)){
+        // replica cannot serve read; ask server, which sends it the object
+        auxreadmanysend(coids[i], typ, cd, res == GAIAERR_REPLICA_MISS);
+        cd->sem.wait(INFINITE);
+        if (!cd->resp) res = GAIAERR_SERVER_TIMEOUT;
+        else if (typ == 0) res = auxvgetresp(coids[i], cd->server, cd->resp,
+                                             bufs[i]);
+        else res = auxvsupergetresp(coids[i], cd->server, cd->resp, bufs[i]);
+      }
+#endif
+      if (!res){
+#ifdef GAIA_STALE_READS
+        cacheRefresh(coids[i], bufs[i]);
+#endif
+        res = txCache.applyPendingOps(coids[i], bufs[i],
+                                      readsTxCached<MAX_READS_TO_TXCACHE);
+        if (res >= 0){
+          if (readsTxCached < MAX_READS_TO_TXCACHE || res > 0) ++readsTxCached;
+          res = 0;
+        }
+      }
+      if (res){ bufs[i] = 0; if (!status) status = res; }
     }
-    // extract childOid
-    sv->Cells[i].value = *(Oid*)ptr;
-    ptr += sizeof(u64); // space for 64-bit value in cell
   }
-  sv->prki = r->prki;
-  buf = vbuf;
-
-  res = txCache.applyPendingOps(coid, buf, readsTxCached<MAX_READS_TO_TXCACHE);
-  if (res<0) return res;
-  if (readsTxCached < MAX_READS_TO_TXCACHE || res > 0) ++readsTxCached;
-  free(resp); // free response buffer
-  return respstatus;
+  delete [] rmcd;
+  return status;
 }
 
 // free a buffer returned by Transaction::read
@@ -574,6 +1024,7 @@ int Transaction::auxprepare(Timestamp &chosents, int &hascommitted){
   int decision;
   Set<IPPortServerno> *serverset;
   Timestamp committs;
+  int nparticipants;
 
   serverset = &Servers;
 
@@ -595,6 +1046,14 @@ int Transaction::auxprepare(Timestamp &chosents, int &hascommitted){
   hascommitted = 0;
 #endif
 
+#ifdef GAIA_RESOLVE_ORPHANS
+  // tell servers who the other servers are, unless a single server commits
+  // the transaction right away
+  nparticipants = hascommitted ? 0 : serverset->getNitems();
+#else
+  nparticipants = 0;
+#endif
+
   for (it = serverset->getFirst(); it != serverset->getLast();
        it = serverset->getNext(it)){
     server = it->key;
@@ -654,6 +1113,18 @@ int Transaction::auxprepare(Timestamp &chosents, int &hascommitted){
     rpcdata->data->readset = 0;
 #endif
 
+    rpcdata->data->nparticipants = nparticipants;
+    if (nparticipants){
+      SetNode<IPPortServerno> *itpart;
+      int pos;
+      rpcdata->deleteparticipants = true;
+      rpcdata->data->participants = new IPPort[nparticipants];
+      for (pos = 0, itpart = serverset->getFirst();
+           itpart != serverset->getLast();
+           ++pos, itpart = serverset->getNext(itpart))
+        rpcdata->data->participants[pos] = itpart->key.ipport;
+    } else rpcdata->data->participants = 0;
+
     pcd = new PrepareCallbackData;
     pcd->serverno = server.serverno;
     pcdlist.pushTail(pcd);
@@ -681,6 +1152,9 @@ int Transaction::auxprepare(Timestamp &chosents, int &hascommitted){
         else decision = 1; // someone voted to abort
       }
     }
+#ifdef GAIA_LEASES
+    if (pcd->data.vote == 0 && pcd->data.leased) hasWritesLeased = true;
+#endif
     if (decision==0){ // still want to commit
       if (Timestamp::cmp(pcd->data.mincommitts, committs) > 0)
         committs = pcd->data.mincommitts;  // keep track of largest seen
@@ -769,6 +1243,59 @@ int Transaction::auxcommit(int outcome, Timestamp committs,
   return res;
 }
 
+#ifdef GAIA_EARLY_COMMIT_ACK
+// static method
+void Transaction::auxcommitasynccallback(char *data, int len,
+                                         void *callbackdata){
+  CommitAsyncData *cad = (CommitAsyncData*) callbackdata;
+  CommitRPCRespData rpcresp;
+  if (data){
+    rpcresp.demarshall(data);
+    if (!rpcresp.data->waitingts.isIllegal())
+      cad->cq->reportWaitingTs(rpcresp.data->waitingts);
+  }
+  // if data==0 the server could not be contacted; the outcome was already
+  // returned to the user, so there is nothing else to do here
+  if (AtomicDec32(&cad->pending) == 0){ // last reply
+    cad->cq->release();
+    delete cad;
+  }
+  return; // free buffer
+}
+
+void Transaction::auxcommitasync(int outcome, Timestamp committs){
+  IPPortServerno server;
+  CommitRPCData *rpcdata;
+  CommitAsyncData *cad;
+  SetNode<IPPortServerno> *it;
+
+  if (Servers.getNitems() == 0) return;
+
+  Sc->CQ.acquire();
+  cad = new CommitAsyncData;
+  cad->cq = &Sc->CQ;
+  cad->pending = Servers.getNitems();
+
+  for (it = Servers.getFirst(); it != Servers.getLast();
+       it = Servers.getNext(it)){
+    server = it->key;
+
+    rpcdata = new CommitRPCData;
+    rpcdata->data = new CommitRPCParm;
+    rpcdata->freedata = true;
+
+    // fill out parameters
+    rpcdata->data->tid = Id;
+    rpcdata->data->committs = committs;
+    rpcdata->data->commit = outcome;
+
+    Sc->Rpcc->asyncRPC(server.ipport, COMMIT_RPCNO,
+                       FLAG_HID(TID_TO_RPCHASHID(Id)), rpcdata,
+                       auxcommitasynccallback, cad);
+  }
+}
+#endif
+
 //--------------------------- subtransactions ------------------------
 // start a subtransaction with the given level, which
 // must be greater than currlevel
@@ -826,6 +1353,17 @@ int Transaction::releaseSubtrans(int level){
 //    3 if aborted due to prepare failure,
 //   <0 if commit error or transaction has ended
 
+// Waits until the local clock reaches ts. Used instead of advancing the
+// clock to a commit timestamp that a server pushed far into the future
+// (see GAIA_CLIENT_CONSISTENT_CACHE and GAIA_LEASES)
+static void waitUntilTs(Timestamp &ts){
+  int tosleep = -ts.ageus();
+  if (tosleep > 0){
+    ++tosleep;
+    usleep(tosleep);
+  }
+}
+
 int Transaction::tryCommit(Timestamp *retcommitts){
   int outcome;
   Timestamp committs, waitingts;
@@ -845,22 +1383,31 @@ int Transaction::tryCommit(Timestamp *retcommitts){
 
   if (outcome == 0 && !hascommitted){
 #ifdef GAIA_CLIENT_CONSISTENT_CACHE
-    if (hasWritesCachable){
-      int tosleep = -committs.ageus();
-      if (tosleep > 0){
-        ++tosleep;
-        usleep(tosleep);
-      }
-    }
-    else Timestamp::catchup(committs);
-#else
-    Timestamp::catchup(committs);    
+    if (hasWritesCachable) waitUntilTs(committs);
+    else
 #endif
+#ifdef GAIA_LEASES
+    if (hasWritesLeased) waitUntilTs(committs);
+    else
+#endif
+    Timestamp::catchup(committs);
   }
+#ifdef GAIA_LEASES
+  // a one-phase commit is done already, but later transactions of this
+  // client must still start after it
+  else if (outcome == 0 && hasWritesLeased) waitUntilTs(committs);
+#endif
 
   if (!hascommitted){
     // Commit phase
+#ifdef GAIA_EARLY_COMMIT_ACK
+    // outcome is already decided, so do not wait for servers
+    auxcommitasync(outcome, committs);
+    waitingts = Sc->CQ.takeWaitingTs(); // from earlier commits
+    res = 0;
+#else
     res = auxcommit(outcome, committs, &waitingts);
+#endif
     Timestamp::catchup(waitingts);
   } else res = 0;
 
@@ -1081,12 +1628,15 @@ int Transaction::writeSuperValue(COid coid, SuperValue *sv){
   // calculate space needed for cells
   len = 0;
   for (i=0; i < sv->Ncells; ++i){
-    if (sv->CellType == 0){ // int key
+    if (sv->CellType != 1){ // int key
       len += myVarintLen(sv->Cells[i].nKey);
       assert(sv->Cells[i].pKey==0);
     }
     else len += myVarintLen(sv->Cells[i].nKey) +
            (int) sv->Cells[i].nKey; // non-int key
+    if (sv->CellType == 2) // inline row
+      len += myVarintLen(sv->Cells[i].nData) + sv->Cells[i].nData;
+    else assert(sv->Cells[i].pData==0);
     len += sizeof(u64); // space for 64-bit value in cell
   }
   // fill celloids
@@ -1098,11 +1648,18 @@ int Transaction::writeSuperValue(COid coid, SuperValue *sv){
   ptr = cells;
   for (i=0; i < sv->Ncells; ++i){
     ptr += myPutVarint((unsigned char*)ptr, sv->Cells[i].nKey);
-    if (sv->CellType == 0) ; // int key, do nothing
+    if (sv->CellType != 1) ; // int key, do nothing
     else { // non-int key, copy content in pKey
       memcpy(ptr, sv->Cells[i].pKey, (int) sv->Cells[i].nKey);
       ptr += (int) sv->Cells[i].nKey;
     }
+    if (sv->CellType == 2){ // inline row
+      ptr += myPutVarint((unsigned char*)ptr, sv->Cells[i].nData);
+      if (sv->Cells[i].nData){
+        memcpy(ptr, sv->Cells[i].pData, sv->Cells[i].nData);
+        ptr += sv->Cells[i].nData;
+      }
+    }
     // copy childOid
     memcpy(ptr, &sv->Cells[i].value, sizeof(u64));
     ptr += sizeof(u64);
@@ -1156,9 +1713,11 @@ int Transaction::listAdd(COid coid, ListCell *cell, Ptr<RcKeyInfo> prki,
       assert(!txCache.hasPendingOps(coid));
       //applyPendingOps(coid, vbuf);
       if (vbuf->u.raw->Ncells >= 1){
-	int matches;
-	myCellSearchNode(vbuf, cell->nKey, cell->pKey, 0, prki, &matches);
-	if (matches) return 0; // found, nothing to do
+	int matches=0, index;
+	index = myCellSearchNode(vbuf, cell->nKey, cell->pKey, 0, prki,
+                                 &matches);
+	if (matches && ListCell::samePayload(vbuf->u.raw->Cells[index], *cell))
+          return 0; // found, nothing to do
       }
       // data in txcache, but key not present, so continue to ask server to
       // listadd it
@@ -1318,8 +1877,18 @@ int Transaction::listDelRange(COid coid, u8 intervalType, ListCell *cell1,
   return respstatus;
 }
   
-// adds a cell to a supervalue
+// sets an attribute of a supervalue
 int Transaction::attrSet(COid coid, u32 attrid, u64 attrvalue){
+  return auxattrop(coid, attrid, attrvalue, false);
+}
+
+// adds delta to an attribute of a supervalue
+int Transaction::attrAdd(COid coid, u32 attrid, u64 delta){
+  return auxattrop(coid, attrid, delta, true);
+}
+
+// sets an attribute (add==false) or adds attrvalue to it (add==true)
+int Transaction::auxattrop(COid coid, u32 attrid, u64 attrvalue, bool add){
   IPPortServerno server;
   AttrSetRPCData *rpcdata;
   AttrSetRPCRespData rpcresp;
@@ -1351,7 +1920,7 @@ int Transaction::attrSet(COid coid, u32 attrid, u64 attrvalue){
   rpcdata->data->attrid = attrid;  
   rpcdata->data->attrvalue = attrvalue; 
 
-  resp = Sc->Rpcc->syncRPC(server.ipport, ATTRSET_RPCNO,
+  resp = Sc->Rpcc->syncRPC(server.ipport, add ? ATTRADD_RPCNO : ATTRSET_RPCNO,
                            FLAG_HID(TID_TO_RPCHASHID(Id)), rpcdata);
 
   if (!resp){ // error contacting server
@@ -1367,7 +1936,7 @@ int Transaction::attrSet(COid coid, u32 attrid, u64 attrvalue){
   else {
     PendingOpsEntry *poe;
     poe = new PendingOpsEntry;
-    poe->type = 2; // attrset
+    poe->type = add ? 3 : 2; // attradd or attrset
     poe->level = currlevel;
     poe->u.attrset.attrid = attrid;
     poe->u.attrset.attrvalue = attrvalue;
@@ -35,6 +35,7 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "options.h"
 #include "tmalloc.h"
@@ -47,6 +48,13 @@
 #include "kvinterface.h"
 
 Tlocal SimplePrng *RndServerPrng=0;
+Tlocal u32 PlaceLastServerid = 0; // serverid of last node placed
+Tlocal int PlaceRun = 0;          // # of nodes in a row placed there
+Tlocal u32 *PlaceCount = 0;       // # of nodes placed on each server
+Tlocal u32 PlaceTotal = 0;        // # of nodes placed on all servers
+Tlocal int PlaceNservers = 0;     // # of entries in PlaceCount
+
+extern StorageConfig *SC;
 Tlocal u64 MyOidIssuerId = 0;
 Tlocal u32 MyOidCounter = 0; // next available counter
 
@@ -129,6 +137,52 @@ void setRandomServerid(u64 *oid){
   *oid |= serverid; // set lower 32 bits to random serverid
 }
 
+// change oid to have the serverid of neighbor, so that nodes next to each
+// other in a tree are on the same server. Picks a random serverid instead if
+// this thread already placed DTREE_LOCAL_PLACEMENT_MAXRUN nodes in a row on
+// that server, or if that server got too many of the nodes placed by this
+// thread (see DTREE_LOCAL_PLACEMENT_MAXLOAD)
+void setNeighborServerid(u64 *oid, u64 neighbor){
+  u32 serverid = (u32) neighbor & 0xffff;
+  bool capped;
+  assert(oid);
+
+  if (!PlaceCount && SC && SC->CS && SC->CS->Nservers > 0){
+    PlaceNservers = SC->CS->Nservers;
+    PlaceCount = new u32[PlaceNservers];
+    memset(PlaceCount, 0, PlaceNservers * sizeof(u32));
+  }
+
+  capped = serverid == PlaceLastServerid &&
+    PlaceRun >= DTREE_LOCAL_PLACEMENT_MAXRUN;
+  if (PlaceCount){
+    u32 count = PlaceCount[serverid % PlaceNservers];
+    // small counts are always fine, so that runs can start
+    if (count >= DTREE_LOCAL_PLACEMENT_MAXRUN &&
+        (u64) count * 100 * PlaceNservers >
+        (u64) PlaceTotal * DTREE_LOCAL_PLACEMENT_MAXLOAD)
+      capped = true;
+  }
+
+  if (capped) setRandomServerid(oid);
+  else {
+    *oid &= ~0xffffLL; // clear lower 16 bits
+    *oid |= serverid;
+  }
+
+  // account for placed node
+  serverid = (u32) *oid & 0xffff;
+  if (serverid == PlaceLastServerid) ++PlaceRun;
+  else {
+    PlaceLastServerid = serverid;
+    PlaceRun = 1;
+  }
+  if (PlaceCount){
+    ++PlaceCount[serverid % PlaceNservers];
+    ++PlaceTotal;
+  }
+}
+
 // constructs oid from its components
 void setOid(u64 *oid, u64 issuerid, u64 counter, u64 serverid){
   assert((issuerid & ~0xffffffffLL)==0); // only low 32 bits should be set
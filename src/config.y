@@ -21,7 +21,7 @@ ConfigState *parser_cs;
 }
 
 %token <ival> T_INT
-%token <ival> T_NSERVERS T_STRIPE_METHOD T_STRIPE_PARM T_SERVER T_HOST T_PORT T_LOGFILE T_STOREDIR T_BEGIN T_END T_PREFER_IP T_PREFER_IP_MASK
+%token <ival> T_NSERVERS T_STRIPE_METHOD T_STRIPE_PARM T_SERVER T_HOST T_PORT T_LOGFILE T_STOREDIR T_BEGIN T_END T_PREFER_IP T_PREFER_IP_MASK T_REPLICA
 %token <dval> T_FLOAT
 %token <sval> T_STR
 
@@ -39,17 +39,20 @@ specitem	:	T_PREFER_IP T_STR { parser_cs->setPreferredIP($2); }
 		|	T_STRIPE_PARM T_INT { parser_cs->setStripeParm($2); }
 		|	T_SERVER T_INT T_HOST T_STR T_PORT T_INT { parser_cs->addServer($2,$4,$6, parser_cs->PreferredIP, parser_cs->PreferredIPMask); }
 		|	T_SERVER T_INT T_HOST T_STR { parser_cs->addServer($2,$4,0, parser_cs->PreferredIP, parser_cs->PreferredIPMask); }
+		|	T_REPLICA T_INT T_HOST T_STR T_PORT T_INT { parser_cs->addReplica($2,$4,$6, parser_cs->PreferredIP, parser_cs->PreferredIPMask); }
 		|	host { parser_cs->addHost(currhost); }
 		
 		;
 
 host		:	T_HOST T_STR { currhost = new HostConfig();
 				       currhost->hostname=$2;
-				       currhost->port=0; }
+				       currhost->port=0;
+				       currhost->nlogfiles=0; }
 			T_BEGIN hostbody T_END
 		|	T_HOST T_STR T_PORT T_INT { currhost = new HostConfig();
 						    currhost->hostname=$2;
-						    currhost->port=$4; }
+						    currhost->port=$4;
+						    currhost->nlogfiles=0; }
 			T_BEGIN hostbody T_END
 		;
 
@@ -57,7 +60,11 @@ hostbody	:	/* empty */
 		|	hostbody hitem
 		;
 
-hitem		:	T_LOGFILE T_STR { currhost->logfile = $2; }
+hitem		:	T_LOGFILE T_STR { if (currhost->nlogfiles == 0)
+						    currhost->logfile = $2;
+					  if (currhost->nlogfiles < MAX_LOGFILES)
+					    currhost->logfiles[currhost->nlogfiles++] = $2;
+					  else yyerror("too many logfiles"); }
 		|	T_STOREDIR T_STR { currhost->storedir = $2; }
 		;
 
@@ -65,6 +65,7 @@ void DiskLog::BufFlush(void){}
 
 DiskLog::DiskLog(const char *logname){}
 DiskLog::~DiskLog(){}
+void DiskLog::addStripe(const char *logname){}
 void DiskLog::launch(void){}
 int DiskLog::logUpdatesAndYesVote(Tid tid, Timestamp ts,
                            Ptr<PendingTxInfo> pti, void *notify){ return 0; }
@@ -59,19 +59,41 @@
 #include "pendingtx.h"
 #include "disklog.h"
 #include "diskstorage.h"
+#include "util.h"
+
+int DiskLog::checkRecord(char *buf, int len){
+  u32 crc, plen;
+  if (len < DISKLOG_RECORD_HEADER) return 0;
+  if (buf[16] != DISKLOG_RECORD_VERSION) return 0; // also catches zero fill
+  memcpy(&plen, buf+4, 4);
+  if (plen > (u32)(len - DISKLOG_RECORD_HEADER)) return 0; // torn record
+  memcpy(&crc, buf, 4);
+  if (crc != crc32c(0, buf+4, DISKLOG_RECORD_HEADER-4+plen)) return 0;
+  return DISKLOG_RECORD_HEADER + plen;
+}
 
 #ifdef SKIPLOG
 DiskLog::DiskLog(const char *logname){
-  RawWritebuf = Writebuf = 0;
+  RawWritebufs[0] = RawWritebufs[1] = Writebufs[0] = Writebufs[1] = 0;
+  CurWritebuf = 0;
+  Writebuf = 0;
   WritebufSize = WritebufLeft = 0;
   WritebufPtr = 0;
   FileOffset = 0;
   WriteQueueHead = WriteQueueTail = 0;
+  BatchHead = BatchTail = 0;
   diskLogThreadNo = -1;
+  syncThreadNo = -1;
+  Stripe = 0;
+  NextStripe = 0;
+  RecBuf = 0;
+  RecBufSize = RecLen = 0;
+  NextLsn = 0;
 }
 
 DiskLog::~DiskLog(){
 }
+void DiskLog::addStripe(const char *logname){}
 void DiskLog::writeWqi(WriteQueueItem *wqi){}
 void DiskLog::logCommitAsync(Tid tid, Timestamp ts){}
 void DiskLog::logAbortAsync(Tid tid, Timestamp ts){}
@@ -87,8 +109,8 @@ void DiskLog::test(int niter){}
 
 // auxilliary function called by logCommitAsync and logAbortAsync
 static void logAsync(LogEntry *le);
-// sends a write request to the PROGShipDiskReqs task
-static void SendDiskLog(WriteQueueItem *wqi);
+// sends a write request to the PROGShipDiskReqs task of the stripe of tid
+static void SendDiskLog(WriteQueueItem *wqi, Tid &tid);
 // immediate function to enqueue a disk request for the PROGShipDiskReqs task
 static void ImmediateFuncEnqueueDiskReq(TaskMsgData &msgdata,
                                         TaskScheduler *ts, int srcthread);
@@ -109,22 +131,29 @@ DiskLog::DiskLog(const char *logname){
   *lastptr = 0;
 
 #ifdef DISKLOG_SIMPLE
-  RawWritebuf = Writebuf = 0;
+  RawWritebufs[0] = RawWritebufs[1] = Writebufs[0] = Writebufs[1] = 0;
   WritebufSize = WritebufLeft = 0;
 #else
-  // allocate writebuf
-  RawWritebuf = new char[WRITEBUFSIZE+ALIGNBUFSIZE-1];
-  if ((unsigned)(long long)RawWritebuf & (ALIGNBUFSIZE-1)){ // does not align
-    Writebuf = RawWritebuf + (ALIGNBUFSIZE - ((unsigned)(long long)
-                                              RawWritebuf & (ALIGNBUFSIZE-1)));
-  } else Writebuf = RawWritebuf;
-  assert(((unsigned)(long long)Writebuf & (ALIGNBUFSIZE-1))==0 &&
-         Writebuf >= RawWritebuf);
-  WritebufSize = ALIGNLEN((int)(RawWritebuf + WRITEBUFSIZE + ALIGNBUFSIZE-1 -
-                                Writebuf));
+  int i;
+  char *raw, *aligned;
+  // allocate writebufs
+  WritebufSize = ALIGNLEN(WRITEBUFSIZE);
   assert(WritebufSize >=ALIGNBUFSIZE);
+  for (i=0; i < 2; ++i){
+    raw = new char[WritebufSize+ALIGNBUFSIZE-1];
+    if ((unsigned)(long long)raw & (ALIGNBUFSIZE-1)){ // does not align
+      aligned = raw + (ALIGNBUFSIZE - ((unsigned)(long long)
+                                       raw & (ALIGNBUFSIZE-1)));
+    } else aligned = raw;
+    assert(((unsigned)(long long)aligned & (ALIGNBUFSIZE-1))==0 &&
+           aligned >= raw);
+    RawWritebufs[i] = raw;
+    Writebufs[i] = aligned;
+  }
   WritebufLeft = WritebufSize;
 #endif
+  CurWritebuf = 0;
+  Writebuf = Writebufs[0];
 
   WritebufPtr = Writebuf;
   FileOffset = 0;
@@ -133,6 +162,21 @@ DiskLog::DiskLog(const char *logname){
   WriteQueueHead = WriteQueueTail = new WriteQueueItem;
   memset(WriteQueueHead, 0, sizeof(WriteQueueItem));
   WriteQueueHead->next = 0;
+  BatchHead = BatchTail = 0;
+
+  SyncBuf = 0;
+  SyncLen = 0;
+  SyncOffset = 0;
+  SyncItems = 0;
+  SyncBusy = 0;
+  SyncDoneFlag = 0;
+  SyncExit = 0;
+  NotifyTask = 0;
+
+  RecBufSize = 4096; // grows as needed
+  RecBuf = new char[RecBufSize];
+  RecLen = 0;
+  NextLsn = 0;
 
   // create path up to filename
   DiskStorage::Makepath(str);
@@ -148,6 +192,9 @@ DiskLog::DiskLog(const char *logname){
   }
 
   diskLogThreadNo = -1;
+  syncThreadNo = -1;
+  Stripe = 0;
+  NextStripe = 0;
   
   delete [] str;
 }
@@ -160,8 +207,75 @@ DiskLog::~DiskLog(){
     tgetTaskScheduler()->sendMessage(msg);
     SLauncher->waitThread(diskLogThreadNo);
   }
+  if (syncThreadNo != -1){
+    reapSync(true);
+    SyncExit = 1;
+    SyncSubmit.signal();
+    SLauncher->waitThread(syncThreadNo);
+  }
+  if (NextStripe) delete NextStripe;
   if (f >= 0) close(f);
-  if (RawWritebuf) delete [] RawWritebuf;
+  if (RawWritebufs[0]) delete [] RawWritebufs[0];
+  if (RawWritebufs[1]) delete [] RawWritebufs[1];
+  if (RecBuf) delete [] RecBuf;
+}
+
+// auxilliary functions to encode a log record in RecBuf
+
+void DiskLog::recStart(void){
+  RecLen = DISKLOG_RECORD_HEADER; // leave space for header
+}
+
+void DiskLog::recPut(const void *buf, int len){
+  if (RecLen + len > RecBufSize){ // grow buffer
+    int newsize = RecBufSize;
+    char *newbuf;
+    while (RecLen + len > newsize) newsize *= 2;
+    newbuf = new char[newsize];
+    memcpy(newbuf, RecBuf, RecLen);
+    delete [] RecBuf;
+    RecBuf = newbuf;
+    RecBufSize = newsize;
+  }
+  memcpy(RecBuf + RecLen, buf, len);
+  RecLen += len;
+}
+
+void DiskLog::recPutVarint(u64 v){
+  u8 buf[10];
+  int len = 0;
+  while (v >= 0x80){
+    buf[len++] = (u8)(v | 0x80);
+    v >>= 7;
+  }
+  buf[len++] = (u8) v;
+  recPut(buf, len);
+}
+
+// encodes a cell: nKey (zigzag), celltype, then the key (celltype 1) or
+// the inline row (celltype 2), then the value
+void DiskLog::recPutCell(ListCell *cell, int celltype){
+  recPutVarint(((u64)cell->nKey << 1) ^ (u64)(cell->nKey >> 63));
+  recPutVarint(celltype);
+  if (celltype == 1) recPut(cell->pKey, (int) cell->nKey);
+  else if (celltype == 2){ // inline row
+    recPutVarint(cell->nData);
+    recPut(cell->pData, cell->nData);
+  }
+  recPutVarint(cell->value);
+}
+
+void DiskLog::recEnd(int type){
+  u32 len = RecLen - DISKLOG_RECORD_HEADER;
+  u32 crc;
+  memcpy(RecBuf+4, &len, 4);
+  memcpy(RecBuf+8, &NextLsn, 8);
+  RecBuf[16] = DISKLOG_RECORD_VERSION;
+  RecBuf[17] = (char) type;
+  crc = crc32c(0, RecBuf+4, RecLen-4);
+  memcpy(RecBuf, &crc, 4);
+  ++NextLsn;
+  BufWrite(RecBuf, RecLen);
 }
 
 // auxilliary function for disklog write to log a WriteQueueItem
@@ -170,106 +284,91 @@ void DiskLog::writeWqi(WriteQueueItem *wqi){
   int type;
   int celltype;
 
-  if (wqi->utype == 0){
-    BufWrite(wqi->u.buf.buf, wqi->u.buf.len);
+  recStart();
+  if (wqi->utype == 0){ // commit or abort
+    LogEntry *le = (LogEntry*) wqi->u.buf.buf;
+    assert(wqi->u.buf.len == sizeof(LogEntry));
+    recPut(&le->tid, sizeof(Tid));
+    recPut(&le->ts, sizeof(Timestamp));
+    recEnd(le->let);
   } else { // wqi->utype == 1
-
-    MultiWriteLogEntry mwle;
-    //MultiWriteLogSubEntry mwlse;
-    //list<TxWriteItem *> *writeSet = wqi->u.writes.writeSet;
     Ptr<PendingTxInfo> pti = wqi->u.updates.pti;
 
-    // write header
-    mwle.let = LEMultiWrite;
-    mwle.tid = wqi->u.updates.tid;
-    mwle.ts = wqi->u.updates.ts;
-    mwle.ncoids = pti->coidinfo.getNitems();
-    BufWrite((char*) &mwle, sizeof(MultiWriteLogEntry));
+    // header of payload
+    recPut(&wqi->u.updates.tid, sizeof(Tid));
+    recPut(&wqi->u.updates.ts, sizeof(Timestamp));
+    recPutVarint(pti->coidinfo.getNitems());
 
     // iterator over all objects
-    SkipListNode<COid, Ptr<TxUpdateCoid> > *it;
+    SkipListNode<COid, Ptr<TxRawCoid> > *it;
     for (it = pti->coidinfo.getFirst(); it != pti->coidinfo.getLast();
          it = pti->coidinfo.getNext(it)){
-      Ptr<TxUpdateCoid> tucoid = it->value;
+      Ptr<TxUpdateCoid> tucoid = it->value->getTucoid(it->key);
       if (tucoid->Writevalue) type = 1;
       else if (tucoid->WriteSV) type = 2;
       else type = 0;
-      BufWrite((char*) &type, sizeof(int));
+      recPutVarint(it->key.cid);
+      recPutVarint(it->key.oid);
+      recPutVarint(type);
 
       if (type == 0){ // write a delta record
-        int len;
-        BufWrite((char*)tucoid->SetAttrs, GAIA_MAX_ATTRS);
-        BufWrite((char*)tucoid->Attrs, sizeof(u64)*GAIA_MAX_ATTRS);
-        len = (int) tucoid->Litems.getNitems(); // number of items
-        BufWrite((char*)&len, sizeof(int));
+        int i, nattrs;
+        // attributes: number of set attributes then (index,value) pairs,
+        // where index is 2*i for a set and 2*i+1 for an add of value to
+        // attribute i
+        for (i = nattrs = 0; i < GAIA_MAX_ATTRS; ++i)
+          if (tucoid->SetAttrs[i]) ++nattrs;
+        recPutVarint(nattrs);
+        for (i = 0; i < GAIA_MAX_ATTRS; ++i){
+          if (tucoid->SetAttrs[i]){
+            recPutVarint(2*i + (tucoid->SetAttrs[i] == 2 ? 1 : 0));
+            recPutVarint(tucoid->Attrs[i]);
+          }
+        }
+        recPutVarint(tucoid->Litems.getNitems()); // number of items
         // for each item
         for (TxListItem *tli = tucoid->Litems.getFirst();
              tli != tucoid->Litems.getLast();
              tli = tucoid->Litems.getNext(tli)){
-          BufWrite((char*)&tli->type, sizeof(int));
+          recPutVarint(tli->type);
           if (tli->type == 0){
             TxListAddItem *tlai = dynamic_cast<TxListAddItem*>(tli);
-            // item
-            BufWrite((char*)&tlai->item.nKey, sizeof(int));
-            if (!tlai->item.pKey) celltype=0; // int key
+            if (!tlai->item.pKey) // int key, maybe with inline row
+              celltype = tlai->item.pData ? 2 : 0;
             else celltype=1;
-            BufWrite((char*)&celltype, sizeof(int));
-            if (celltype) BufWrite((char*)tlai->item.pKey,
-                                   (int) tlai->item.nKey);
-            BufWrite((char*) &tlai->item.value, sizeof(u64));
+            recPutCell(&tlai->item, celltype);
           } else { // tli->type == 1
             TxListDelRangeItem *tldri = dynamic_cast<TxListDelRangeItem*>(tli);
-            BufWrite((char*) &tldri->intervalType, 1);
-            // itemstart
-            BufWrite((char*) &tldri->itemstart.nKey, sizeof(int));
-            if (!tldri->itemstart.pKey) celltype=0; // int key
-            else celltype = 1;
-            BufWrite((char*) &celltype, sizeof(int));
-            if (celltype) BufWrite((char*)tldri->itemstart.pKey,
-                                   (int)tldri->itemstart.nKey);
-            BufWrite((char*) &tldri->itemstart.value, sizeof(u64));
-            // itemend
-            BufWrite((char*) &tldri->itemend.nKey, sizeof(int));
-            if (!tldri->itemend.pKey) celltype=0; // int key
-            else celltype = 1;
-            BufWrite((char*) &celltype, sizeof(int));
-            if (celltype) BufWrite((char*)tldri->itemend.pKey,
-                                   (int)tldri->itemend.nKey);
-            BufWrite((char*) &tldri->itemend.value, sizeof(u64));
+            recPut(&tldri->intervalType, 1);
+            recPutCell(&tldri->itemstart, tldri->itemstart.pKey ? 1 : 0);
+            recPutCell(&tldri->itemend, tldri->itemend.pKey ? 1 : 0);
           }
         }
       } else if (type == 1){ // write a value record
         TxWriteItem *twi = tucoid->Writevalue;
-        BufWrite((char*) &twi->len, sizeof(int));
-        BufWrite((char*)twi->buf, twi->len);
+        recPutVarint(twi->len);
+        recPut(twi->buf, twi->len);
       } else { // type == 2
-	int nitems;
+        int i;
         // write a supervalue record
         TxWriteSVItem *twsvi = tucoid->WriteSV;
-        BufWrite((char*)twsvi, offsetof(TxWriteSVItem, attrs)); // header
-        BufWrite((char*)twsvi->attrs, sizeof(u64) * twsvi->nattrs);
-	nitems = twsvi->cells.getNitems();
-        BufWrite((char*) &nitems, sizeof(int)); // number of cells
+        recPutVarint(twsvi->nattrs);
+        recPut(&twsvi->celltype, 1);
+        for (i = 0; i < twsvi->nattrs; ++i) recPutVarint(twsvi->attrs[i]);
+        recPutVarint(twsvi->cells.getNitems()); // number of cells
         // for each cell
         SkipListNodeBK<ListCellPlus,int> *ptr;
         for (ptr = twsvi->cells.getFirst(); ptr != twsvi->cells.getLast();
              ptr = twsvi->cells.getNext(ptr)){
           ListCellPlus *lc = ptr->key;
-          BufWrite((char*) &lc->nKey, sizeof(int));
-          if (!lc->pKey) celltype=0; // int key
+          if (!lc->pKey) celltype = lc->pData ? 2 : 0; // int key
           else celltype = 1;
-          BufWrite((char*) &celltype, sizeof(int));
-          if (celltype) BufWrite((char*)lc->pKey, (int)lc->nKey);
-          BufWrite((char*) &lc->value, sizeof(u64));
+          recPutCell(lc, celltype);
         }
       }
     }
-    // log a yes vote
-    LogEntry le;
-    le.let = LEVoteYes;
-    le.tid = wqi->u.updates.tid;
-    le.ts.setIllegal();
-    BufWrite((char*) &le, sizeof(LogEntry));
+    // the record also logs the yes vote
+    recEnd(LEMultiWrite);
   }
 }
 
@@ -286,7 +385,7 @@ void logAsync(LogEntry *le){
   wqi->u.buf.buf = buf;
   wqi->u.buf.len = len;
   wqi->notify = 0;
-  SendDiskLog(wqi);
+  SendDiskLog(wqi, le->tid);
 }
 
 void DiskLog::logCommitAsync(Tid tid, Timestamp ts){
@@ -313,7 +412,7 @@ int DiskLog::logUpdatesAndYesVote(Tid tid, Timestamp ts, Ptr<PendingTxInfo> pti,
   wqi->u.updates.ts = ts;
   wqi->u.updates.pti = pti;
   wqi->notify = notify;
-  SendDiskLog(wqi);
+  SendDiskLog(wqi, tid);
   if (notify) return 1; // indicate that log will be done in the background,
                         //with notification happening subsequently
   else return 0; // indicate that no notification will happen
@@ -333,46 +432,81 @@ void ImmediateFuncEnqueueDiskReq(TaskMsgData &msgdata, TaskScheduler *ts,
   ts->wakeUpTask(dltc->psdrtask); // wake up PROGShipDiskReqs task
 }
 
+// sends notifications for a list of items and frees them
+void DiskLog::notifyItems(WriteQueueItem *wqi){
+  WriteQueueItem *next;
+  for (; wqi != 0; wqi = next){
+    if (wqi->notify){
+      // send a message to wqi->notify
+      TaskMsg msg;
+      msg.dest = (TaskInfo*) wqi->notify;
+      msg.flags = 0;
+      memset(&msg.data, 0, sizeof(TaskMsgData));
+      msg.data.data[0] = 0xb0; // check byte only (message carries no
+                               // relevant data; it is just a signal)
+      tsendMessage(msg);
+    }
+    next = wqi->next;
+    delete wqi;
+  }
+}
+
+void DiskLog::addToBatch(WriteQueueItem *head, WriteQueueItem *tail){
+  if (!BatchHead) BatchHead = head;
+  else BatchTail->next = head;
+  BatchTail = tail;
+}
+
+// The disk log is pipelined: items are written to the current buffer while
+// the previous buffer is being written and synced by the sync thread. When
+// the sync completes, the sync thread wakes up this task, which notifies
+// the items of the synced batch and submits the current buffer, if it has
+// items. Thus, items arriving during a sync are grouped into the next batch.
 int DiskLog::PROGShipDiskReqs(TaskInfo *ti){
   DiskLogThreadContext *dltc = (DiskLogThreadContext*)
     tgetSharedSpace(THREADCONTEXT_SPACE_DISKLOG);
   DiskLog *dl = (DiskLog*) ti->getTaskData();
-  WriteQueueItem *wqi, *next;
+  WriteQueueItem *wqi;
+
+  dl->reapSync(false); // notify items of synced batch, if any
 
   if (dltc->ToShipHead->next){ // if ToShip not empty
     // write items
     for (wqi = dltc->ToShipHead->next; wqi != 0; wqi = wqi->next){
       dl->writeWqi(wqi);
     }
-    dl->BufFlush();
-
-    // send notifications
-    for (wqi = dltc->ToShipHead->next; wqi != 0; wqi = next){
-      if (wqi->notify){
-        // send a message to wqi->notify
-        TaskMsg msg;
-        msg.dest = (TaskInfo*) wqi->notify;
-        msg.flags = 0;
-        memset(&msg.data, 0, sizeof(TaskMsgData));
-        msg.data.data[0] = 0xb0; // check byte only (message carries no
-                                 // relevant data; it is just a signal)
-        tsendMessage(msg);
-      }
-      next = wqi->next;
-      delete wqi;
-    }
+    // items get notified when the buffer they ended in is synced
+    dl->addToBatch(dltc->ToShipHead->next, dltc->ToShipTail);
+
     // clear list
     dltc->ToShipHead->next = 0;
     dltc->ToShipTail = dltc->ToShipHead;
   }
 
+  // submit batch if sync thread is idle
+  if (dl->BatchHead && !dl->SyncBusy) dl->BufFlush();
+
   return SchedulerTaskStateWaiting;
 }
 
+void DiskLog::addStripe(const char *logname){
+  DiskLog *dl = this;
+  assert(diskLogThreadNo == -1); // not launched yet
+  while (dl->NextStripe) dl = dl->NextStripe;
+  dl->NextStripe = new DiskLog(logname);
+  dl->NextStripe->Stripe = dl->Stripe + 1;
+}
+
 void DiskLog::launch(void){
-  if (diskLogThreadNo == -1){ // not launched yet
-    diskLogThreadNo = SLauncher->createThread("DISKLOG", diskLogThread,
-                                              (void*) this, 0);
+  DiskLog *dl;
+  int nstripes = 0;
+  if (diskLogThreadNo != -1) return; // launched already
+  for (dl = this; dl; dl = dl->NextStripe) ++nstripes;
+  gContext.setNThreads(TCLASS_DISKLOG, nstripes);
+  for (dl = this; dl; dl = dl->NextStripe){
+    dl->diskLogThreadNo = SLauncher->createThread("DISKLOG", diskLogThread,
+                                                  (void*) dl, 0);
+    gContext.setThread(TCLASS_DISKLOG, dl->Stripe, dl->diskLogThreadNo);
   }
 }
 
@@ -392,8 +526,9 @@ void DiskLog::init(void){
   
   assert(threadContext);
   int threadno = tgetThreadNo();
-  gContext.setNThreads(TCLASS_DISKLOG, 1); 
-  gContext.setThread(TCLASS_DISKLOG, 0, threadno);
+  if (gContext.getNThreads(TCLASS_DISKLOG) == 0) // not called from launch()
+    gContext.setNThreads(TCLASS_DISKLOG, 1); 
+  gContext.setThread(TCLASS_DISKLOG, Stripe, threadno);
 
   // assign immediate functions and tasks
   ts->assignImmediateFunc(IMMEDIATEFUNC_ENQUEUEDISKREQ,
@@ -403,10 +538,18 @@ void DiskLog::init(void){
   ti = ts->createTask(PROGShipDiskReqs, this);
   dltc->psdrtask = ti;
   //ts->assignFixedTask(FIXED TASK NUMBER HERE, ti);
+
+#ifndef DISKLOG_SIMPLE
+  NotifyTask = ti;
+  if (syncThreadNo == -1)
+    syncThreadNo = SLauncher->createThread("DISKLOGSYNC", syncThread,
+                                           (void*) this, 0);
+#endif
 }
 
-void SendDiskLog(WriteQueueItem *wqi){
-  sendIFMsg(gContext.hashThread(TCLASS_DISKLOG, 0),
+void SendDiskLog(WriteQueueItem *wqi, Tid &tid){
+  int nstripes = gContext.getNThreads(TCLASS_DISKLOG);
+  sendIFMsg(gContext.getThread(TCLASS_DISKLOG, Tid::hash(tid) % nstripes),
             IMMEDIATEFUNC_ENQUEUEDISKREQ, (void*) &wqi,
             sizeof(WriteQueueItem*));
 }
@@ -427,16 +570,21 @@ void DiskLog::test(int niter){
     }
   }
   BufFlush();
+  reapSync(true);
 }
 
 
 #ifdef DISKLOG_SIMPLE
 // simple version without flushing to disk
 void DiskLog::auxwrite(char *buf, int buflen){}
+OSTHREAD_FUNC DiskLog::syncThread(void *parm){ return 0; }
+void DiskLog::reapSync(bool wait){}
 void DiskLog::BufFlush(){
 #ifndef DISKLOG_NOFSYNC
   int res = fdatasync(f); assert(res==0);
 #endif
+  notifyItems(BatchHead);
+  BatchHead = BatchTail = 0;
 }
 
 void DiskLog::BufWrite(char *buf, int len){
@@ -454,62 +602,100 @@ void DiskLog::BufWrite(char *buf, int len){
 }
 
 #else // ifdef DISKLOG_SIMPLE
-// version that uses queues to flush to disk synchronously
-
-// Writes buf to disk. Assumes buf is aligned and that it is
-// legal to read it and fill it with zeroes until buflen + the next align point.
-// This is true for Writebuf, and this function is currently used
-// only when buf == Writebuf.
-// The last block written, if partial, is copied to the beginning of the
-// Writebuf. WritebufLeft and WritebufPtr are set accordingly.
-// Also sets FileOffset and seeks file handle so that they
-// reflect the beginning of Writebuf.
-void DiskLog::auxwrite(char *buf, int buflen){
-  unsigned long written;
-  int writelen;
+// version that uses two buffers: one is filled while the other is written
+// and synced to disk by the sync thread
 
-  // number of bytes to write, must be aligned, so move forward
-  writelen = ALIGNLEN(buflen + (ALIGNBUFSIZE-1));
-
-  assert(writelen >= buflen);
-
-  if (writelen != buflen) // zero-fill missing gap (gap until alignment point)
-    bzero(buf+buflen, writelen - buflen);
+// Writes buflen bytes of buf to the file at offset. Assumes buf is aligned
+// and buflen is a multiple of ALIGNBUFSIZE.
+void DiskLog::auxwrite(char *buf, int buflen){
+  long written;
+  u64 offset = SyncOffset;
 
-  // this loop writes writelen bytes starting at buf
-  while (writelen > 0){
-    written = write(f, buf, writelen);
+  // this loop writes buflen bytes starting at buf
+  while (buflen > 0){
+    written = pwrite(f, buf, buflen, offset);
     if (written < 0){
       printf("Disklog: write() error %d\n", errno);
       exit(1);
     }
-    writelen -= written;
+    buflen -= written;
     buf += written;
+    offset += written;
   }
 
 #ifndef DISKLOG_NOFSYNC
   int res = fdatasync(f); assert(res==0);
 #endif  
+}
 
-  char *lastblock = Writebuf+ALIGNLEN(buflen); //beginning of last block written
-  if (lastblock != Writebuf){
-    // move last block to beginning to Writebuf
-    memmove(Writebuf, lastblock, ALIGNMOD(buflen));
+// Thread that writes and syncs batches submitted by BufFlush
+OSTHREAD_FUNC DiskLog::syncThread(void *parm){
+  DiskLog *dl = (DiskLog*) parm;
+  while (1){
+    dl->SyncSubmit.wait(INFINITE);
+    if (dl->SyncExit) break;
+    dl->auxwrite(dl->SyncBuf, dl->SyncLen);
+    MemBarrier();
+    dl->SyncDoneFlag = 1;
+    dl->SyncDone.signal();
+    if (dl->NotifyTask) tsendWakeup(dl->NotifyTask);
   }
+  return 0;
+}
+
+// If the submitted batch has been synced, notifies its items. If wait is
+// set, first waits for the batch to be synced.
+void DiskLog::reapSync(bool wait){
+  if (!SyncBusy) return;
+  if (!wait && !SyncDoneFlag) return;
+  SyncDone.wait(INFINITE);
+  SyncDoneFlag = 0;
+  SyncBusy = 0;
+  notifyItems(SyncItems);
+  SyncItems = 0;
+}
+
+// Submits Writebuf to the sync thread and switches to the other buffer,
+// waiting for the previous submission to complete if needed. The last block
+// of Writebuf, if partial, is copied to the beginning of the other buffer,
+// so it is written again with more data in the next batch. WritebufLeft,
+// WritebufPtr, and FileOffset are set accordingly.
+void DiskLog::BufFlush(void){
+  int buflen, writelen;
+  char *next;
+
+  reapSync(true);
 
-  // adjust WritebufLeft and WritebufPtr
+  buflen = WritebufSize - WritebufLeft;
+  // number of bytes to write, must be aligned, so move forward
+  writelen = ALIGNLEN(buflen + (ALIGNBUFSIZE-1));
+  assert(writelen >= buflen);
+  if (writelen != buflen) // zero-fill missing gap (gap until alignment point)
+    bzero(Writebuf+buflen, writelen - buflen);
+
+  // move last block to beginning of other buffer
+  next = Writebufs[1-CurWritebuf];
+  if (ALIGNMOD(buflen))
+    memcpy(next, Writebuf+ALIGNLEN(buflen), ALIGNMOD(buflen));
+
+  // hand buffer to sync thread
+  SyncBuf = Writebuf;
+  SyncLen = writelen;
+  SyncOffset = FileOffset;
+  SyncItems = BatchHead;
+  BatchHead = BatchTail = 0;
+  SyncBusy = 1;
+  SyncSubmit.signal();
+
+  // switch buffers
+  CurWritebuf = 1-CurWritebuf;
+  Writebuf = next;
   WritebufPtr = Writebuf + ALIGNMOD(buflen);
   WritebufLeft = WritebufSize - ALIGNMOD(buflen);
 
   // adjust file offset
   FileOffset = FileOffset+ALIGNLEN(buflen); // offset at the beginning of buffer
   assert(FileOffset == ALIGNLEN(FileOffset));
-  lseek(f, FileOffset, 0);
-}
-
-void DiskLog::BufFlush(void){
-  auxwrite(Writebuf, WritebufSize - WritebufLeft);
-  assert(WritebufLeft == Writebuf + WritebufSize - WritebufPtr);
 }
 
 void DiskLog::BufWrite(char *buf, int len){
@@ -41,6 +41,8 @@
 
 #define _DTREE_C
 
+#include <algorithm>
+
 #include "os.h"
 #include "gaiarpcaux.h"
 #include "dtreeaux.h"
@@ -63,7 +65,20 @@ static int DtCreateTable(KVTransaction *tx, u64 dbid, bool allocateiTable,
                          Pgno *piTable, int createTabFlags);
 int DtReadData(BtCursor *pCur);
 int DtWriteData(BtCursor *pCur, u64 nkey, char *pdata, int ndata);
+static bool DtMayHaveInlineRows(BtCursor *pCur);
 static int saveAllCursors(BtShared *pBt, u64 cidTable, BtCursor *pExcept);
+static int DtBulkInsert(BtCursor *pCur, const void *pKey, i64 nKey,
+                        const void *pData, int nData);
+static int DtBulkFinish(BtCursor *pCur);
+static void DtScanPrefetchStart(BtCursor *pCur);
+static int DtScanPrefetchNext(BtCursor *pCur, Oid leafoid, DTreeNode &node);
+static int DtScanPrefetchRow(BtCursor *pCur);
+static void DtScanPrefetchEnd(BtCursor *pCur);
+static int DtRowPrefetchRow(BtCursor *pCur, i64 nKey);
+static int DtRowPrefetchLeaf(BtCursor *pCur, Oid oid, DTreeNode &node);
+static void DtRowPrefetchEnd(BtCursor *pCur);
+static void DtRowPrefetchEndTable(BtShared *pBt, u64 cidTable);
+void DtFreeCursorFields(BtCursor *pCur);
 static Pgno btreePagecount(BtShared *pBt);
 #ifdef SQLITE_DEBUG
 static int cursorHoldsMutex(BtCursor *p);
@@ -350,6 +365,12 @@ static int DtCreateTable(KVTransaction *tx, u64 dbid, bool allocateiTable,
   COid coid, coidfirst;
   int res;
   SuperValue rootNode, firstNode;
+  u8 celltype = (createTabFlags == BTREE_INTKEY) ? 0 : 1;
+
+#ifdef DTREE_INLINE_ROW_MAX
+  if (celltype == 0 && !isDBIdEphemeral(dbid))
+    celltype = 2; // keep small rows inline in leaf cells
+#endif
 
   if (allocateiTable){
     *piTable = findFreeiTable(dbid, createTabFlags == BTREE_TRANSIENT);
@@ -363,8 +384,7 @@ static int DtCreateTable(KVTransaction *tx, u64 dbid, bool allocateiTable,
   coidfirst.cid = coid.cid;
   setOid(&coidfirst.oid, 0, 2, 0);   // pick issuerid 0 and counter 2
   setRandomServerid(&coidfirst.oid); // pick random serverid for first node
-  DTreeNode::InitSuperValue(&firstNode,
-                            (createTabFlags == BTREE_INTKEY) ? 0 : 1);
+  DTreeNode::InitSuperValue(&firstNode, celltype);
   firstNode.Attrs[DTREENODE_ATTRIB_FLAGS] = DTREENODE_FLAG_LEAF
     | ((createTabFlags == BTREE_INTKEY) ? DTREENODE_FLAG_INTKEY : 0);
   firstNode.Attrs[DTREENODE_ATTRIB_HEIGHT] = 0;
@@ -375,8 +395,7 @@ static int DtCreateTable(KVTransaction *tx, u64 dbid, bool allocateiTable,
   if (res) return SQLITE_IOERR;
 #endif
 
-  DTreeNode::InitSuperValue(&rootNode,
-                            (createTabFlags == BTREE_INTKEY) ? 0 : 1);
+  DTreeNode::InitSuperValue(&rootNode, celltype);
 #ifndef DTREE_NOFIRSTNODE
   rootNode.Attrs[DTREENODE_ATTRIB_FLAGS] =
     ((createTabFlags == BTREE_INTKEY) ? DTREENODE_FLAG_INTKEY : 0);
@@ -766,6 +785,75 @@ int DtRefreshCursor(BtCursor *pCur, ListCell *cellguide, Oid targetoid){
   return levelsought;
 }
 
+// Whether rows of the cursor's table may be inline in leaf cells, in which
+// case a row need not have a data object. This is known from the cached root
+// node; if the root is not cached, the answer is conservatively yes.
+static bool DtMayHaveInlineRows(BtCursor *pCur){
+  DTreeNode root;
+  COid coid;
+  if (!pCur->intKey || isDBIdEphemeral(pCur->pBt->KVdbid)) return false;
+  coid.cid = pCur->rootCid;
+  coid.oid = DTREE_ROOT_OID;
+  if (auxReadCache(coid, root)) return true; // root not cached
+  return root.hasInlineRows();
+}
+
+// Whether a row of length nData should be inline in its leaf cell, given any
+// node of the row's tree
+static bool DtInlineRow(DTreeNode &node, int nData){
+#ifdef DTREE_INLINE_ROW_MAX
+  return node.raw.isset() && node.hasInlineRows() &&
+    0 < nData && nData <= DTREE_INLINE_ROW_MAX;
+#else
+  return false;
+#endif
+}
+
+// Returns the row in a leaf cell as a buffer in the format of data objects
+static Ptr<Valbuf> DtInlineRowBuf(COid coid, DTreeNode &leaf, ListCell *cell){
+  Valbuf *vb = new Valbuf;
+  DataHeader dh;
+  strcpy((char*) &dh.dummy, "DAT");
+
+  vb->type = 0;
+  vb->coid = coid;
+  vb->immutable = true;
+  vb->commitTs = leaf.raw->commitTs;
+  vb->readTs = leaf.raw->readTs;
+  vb->len = sizeof(DataHeader) + cell->nData;
+  // allocated as by Transaction::allocReadBuf, since Valbuf frees it that way
+  vb->u.buf = ReadRPCRespData::clientAllocReceiveBuffer(vb->len);
+  memcpy(vb->u.buf, &dh, sizeof(DataHeader));
+  memcpy(vb->u.buf + sizeof(DataHeader), cell->pData, cell->nData);
+  Ptr<Valbuf> buf = vb;
+  return buf;
+}
+
+// Replaces the cell of key nkey in the leaf at the cursor, with the row inline
+// in the cell if pdata != 0, or without a row otherwise
+static int DtReplaceLeafCell(BtCursor *pCur, i64 nkey, char *pdata,
+                             int ndata){
+  COid coid;
+  ListCell cell;
+
+  coid.cid = pCur->rootCid;
+  coid.oid = pCur->node[pCur->levelLeaf].NodeOid();
+  cell.nKey = nkey;
+  cell.pKey = 0;
+  cell.value = 0xabcdabcdabcdabcd; // not used
+  if (pdata){
+    cell.pData = pdata;
+    cell.nData = ndata;
+  }
+#if DTREE_SPLIT_LOCATION != 1
+  return KVlistadd(pCur->pBtree->tx, coid, &cell,
+                   (RcKeyInfo*) pCur->pKeyInfo, 0);
+#else
+  return KVlistadd(pCur->pBtree->tx, coid, &cell,
+                   (RcKeyInfo*) pCur->pKeyInfo, 0, 0, 0);
+#endif
+}
+
 /*
 ** Reads the data of a tree node at the cursor.
 ** Requires the cursor to be valid and of type intKey
@@ -781,9 +869,20 @@ int DtReadData(BtCursor *pCur){
   else { // pCur->eState == CURSOR_VALID
     int levelleaf = pCur->levelLeaf;
     int index = pCur->nodeIndex[levelleaf];
-    coid.oid = pCur->node[levelleaf].Cells()[index].nKey;
+    ListCell *cell = &pCur->node[levelleaf].Cells()[index];
+    coid.oid = cell->nKey;
+    if (cell->pData){ // row is inline in the cell
+      pCur->data = DtInlineRowBuf(coid, pCur->node[levelleaf], cell);
+      return 0;
+    }
   }
 
+  if (pCur->prefetch && pCur->eState == CURSOR_VALID &&
+      DtScanPrefetchRow(pCur)) // row was fetched ahead
+    return 0;
+  if (pCur->rowfetch && DtRowPrefetchRow(pCur, coid.oid)) // ditto
+    return 0;
+
   pCur->data=0;
   res = KVget(pCur->pBtree->tx, coid, pCur->data);
   return res;
@@ -813,6 +912,12 @@ int DtMovetoDirect(BtCursor *pCur, UnpackedRecord *pIdxKey, i64 intKey,
   int res;
   assert(pIdxKey==0);
 
+  if (DtMayHaveInlineRows(pCur)){ // row may have no data object
+    pCur->eState = CURSOR_INVALID;
+    *pRes=-1;
+    return 0;
+  }
+
   // create a cell for key being sought
   pCur->directIntKey = intKey;
   pCur->eState = CURSOR_DIRECT;
@@ -828,6 +933,44 @@ int DtMovetoDirect(BtCursor *pCur, UnpackedRecord *pIdxKey, i64 intKey,
 
   return res;
 }
+
+// Reads in full the leaf at given level of the cursor's path, which has only
+// some of its cells (see DtMovetoUnpackedaux). Returns 0 if ok, != 0 if
+// problem.
+static int DtReadWholeLeaf(BtCursor *pCur, int level){
+  COid coid;
+  coid.cid = pCur->rootCid;
+  coid.oid = pCur->node[level].NodeOid();
+  return auxReadReal(pCur->pBtree->tx, coid, pCur->node[level], 0, 0);
+}
+
+// Called when the cursor is about to move past the cells of a leaf that has
+// only some of its cells. Reads the whole leaf and points the cursor to the
+// same entry in it. If that entry is not there, points the cursor to the
+// entry after it and sets *matches=0, otherwise sets *matches=1.
+// From then on, the cursor reads whole leaves, since it is scanning.
+static int DtMoveToWholeLeaf(BtCursor *pCur, int *matches){
+  int level = pCur->levelLeaf;
+  ListCell cell(pCur->node[level].Cells()[pCur->nodeIndex[level]]);
+  UnpackedRecord *pIdxKey;
+  char aSpace[150];
+  int res;
+
+  pCur->wholeLeaves = 1;
+  res = DtReadWholeLeaf(pCur, level);
+  if (res){ cell.Free(); return res; }
+  if (cell.pKey){
+    pIdxKey = sqlite3VdbeRecordUnpack(pCur->pKeyInfo, (int)cell.nKey,
+                                      cell.pKey, aSpace, sizeof(aSpace));
+    if (pIdxKey == 0){ cell.Free(); return SQLITE_NOMEM; }
+  } else pIdxKey = 0;
+  pCur->nodeIndex[level] = CellSearchNodeUnpacked(pCur->node[level], pIdxKey,
+                                                  cell.nKey, 0, matches);
+  if (pIdxKey) sqlite3VdbeDeleteUnpackedRecord(pIdxKey);
+  cell.Free();
+  return 0;
+}
+
 // Traverse the Dtree to find a given key.
 // First, traverse the local cache and see if it leads to the key.
 // Otherwise, start fetching nodes from TKVS as necessary to find the key.
@@ -840,6 +983,8 @@ int DtMovetoDirect(BtCursor *pCur, UnpackedRecord *pIdxKey, i64 intKey,
 //     *pRes>0      No entry matches key, and the cursor is left at entry
 //                  immediately after the key.
 // Sets pCur->levelLeaf
+// A read-only cursor asks for just the cells of the leaf around the key, so
+// the leaf in the path may have only some of its cells (see coversIndex()).
 int DtMovetoUnpackedaux(BtCursor *pCur, UnpackedRecord *pIdxKey, i64 nKey,
                         char *pKey, int biasRight, int *pRes, bool tryDirect){
   // highest level at which key belongs inside the node. This is the negation
@@ -856,6 +1001,11 @@ int DtMovetoUnpackedaux(BtCursor *pCur, UnpackedRecord *pIdxKey, i64 nKey,
   COid coid, coid2, prevcoid;
   ListCell cell;
   Ptr<RcKeyInfo> prki;
+#ifdef GAIA_POINT_READS
+  bool cellonly = !pCur->wrFlag && !pCur->wholeLeaves;
+#else
+  bool cellonly = false;
+#endif
 
   cell.nKey = nKey;
   cell.pKey = pKey;
@@ -893,6 +1043,7 @@ int DtMovetoUnpackedaux(BtCursor *pCur, UnpackedRecord *pIdxKey, i64 nKey,
     if (pCur->node[levelleaf].RightPtr() == 0    // last node in tree
     && pCur->nodeIndex[levelleaf] == pCur->node[levelleaf].Ncells()-1 // at last
                                                                       // cell
+    && pCur->node[levelleaf].coversIndex(pCur->nodeIndex[levelleaf]+1)
     && pCur->node[levelleaf].Cells()[pCur->nodeIndex[levelleaf]].nKey < nKey)
     {
       // cursor key is last and smaller than requested key */
@@ -914,8 +1065,13 @@ int DtMovetoUnpackedaux(BtCursor *pCur, UnpackedRecord *pIdxKey, i64 nKey,
   level = 0;
   coid.oid = DTREE_ROOT_OID; // start with root
   do {
-    res = auxReadCacheOrReal(pCur->pBtree->tx, coid, pCur->node[level], real,
-                             &cell, prki);
+    if (pCur->rowfetch &&
+        DtRowPrefetchLeaf(pCur, coid.oid, pCur->node[level])){
+      res = 0; // leaf was fetched ahead
+      real = 1;
+    }
+    else res = auxReadCacheOrReal(pCur->pBtree->tx, coid, pCur->node[level],
+                                  real, &cell, prki, cellonly);
     if (res == GAIAERR_WRONG_TYPE){  // not a supervalue
       //printf("Found unexpected non-supervalue\n");
       if (level == 0){
@@ -937,6 +1093,16 @@ int DtMovetoUnpackedaux(BtCursor *pCur, UnpackedRecord *pIdxKey, i64 nKey,
     pCur->nodetype[level] = real ? 1 : 0;
     index = CellSearchNodeUnpacked(pCur->node[level], pIdxKey, nKey,
                                    biasRight, &matches);
+    if (!matches && !pCur->node[level].coversIndex(index)){
+      // leaf has only some cells, and not those around the key
+      if (DtReadWholeLeaf(pCur, level)){
+        pCur->eState = CURSOR_INVALID;
+        DTREELOG("  return %d", SQLITE_IOERR);
+        return SQLITE_IOERR;
+      }
+      index = CellSearchNodeUnpacked(pCur->node[level], pIdxKey, nKey,
+                                     biasRight, &matches);
+    }
     pCur->nodeIndex[level] = index;
     if (matches || 0 < index && index < pCur->node[level].Ncells())
       highestNonExtremeLevel = level; // key belongs inside the node
@@ -1048,7 +1214,10 @@ int DtMovetoUnpackedaux(BtCursor *pCur, UnpackedRecord *pIdxKey, i64 nKey,
     ++level;
     assert(level < DTREE_MAX_LEVELS);
     // read child
-    res = auxReadReal(pCur->pBtree->tx, coid, pCur->node[level], &cell, prki);
+    if (pCur->rowfetch && DtRowPrefetchLeaf(pCur, coid.oid, pCur->node[level]))
+      res = 0; // leaf was fetched ahead
+    else res = auxReadReal(pCur->pBtree->tx, coid, pCur->node[level], &cell,
+                           prki, cellonly);
     if (res == GAIAERR_WRONG_TYPE)
       res = SQLITE_CORRUPT; // not a supervalue, so tree is corrupted
     if (res){
@@ -1060,6 +1229,16 @@ int DtMovetoUnpackedaux(BtCursor *pCur, UnpackedRecord *pIdxKey, i64 nKey,
     // search for key
     index = CellSearchNodeUnpacked(pCur->node[level], pIdxKey, nKey,
                                    biasRight, &matches);
+    if (!matches && !pCur->node[level].coversIndex(index)){
+      // leaf has only some cells, and not those around the key
+      if (DtReadWholeLeaf(pCur, level)){
+        pCur->eState = CURSOR_INVALID;
+        DTREELOG("  return %d", SQLITE_IOERR);
+        return SQLITE_IOERR;
+      }
+      index = CellSearchNodeUnpacked(pCur->node[level], pIdxKey, nKey,
+                                     biasRight, &matches);
+    }
     pCur->nodeIndex[level] = index;
   }
   pCur->levelLeaf = level;
@@ -1118,6 +1297,10 @@ int sqlite3BtreeMovetoUnpacked(BtCursor *pCur, UnpackedRecord *pIdxKey,
                                    i64 intKey, int biasRight, int *pRes){
   char *pKey;
   int res, nKey;
+  if (pCur->bulk){ // moving cursor ends bulk load
+    res = DtBulkFinish(pCur);
+    if (res) return res;
+  }
   assert(testRecordPack(pIdxKey, BTREE_FILE_FORMAT));
   pKey = myVdbeRecordPack(pIdxKey, BTREE_FILE_FORMAT, nKey);
 
@@ -1294,6 +1477,7 @@ int sqlite3BtreeInsert(
   COid coid;
   KVTransaction *tx = pCur->pBtree->tx;
   ListCell cell;
+  bool inlinerow, replacecell=false, dropdata=false;
 #if DTREE_SPLIT_LOCATION == 1
   int ncells=0, size=0;
 #endif
@@ -1302,6 +1486,14 @@ int sqlite3BtreeInsert(
            "appendBias %d seekResult %d", pCur, pKey,
            (long long)nKey, pData, nData, nZero, appendBias, seekResult);
 
+  if (pCur->bulk){ // bulk load in progress, just buffer the key
+    res = DtBulkInsert(pCur, pKey, nKey, pData, nData);
+    DTREELOG("  return %d", res);
+    return res;
+  }
+  if (pCur->prefetch) DtScanPrefetchEnd(pCur); // fetched rows may change
+  DtRowPrefetchEndTable(pCur->pBt, pCur->rootCid); // ditto
+
   pCur->data=0;
 
   if (seekResult && pCur->eState == CURSOR_VALID){
@@ -1309,7 +1501,7 @@ int sqlite3BtreeInsert(
     //  printf("insert: No seek so no optimistic insert\n");
   } 
   else if (pCur->eState == CURSOR_DIRECT && pCur->intKey && pKey==0 &&
-           pCur->directIntKey == nKey){
+           pCur->directIntKey == nKey && !DtMayHaveInlineRows(pCur)){
     // skip seeking since we did a directseek and found it
     //printf("insert: direct seek so no optimistic insert\n");
     seekResult=0;
@@ -1329,20 +1521,34 @@ int sqlite3BtreeInsert(
     if (res){ DTREELOG("  return %d", res); return res; }
   }
 
+  levelleaf = pCur->levelLeaf;
+  inlinerow = pCur->eState != CURSOR_DIRECT && pCur->intKey &&
+    DtInlineRow(pCur->node[levelleaf], nData);
+
   // here, if seekResult==0, then item is already on the tree, so no operation
-  // is needed
+  // is needed on the tree unless its row is or was inline in its cell
+  if (!seekResult && pCur->eState == CURSOR_VALID && pCur->intKey &&
+      pCur->node[levelleaf].hasInlineRows()){
+    ListCell *old = &pCur->node[levelleaf].Cells()[pCur->nodeIndex[levelleaf]];
+    replacecell = inlinerow || old->pData;
+    dropdata = inlinerow && !old->pData; // row moves from data object to cell
+  }
+
   if (seekResult){
     intKey = pCur->intKey;
     assert(intKey && !pKey || !intKey && pKey);
 
     /* write to KV store */
-    levelleaf = pCur->levelLeaf;
     coid.cid = pCur->rootCid;
     coid.oid = pCur->node[levelleaf].NodeOid();
     // create a cell with key
     cell.nKey = nKey;
     cell.pKey = (char*) pKey;
     cell.value = 0xabcdabcdabcdabcd; // not used
+    if (inlinerow){
+      cell.pData = (char*) pData;
+      cell.nData = nData;
+    }
 
 #if DTREE_SPLIT_LOCATION != 1    
     res = KVlistadd(tx, coid, &cell, (RcKeyInfo*) pCur->pKeyInfo, 0);
@@ -1352,8 +1558,19 @@ int sqlite3BtreeInsert(
 #endif
     if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
   }
+  else if (replacecell){
+    res = DtReplaceLeafCell(pCur, nKey, inlinerow ? (char*) pData : 0, nData);
+    if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
+  }
 
-  if (nData) {
+  if (dropdata){
+    coid.cid = DATA_CID(pCur->rootCid);
+    coid.oid = nKey;
+    res = KVput(tx, coid, 0, 0); // delete object
+    if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
+  }
+  
+  if (nData && !inlinerow) {
     res = DtWriteData(pCur, nKey, (char*) pData, nData);
     if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
   }
@@ -1385,6 +1602,7 @@ int btreeInsertOptimistic(BtCursor *pCur, const void *pKey, i64 nKey,
   Oid dest;
   KVTransaction *tx = pCur->pBtree->tx;
   ListCell cell;
+  bool inlinerow;
 
   //if (tx->type == 0) return -1; // don't do this for in-memory txs
 
@@ -1404,10 +1622,16 @@ int btreeInsertOptimistic(BtCursor *pCur, const void *pKey, i64 nKey,
   cell.nKey = nKey;
   cell.pKey = (char*) pKey;
   cell.value = 0xabcdabcdabcdabcd; // not used
+  inlinerow = intKey && DtInlineRow(pCur->node[0], nData); // node 0 is root
+  if (inlinerow){
+    cell.pData = (char*) pData;
+    cell.nData = nData;
+  }
   
 #if DTREE_SPLIT_LOCATION != 1
   // KVlistadd checks that coid is a leaf node and the key is within range.
-  // If so, the key is inserted if it is not inserted already
+  // If so, the key is inserted if it is not inserted already (or if its
+  // inline row differs)
   res = KVlistadd(tx, coid, &cell, (RcKeyInfo*) pCur->pKeyInfo, 1);
 #else
   int ncells=0, size=0;
@@ -1420,9 +1644,10 @@ int btreeInsertOptimistic(BtCursor *pCur, const void *pKey, i64 nKey,
     // **!** check that callers won't be bothered by CURSOR_INVALID
     return -1; // optimistic insert failed
   }
-  pCur->eState = CURSOR_DIRECT;
+  // an inline row has no data object to read directly
+  pCur->eState = inlinerow ? CURSOR_INVALID : CURSOR_DIRECT;
 
-  if (nData) {
+  if (nData && !inlinerow) {
     res = DtWriteData(pCur, nKey, (char*) pData, nData);
     if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
   }
@@ -1441,6 +1666,705 @@ int btreeInsertOptimistic(BtCursor *pCur, const void *pKey, i64 nKey,
   return 0;
 }
 
+// ---------------------------- Bulk loading ---------------------------------
+
+// State of a bulk load on a cursor (see sqlite3BtreeBulkBegin). While a bulk
+// load is in progress, keys are buffered here instead of being added to the
+// tree one at a time. When the load ends, the tree is built bottom-up.
+struct DtBulkLoad {
+  Oid firstleaf;    // oid of existing empty leaf, reused for leftmost leaf
+                    // (0 if there is none)
+  bool sorted;      // whether keys have arrived in increasing order so far
+  u8 celltype;      // CellType of the tree's nodes
+  int ncells;       // number of buffered cells
+  int maxcells;     // number of cells allocated
+  ListCell *cells;  // buffered cells
+
+  DtBulkLoad(){ firstleaf = 0; sorted = true; celltype = 0;
+                ncells = maxcells = 0; cells = 0; }
+  ~DtBulkLoad(){
+    for (int i=0; i < ncells; ++i) cells[i].Free();
+    if (cells) delete [] cells;
+  }
+};
+
+// compares the keys of two cells, returning <0, 0, or >0
+static int DtBulkCompare(ListCell *c1, ListCell *c2, KeyInfo *pKeyInfo){
+  UnpackedRecord *pIdxKey;   /* Unpacked index key */
+  char aSpace[150];          /* Temp space for pIdxKey - to avoid a malloc */
+  int cmp;
+
+  if (!c1->pKey){ // intkey
+    if (c1->nKey == c2->nKey) return 0;
+    return c1->nKey < c2->nKey ? -1 : +1;
+  }
+  pIdxKey = sqlite3VdbeRecordUnpack(pKeyInfo, (int)c2->nKey, c2->pKey, aSpace,
+                                    sizeof(aSpace));
+  assert(pIdxKey);
+  cmp = sqlite3VdbeRecordCompare((int)c1->nKey, c1->pKey, pIdxKey);
+  sqlite3VdbeDeleteUnpackedRecord(pIdxKey);
+  return cmp;
+}
+
+// orders indices of buffered cells by their keys
+struct DtBulkLess {
+  ListCell *cells;
+  KeyInfo *pKeyInfo;
+  DtBulkLess(ListCell *c, KeyInfo *k){ cells = c; pKeyInfo = k; }
+  bool operator()(int i1, int i2){
+    return DtBulkCompare(&cells[i1], &cells[i2], pKeyInfo) < 0;
+  }
+};
+
+// Writes one level of the tree. The level consists of nodes whose cells are
+// given by cells[0..n-1]; for inner nodes, cells[i]->value holds the child
+// pointer and the last cell of each node becomes its last pointer. Fills
+// seps[] and oids[] with the separator cell and oid of each node created,
+// and returns in *nnodes the number of nodes. If a single node is created,
+// it becomes the root.
+static int DtBulkWriteLevel(BtCursor *pCur, u8 celltype, int height,
+                            ListCell **cells, int n, Oid firstoid,
+                            ListCell **seps, Oid *oids, int *nnodes){
+  KVTransaction *tx = pCur->pBtree->tx;
+  bool remote = !isDBIdEphemeral(pCur->pBt->KVdbid);
+  bool leaf = height == 0;
+  int maxcells = DTREE_SPLIT_SIZE * DTREE_BULKLOAD_FILL / 100;
+  int maxbytes = DTREE_SPLIT_SIZE_BYTES * DTREE_BULKLOAD_FILL / 100;
+  int *start; // start[j] is the index of the first cell of node j
+  int i, j, k, nc, bytes, res;
+  u64 rnd;
+  u32 serverid;
+  COid coid;
+  SuperValue sv;
+  Ptr<RcKeyInfo> prki;
+
+  if (maxcells < 1) maxcells = 1;
+  start = new int[n+1];
+
+  // partition cells into nodes. Inner nodes need at least one cell besides
+  // the one that becomes the last pointer
+  j = 0;
+  i = 0;
+  while (i < n){
+    start[j++] = i;
+    nc = bytes = 0;
+    do {
+      bytes += cells[i]->size();
+      ++nc; ++i;
+    } while (i < n && (nc < maxcells || !leaf && nc < 2) &&
+             (bytes + cells[i]->size() <= maxbytes || !leaf && nc < 2));
+    if (!leaf && i == n-1) ++i; // do not leave a node with no cells
+  }
+  start[j] = n;
+  *nnodes = j;
+
+  // choose oids. Nodes go to consecutive serverids starting at a random one,
+  // so that they are spread across the servers
+  rnd = 0;
+  setRandomServerid(&rnd);
+  serverid = (u32) rnd;
+  for (j=0; j < *nnodes; ++j){
+    if (*nnodes == 1 && !leaf) oids[j] = DTREE_ROOT_OID;
+    else if (j == 0 && firstoid) oids[j] = firstoid;
+    else {
+      oids[j] = NewOid(remote);
+      oids[j] |= (serverid + j) & 0xffff;
+    }
+  }
+
+  // nodes stay in the transaction's cache after sqlite frees its keyinfo
+  // at the end of the statement, so they get a copy
+  if (pCur->pKeyInfo) prki = CloneKeyInfo((RcKeyInfo*) pCur->pKeyInfo);
+
+  coid.cid = pCur->rootCid;
+  for (j=0; j < *nnodes; ++j){
+    DTreeNode::InitSuperValue(&sv, celltype);
+    sv.prki = prki;
+    sv.Attrs[DTREENODE_ATTRIB_FLAGS] = (leaf ? DTREENODE_FLAG_LEAF : 0) |
+      (pCur->intKey ? DTREENODE_FLAG_INTKEY : 0);
+    sv.Attrs[DTREENODE_ATTRIB_HEIGHT] = height;
+    sv.Attrs[DTREENODE_ATTRIB_LEFTPTR] = j > 0 ? oids[j-1] : 0;
+    sv.Attrs[DTREENODE_ATTRIB_RIGHTPTR] = j < *nnodes-1 ? oids[j+1] : 0;
+    nc = start[j+1] - start[j];
+    if (!leaf){
+      --nc; // last child goes into last pointer
+      sv.Attrs[DTREENODE_ATTRIB_LASTPTR] = cells[start[j+1]-1]->value;
+    }
+    sv.Ncells = nc;
+    sv.Cells = new ListCell[nc];
+    for (k=0; k < nc; ++k){
+      sv.Cells[k].copy(*cells[start[j]+k]);
+      if (leaf) sv.Cells[k].value = 0xabcdabcdabcdabcd; // not used
+      sv.CellsSize += sv.Cells[k].size();
+    }
+    seps[j] = cells[start[j+1]-1]; // node's separator in the parent
+
+    coid.oid = oids[j];
+    res = KVwriteSuperValue(tx, coid, &sv);
+    sv.Free();
+    if (res){ delete [] start; return SQLITE_IOERR; }
+  }
+  delete [] start;
+  return 0;
+}
+
+// Builds the tree bottom-up from the buffered cells and ends the bulk load.
+// The tree must have been empty when the load started, and the new nodes
+// and root are written in the cursor's transaction, so they become visible
+// atomically when it commits.
+static int DtBulkFinish(BtCursor *pCur){
+  DtBulkLoad *bl = pCur->bulk;
+  int *order;
+  ListCell **cells, **seps;
+  Oid *oids;
+  int i, n, nnodes, height, res;
+  COid coid;
+
+  pCur->bulk = 0;
+  if (bl->ncells == 0){ delete bl; return 0; }
+
+  // sort cells if they did not arrive in order, then drop duplicates
+  order = new int[bl->ncells];
+  for (i=0; i < bl->ncells; ++i) order[i] = i;
+  if (!bl->sorted)
+    std::stable_sort(order, order + bl->ncells,
+                     DtBulkLess(bl->cells, pCur->pKeyInfo));
+  cells = new ListCell*[bl->ncells];
+  n = 0;
+  for (i=0; i < bl->ncells; ++i){
+    if (n > 0 && DtBulkCompare(cells[n-1], &bl->cells[order[i]],
+                               pCur->pKeyInfo) == 0)
+      continue;
+    cells[n++] = &bl->cells[order[i]];
+  }
+  delete [] order;
+
+  seps = new ListCell*[n];
+  oids = new Oid[n];
+  res = DtBulkWriteLevel(pCur, bl->celltype, 0, cells, n, bl->firstleaf, seps,
+                         oids, &nnodes);
+  // build inner levels until a single node (the root) is written. There is
+  // always at least one inner level, as in a newly created tree
+  for (height = 1; !res && (height == 1 || nnodes > 1); ++height){
+    assert(height < DTREE_MAX_LEVELS);
+    // separators of the level below, pointing to their nodes, are the
+    // cells of this level
+    for (i=0; i < nnodes; ++i){
+      cells[i] = seps[i];
+      cells[i]->value = oids[i];
+      cells[i]->FreePayload(); // inner cells do not carry inline rows
+    }
+    n = nnodes;
+    res = DtBulkWriteLevel(pCur, bl->celltype, height, cells, n, 0, seps, oids,
+                           &nnodes);
+  }
+
+  delete [] oids;
+  delete [] seps;
+  delete [] cells;
+  delete bl;
+
+  // cached root no longer reflects the tree
+  coid.cid = pCur->rootCid;
+  coid.oid = DTREE_ROOT_OID;
+  auxRemoveCache(coid);
+  DtFreeCursorFields(pCur);
+  pCur->eState = CURSOR_INVALID;
+  return res;
+}
+
+// Buffers a key (and writes the data, for intkey tables) during a bulk load
+static int DtBulkInsert(BtCursor *pCur, const void *pKey, i64 nKey,
+                        const void *pData, int nData){
+  DtBulkLoad *bl = pCur->bulk;
+  ListCell cell, *newcells;
+  bool inlinerow;
+  int res;
+
+  if (bl->ncells >= DTREE_BULKLOAD_MAX_CELLS){
+    // too many keys to buffer; install what we have and insert the rest
+    // one at a time
+    res = DtBulkFinish(pCur);
+    if (res) return res;
+    return sqlite3BtreeInsert(pCur, pKey, nKey, pData, nData, 0, 0, 0);
+  }
+
+  inlinerow = false;
+#ifdef DTREE_INLINE_ROW_MAX
+  inlinerow = bl->celltype == 2 && nData <= DTREE_INLINE_ROW_MAX;
+#endif
+  if (nData && !inlinerow){
+    res = DtWriteData(pCur, nKey, (char*) pData, nData);
+    if (res) return SQLITE_IOERR;
+  }
+
+  if (bl->ncells == bl->maxcells){
+    bl->maxcells = bl->maxcells ? 2 * bl->maxcells : 256;
+    newcells = new ListCell[bl->maxcells];
+    memcpy(newcells, bl->cells, bl->ncells * sizeof(ListCell));
+    if (bl->cells) delete [] bl->cells;
+    bl->cells = newcells;
+  }
+  cell.nKey = nKey;
+  cell.pKey = (char*) pKey;
+  cell.value = 0;
+  if (inlinerow && nData){
+    cell.pData = (char*) pData;
+    cell.nData = nData;
+  }
+  bl->cells[bl->ncells].copy(cell);
+  if (bl->sorted && bl->ncells > 0 &&
+      DtBulkCompare(&bl->cells[bl->ncells-1], &bl->cells[bl->ncells],
+                    pCur->pKeyInfo) >= 0)
+    bl->sorted = false;
+  ++bl->ncells;
+  return 0;
+}
+
+// Starts a bulk load on a cursor. Subsequent inserts through the cursor are
+// buffered and the tree is built bottom-up, with full nodes, when
+// sqlite3BtreeBulkEnd is called or when the cursor is moved. Inserted keys
+// need not be sorted, but sorted keys avoid a sort at the end. If the tree is
+// not empty, this function does nothing and inserts proceed as usual.
+int sqlite3BtreeBulkBegin(BtCursor *pCur){
+  DTreeNode root, leaf;
+  COid coid;
+  Oid firstleaf;
+  int res;
+
+  DTREELOG("BtCursor %p", pCur);
+  assert(pCur->wrFlag && !pCur->bulk);
+
+  // check that tree is empty
+  coid.cid = pCur->rootCid;
+  coid.oid = DTREE_ROOT_OID;
+  res = auxReadReal(pCur->pBtree->tx, coid, root, 0, 0);
+  if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
+  if (root.Ncells() != 0){ DTREELOG("  return %d", 0); return 0; }
+  if (root.isLeaf()) firstleaf = 0;
+  else {
+    if (root.Height() != 1){ DTREELOG("  return %d", 0); return 0; }
+    coid.oid = firstleaf = root.LastPtr();
+    res = auxReadReal(pCur->pBtree->tx, coid, leaf, 0, 0);
+    if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
+    if (leaf.Ncells() != 0 || leaf.RightPtr() != 0){
+      DTREELOG("  return %d", 0);
+      return 0;
+    }
+  }
+
+  pCur->bulk = new DtBulkLoad;
+  pCur->bulk->firstleaf = firstleaf;
+  pCur->bulk->celltype = root.CellType();
+  DTREELOG("  return %d", 0);
+  return 0;
+}
+
+// Ends a bulk load started with sqlite3BtreeBulkBegin, writing the buffered
+// keys to the tree. Does nothing if no bulk load is in progress.
+int sqlite3BtreeBulkEnd(BtCursor *pCur){
+  int res;
+  DTREELOG("BtCursor %p", pCur);
+  if (!pCur->bulk){ DTREELOG("  return %d", 0); return 0; }
+  res = DtBulkFinish(pCur);
+  DTREELOG("  return %d", res);
+  return res;
+}
+
+// ---------------------------- Scan prefetch --------------------------------
+
+// State of a prefetching scan (see sqlite3BtreeScanPrefetch). The scan visits
+// the leaves under one node of the level above the leaves at a time. Those
+// leaves, and for intkey tables the rows in them, are read with parallel
+// batched reads, so that a scan waits for a few round trips per such node
+// rather than one round trip per leaf and per row.
+struct DtScanPrefetch {
+  Oid nextparent;     // next node above the leaves whose leaves have not
+                      // been fetched, 0 if none
+  int nleaves;        // number of fetched leaves
+  int next;           // index of next fetched leaf to visit
+  int curleaf;        // index of fetched leaf being visited, -1 if none
+  DTreeNode *leaves;  // fetched leaves
+  int *firstrow;      // rows of leaves[i] start at rows[firstrow[i]]
+  Ptr<Valbuf> *rows;  // fetched rows, unset for rows not fetched
+
+  DtScanPrefetch(){ nextparent = 0; nleaves = next = 0; curleaf = -1;
+                    leaves = 0; firstrow = 0; rows = 0; }
+  ~DtScanPrefetch(){ clear(); }
+  void clear(){
+    if (leaves){ delete [] leaves; leaves = 0; }
+    if (firstrow){ delete [] firstrow; firstrow = 0; }
+    if (rows){ delete [] rows; rows = 0; }
+    nleaves = next = 0;
+    curleaf = -1;
+  }
+};
+
+static void DtScanPrefetchEnd(BtCursor *pCur){
+  delete pCur->prefetch;
+  pCur->prefetch = 0;
+}
+
+// Fetches the leaves under node pf->nextparent and their rows, replacing the
+// previously fetched ones. Returns 0 if ok, non-zero if the leaves could not
+// be fetched. Rows that could not be fetched are left unset.
+static int DtScanPrefetchBatch(BtCursor *pCur){
+  DtScanPrefetch *pf = pCur->prefetch;
+  KVTransaction *tx = pCur->pBtree->tx;
+  DTreeNode parent;
+  COid coid, *coids;
+  Ptr<Valbuf> *bufs;
+  int i, j, m, n, nrows, res, *slots;
+
+  pf->clear();
+  coid.cid = pCur->rootCid;
+  coid.oid = pf->nextparent;
+  res = auxReadReal(tx, coid, parent, 0, 0);
+  if (res) return SQLITE_IOERR;
+  if (parent.isLeaf() || parent.Height() != 1) return SQLITE_ABORT;
+
+  // read leaves
+  n = parent.Ncells() + 1;
+  coids = new COid[n];
+  bufs = new Ptr<Valbuf>[n];
+  for (i=0; i < n; ++i){
+    coids[i].cid = pCur->rootCid;
+    coids[i].oid = parent.GetPtr(i);
+  }
+  res = KVreadMany(tx, n, coids, bufs, 1);
+  delete [] coids;
+  if (res){ delete [] bufs; return SQLITE_IOERR; }
+  pf->leaves = new DTreeNode[n];
+  for (i=0; i < n; ++i) pf->leaves[i].raw = bufs[i];
+  delete [] bufs;
+  pf->nleaves = n;
+  pf->nextparent = parent.RightPtr();
+  if (!pCur->intKey) return 0;
+
+  // read rows of all leaves, except rows inline in their cells
+  pf->firstrow = new int[n];
+  for (nrows = 0, i=0; i < n; ++i){
+    pf->firstrow[i] = nrows;
+    nrows += pf->leaves[i].Ncells();
+  }
+  coids = new COid[nrows];
+  slots = new int[nrows];
+  for (m = 0, i=0; i < n; ++i){
+    for (j=0; j < pf->leaves[i].Ncells(); ++j){
+      if (pf->leaves[i].Cells()[j].pData) continue;
+      coids[m].cid = DATA_CID(pCur->rootCid);
+      coids[m].oid = pf->leaves[i].Cells()[j].nKey;
+      slots[m++] = pf->firstrow[i]+j;
+    }
+  }
+  pf->rows = new Ptr<Valbuf>[nrows];
+  if (m){
+    bufs = new Ptr<Valbuf>[m];
+    (void) KVreadMany(tx, m, coids, bufs, 0); // failed reads are redone by
+                                              // DtReadData
+    for (i=0; i < m; ++i) pf->rows[slots[i]] = bufs[i];
+    delete [] bufs;
+  }
+  delete [] slots;
+  delete [] coids;
+  return 0;
+}
+
+// Moves a prefetching scan to leaf leafoid, which follows the leaf being
+// visited. If the leaf was fetched, sets node to it and returns 1. Otherwise,
+// ends the prefetch and returns 0, and the caller should read the leaf.
+static int DtScanPrefetchNext(BtCursor *pCur, Oid leafoid, DTreeNode &node){
+  DtScanPrefetch *pf = pCur->prefetch;
+
+  if (pf->next == pf->nleaves && pf->nextparent &&
+      DtScanPrefetchBatch(pCur)){
+    DtScanPrefetchEnd(pCur);
+    return 0;
+  }
+  if (pf->next < pf->nleaves && pf->leaves[pf->next].NodeOid() == leafoid){
+    pf->curleaf = pf->next++;
+    node = pf->leaves[pf->curleaf];
+    return 1;
+  }
+  DtScanPrefetchEnd(pCur); // scan did not proceed as expected
+  return 0;
+}
+
+// Starts prefetching after DtFirst has placed the cursor at the first leaf
+static void DtScanPrefetchStart(BtCursor *pCur){
+  int level = pCur->levelLeaf;
+  DTreeNode leaf;
+
+  if (level == 0){ DtScanPrefetchEnd(pCur); return; } // root is a leaf
+  // the parent may be the root, whose oid is 0, so fetch its leaves here
+  // rather than through DtScanPrefetchNext
+  pCur->prefetch->nextparent = pCur->node[level-1].NodeOid();
+  if (DtScanPrefetchBatch(pCur)){ DtScanPrefetchEnd(pCur); return; }
+  (void) DtScanPrefetchNext(pCur, pCur->node[level].NodeOid(), leaf);
+}
+
+// Sets the cursor data to the fetched row at the cursor, if any.
+// Returns 1 if so, 0 if the row must be read.
+static int DtScanPrefetchRow(BtCursor *pCur){
+  DtScanPrefetch *pf = pCur->prefetch;
+  int levelleaf = pCur->levelLeaf;
+  int index = pCur->nodeIndex[levelleaf];
+  Ptr<Valbuf> row;
+
+  if (!pf->rows || pf->curleaf < 0) return 0;
+  if (pf->leaves[pf->curleaf].NodeOid() != pCur->node[levelleaf].NodeOid() ||
+      index >= pf->leaves[pf->curleaf].Ncells())
+    return 0;
+  row = pf->rows[pf->firstrow[pf->curleaf] + index];
+  if (!row.isset() ||
+      row->coid.oid != (Oid) pCur->node[levelleaf].Cells()[index].nKey)
+    return 0;
+  pCur->data = row;
+  return 1;
+}
+
+// Requests that the next full scan of the cursor, that is, sqlite3BtreeFirst
+// followed by sqlite3BtreeNext calls, fetch leaves and rows ahead with
+// parallel reads. The prefetch ends if the scan moves other than forward or
+// the table is modified. Used for scans that read an entire table.
+int sqlite3BtreeScanPrefetch(BtCursor *pCur){
+  DTREELOG("BtCursor %p", pCur);
+#ifdef DTREE_SCAN_PREFETCH
+  if (!pCur->prefetch && !isDBIdEphemeral(pCur->pBt->KVdbid))
+    pCur->prefetch = new DtScanPrefetch;
+#endif
+  DTREELOG("  return %d", 0);
+  return 0;
+}
+
+// ---------------------------- Row prefetch ---------------------------------
+
+// Rows fetched ahead for an index scan that looks up the row of each index
+// entry in a table (see sqlite3BtreeRowPrefetch). keys[] are the rowids of
+// the next index entries, in the order that the scan visits them. Rows are
+// fetched as data objects in rows[] or, for rows inline in leaf cells or if
+// direct seeks are off, as leaves in leaves[]. Entries that could not be
+// fetched are unset.
+struct DtRowPrefetch {
+  int n;              // number of keys
+  int next;           // index of next key that the scan should look up
+  int nleaves;        // number of fetched leaves
+  i64 *keys;          // rowids
+  Ptr<Valbuf> *rows;  // rows[i] is the data object of keys[i]
+  DTreeNode *leaves;  // fetched leaves
+
+  DtRowPrefetch(){ n = next = nleaves = 0; keys = 0; rows = 0; leaves = 0; }
+  ~DtRowPrefetch(){ clear(); }
+  void clear(){
+    if (keys){ delete [] keys; keys = 0; }
+    if (rows){ delete [] rows; rows = 0; }
+    if (leaves){ delete [] leaves; leaves = 0; }
+    n = next = nleaves = 0;
+  }
+};
+
+static void DtRowPrefetchEnd(BtCursor *pCur){
+  delete pCur->rowfetch;
+  pCur->rowfetch = 0;
+}
+
+// Ends the row prefetches of all cursors on table cidTable (0 for all tables)
+static void DtRowPrefetchEndTable(BtShared *pBt, u64 cidTable){
+  BtCursor *p;
+  for (p=pBt->pCursor; p; p=p->pNext){
+    if (p->rowfetch && (cidTable == 0 || p->rootCid == cidTable))
+      DtRowPrefetchEnd(p);
+  }
+}
+
+// Sets the cursor data to the fetched row of key nKey, if any.
+// Returns 1 if so, 0 if the row must be read.
+static int DtRowPrefetchRow(BtCursor *pCur, i64 nKey){
+  DtRowPrefetch *rf = pCur->rowfetch;
+  int i;
+  if (!rf->rows) return 0;
+  for (i = rf->next > 0 ? rf->next-1 : 0; i < rf->n; ++i){
+    if (rf->keys[i] == nKey){
+      if (!rf->rows[i].isset()) return 0;
+      pCur->data = rf->rows[i];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// If leaf oid was fetched, sets node to it and returns 1. Otherwise,
+// returns 0, and the caller should read the node.
+static int DtRowPrefetchLeaf(BtCursor *pCur, Oid oid, DTreeNode &node){
+  DtRowPrefetch *rf = pCur->rowfetch;
+  for (int i=0; i < rf->nleaves; ++i){
+    if (rf->leaves[i].NodeOid() == oid){
+      node = rf->leaves[i];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Returns in *rowid the rowid in an index cell, which is the last field of
+// its record, as in sqlite3VdbeIdxRowid. Returns 0 if ok, non-zero if the
+// record is malformed.
+static int DtIdxCellRowid(ListCell *cell, i64 *rowid){
+  u8 *z = (u8*) cell->pKey;
+  u32 szHdr, typeRowid, lenRowid;
+  Mem v;
+
+  if (!z || cell->nKey < 3) return SQLITE_CORRUPT;
+  (void) getVarint32(z, szHdr);
+  if (szHdr < 3 || (i64) szHdr > cell->nKey) return SQLITE_CORRUPT;
+  (void) getVarint32(&z[szHdr-1], typeRowid);
+  if (typeRowid < 1 || typeRowid > 9 || typeRowid == 7) return SQLITE_CORRUPT;
+  lenRowid = sqlite3VdbeSerialTypeLen(typeRowid);
+  if ((u64) cell->nKey < szHdr+lenRowid) return SQLITE_CORRUPT;
+  sqlite3VdbeSerialGet(&z[cell->nKey-lenRowid], typeRowid, &v);
+  *rowid = v.u.i;
+  return 0;
+}
+
+// Returns the oid of the leaf that should hold key nKey according to the
+// cached inner nodes, or 0 if the cache does not lead to a leaf. The leaf may
+// turn out to be the wrong one, since the cache is not authoritative.
+static Oid DtCachedLeafOid(BtCursor *pCur, i64 nKey){
+  DTreeNode node;
+  COid coid;
+  int level, index, matches;
+
+  coid.cid = pCur->rootCid;
+  coid.oid = DTREE_ROOT_OID;
+  for (level = 0; level < DTREE_MAX_LEVELS; ++level){
+    if (auxReadCache(coid, node)) return 0;
+    index = CellSearchNodeUnpacked(node, 0, nKey, 0, &matches);
+    coid.oid = node.GetPtr(index);
+    if (node.Height() == 1) return coid.oid; // children are leaves
+  }
+  return 0;
+}
+
+// Fetches the rows of keys rf->keys with parallel batched reads. Rows that
+// could not be fetched are left unset, to be read one at a time.
+static void DtRowPrefetchBatch(BtCursor *pCur){
+  DtRowPrefetch *rf = pCur->rowfetch;
+  KVTransaction *tx = pCur->pBtree->tx;
+  COid *coids;
+  Oid leafoid;
+  Ptr<Valbuf> *bufs;
+  int i, j, m, index, matches, *slots;
+  bool needleaves;
+
+  coids = new COid[rf->n];
+  bufs = new Ptr<Valbuf>[rf->n];
+  slots = new int[rf->n];
+
+#ifndef NODIRECTSEEK
+  needleaves = DtMayHaveInlineRows(pCur); // otherwise rows are read directly
+#else
+  needleaves = true;
+#endif
+  if (needleaves){
+    // read the distinct leaves that the cached inner nodes lead to
+    for (m = 0, i=0; i < rf->n; ++i){
+      leafoid = DtCachedLeafOid(pCur, rf->keys[i]);
+      if (!leafoid) continue;
+      for (j=0; j < m; ++j) if (coids[j].oid == leafoid) break;
+      if (j < m) continue; // already being read
+      coids[m].cid = pCur->rootCid;
+      coids[m++].oid = leafoid;
+    }
+    (void) KVreadMany(tx, m, coids, bufs, 1);
+    rf->leaves = new DTreeNode[m];
+    for (i=0; i < m; ++i){
+      if (!bufs[i].isset() || bufs[i]->type != 1) continue;
+      rf->leaves[rf->nleaves].raw = bufs[i];
+      if (rf->leaves[rf->nleaves].isLeaf()) ++rf->nleaves;
+      else rf->leaves[rf->nleaves].raw = 0;
+      bufs[i] = 0;
+    }
+  }
+
+  // read the data objects of rows that are not inline in a fetched leaf
+  for (m = 0, i=0; i < rf->n; ++i){
+    if (needleaves){
+      for (j=0; j < rf->nleaves; ++j){
+        index = CellSearchNodeUnpacked(rf->leaves[j], 0, rf->keys[i], 0,
+                                       &matches);
+        if (matches) break;
+      }
+      if (j < rf->nleaves && rf->leaves[j].Cells()[index].pData) continue;
+    }
+    coids[m].cid = DATA_CID(pCur->rootCid);
+    coids[m].oid = rf->keys[i];
+    slots[m++] = i;
+  }
+  rf->rows = new Ptr<Valbuf>[rf->n];
+  if (m){
+    (void) KVreadMany(tx, m, coids, bufs, 0);
+    for (i=0; i < m; ++i) rf->rows[slots[i]] = bufs[i];
+  }
+
+  delete [] slots;
+  delete [] bufs;
+  delete [] coids;
+}
+
+// Called when an index scan on cursor pIdxCur is about to look up rowid in
+// the table of cursor pCur. If the rows of the next index entries were not
+// fetched yet, fetches them ahead with parallel reads, taking the entries
+// from the leaf of the index cursor in the direction of the scan (backward if
+// reverse is set). Fetching is only an optimization, so no error is returned
+// if it fails.
+int sqlite3BtreeRowPrefetch(BtCursor *pCur, BtCursor *pIdxCur, i64 rowid,
+                            int reverse){
+#ifdef DTREE_ROW_PREFETCH
+  DtRowPrefetch *rf = pCur->rowfetch;
+  DTreeNode *leaf;
+  int window, index, n;
+  i64 key;
+
+  DTREELOG("BtCursor %p pIdxCur %p rowid %lld reverse %d", pCur, pIdxCur,
+           (long long)rowid, reverse);
+  if (!pCur->intKey || pIdxCur->intKey || isDBIdEphemeral(pCur->pBt->KVdbid))
+    return 0;
+  if (rf && rf->next < rf->n && rf->keys[rf->next] == rowid){
+    ++rf->next; // already fetched
+    return 0;
+  }
+  if (pIdxCur->eState != CURSOR_VALID) return 0;
+
+  // the batch doubles each time the scan consumes it in full
+  window = 4;
+  if (rf && rf->n && rf->next == rf->n){
+    window = 2 * rf->n;
+    if (window > DTREE_ROW_PREFETCH) window = DTREE_ROW_PREFETCH;
+  }
+  if (!rf) pCur->rowfetch = rf = new DtRowPrefetch;
+  rf->clear();
+
+  // collect the rowids of the next index entries in the index leaf
+  leaf = &pIdxCur->node[pIdxCur->levelLeaf];
+  index = pIdxCur->nodeIndex[pIdxCur->levelLeaf];
+  rf->keys = new i64[window];
+  for (n = 0; n < window && 0 <= index && index < leaf->Ncells(); ++n){
+    if (DtIdxCellRowid(&leaf->Cells()[index], &key)) break;
+    rf->keys[n] = key;
+    index += reverse ? -1 : 1;
+  }
+  if (n == 0 || rf->keys[0] != rowid){ // cursor not at entry of rowid
+    DtRowPrefetchEnd(pCur);
+    return 0;
+  }
+  rf->n = n;
+  rf->next = 1;
+  DtRowPrefetchBatch(pCur);
+#endif
+  DTREELOG("  return %d", 0);
+  return 0;
+}
+
 // Given a path with a real node at given level and a cell that can be used to
 // find that node, delete entry pointed to by index.
 // Assumes that node in path at level is real.
@@ -1483,8 +2407,9 @@ int DtDelete(BtCursor *pCur, int level, ListCell *lc){
   int res;
   ListCell cell;
 
-  if (pCur->intKey && dtn->isLeaf()){ // if intkey table and leaf node,
-                                      // remove KV object with data
+  if (pCur->intKey && dtn->isLeaf() && !dtn->Cells()[index].pData){
+    // if intkey table and leaf node, remove KV object with data (unless the
+    // row is inline in the cell)
     coid.cid = DATA_CID(pCur->rootCid);
     coid.oid = dtn->Cells()[index].nKey;
     res = KVput(pCur->pBtree->tx, coid, 0, 0); // delete object
@@ -1505,6 +2430,7 @@ int DtDelete(BtCursor *pCur, int level, ListCell *lc){
     if (index < raw->Ncells){
       // call range delete on cell
       cell = dtn->Cells()[index];
+      cell.FreePayload(); // only the key is needed
       res = KVlistdelrange(pCur->pBtree->tx, coid, 4, &cell, &cell,
                            (RcKeyInfo*) pCur->pKeyInfo);
       if (res) return SQLITE_IOERR;
@@ -1598,6 +2524,7 @@ int DtDelete(BtCursor *pCur, int level, ListCell *lc){
     } else {
       // call delete on only cell
       cell = dtn->Cells()[index];
+      cell.FreePayload(); // only the key is needed
       res = KVlistdelrange(pCur->pBtree->tx, coid, 4, &cell, &cell,
                            (RcKeyInfo*) pCur->pKeyInfo);
       if (res) return SQLITE_IOERR;
@@ -1621,6 +2548,12 @@ int sqlite3BtreeDelete(BtCursor *pCur){
   // ensure cursor is valid
   int res;
 
+  if (pCur->bulk){ // bulk load leaves cursor at no entry
+    res = DtBulkFinish(pCur);
+    if (res){ DTREELOG("  return %d", res); return res; }
+  }
+  if (pCur->prefetch) DtScanPrefetchEnd(pCur); // fetched rows may change
+
   // if cursor is direct, seek it to appropriate location
   if (pCur->eState == CURSOR_DIRECT){
     res = DtMovefromDirect(pCur);
@@ -1665,6 +2598,10 @@ int DtFirst(BtCursor *pCur, int *pRes){
   COid coid;
   COid coid2;
 
+  if (pCur->bulk){ // moving cursor ends bulk load
+    res = DtBulkFinish(pCur);
+    if (res) return res;
+  }
   pCur->data=0;
   coid2.cid = coid.cid = pCur->rootCid;
 
@@ -1736,6 +2673,7 @@ int DtFirst(BtCursor *pCur, int *pRes){
   pCur->nodeIndex[level] = 0; // point to first entry
   *pRes = 0;
   pCur->eState = CURSOR_VALID;
+  if (pCur->prefetch) DtScanPrefetchStart(pCur);
   return 0;
 }
 int sqlite3BtreeFirst(BtCursor *pCur, int *pRes){
@@ -1756,6 +2694,10 @@ int DtLast(BtCursor *pCur, int *pRes){
   COid coid;
   COid coid2;
 
+  if (pCur->bulk){ // moving cursor ends bulk load
+    res = DtBulkFinish(pCur);
+    if (res) return res;
+  }
   pCur->data=0;
 
   coid2.cid = coid.cid = pCur->rootCid;
@@ -1875,6 +2817,13 @@ int sqlite3BtreeNext(BtCursor *pCur, int *pRes){
 
   assert(pCur->eState == CURSOR_VALID);
   int levelleaf = pCur->levelLeaf;
+  if (!pCur->node[levelleaf].coversIndex(pCur->nodeIndex[levelleaf]+1)){
+    // moving past the cells of a partial leaf, so read all of them
+    int matches;
+    res = DtMoveToWholeLeaf(pCur, &matches);
+    if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
+    if (!matches) --pCur->nodeIndex[levelleaf]; // next entry is at index
+  }
   ++pCur->nodeIndex[levelleaf];
   if (pCur->nodeIndex[levelleaf] < pCur->node[levelleaf].Ncells()){
     // still cells in this node
@@ -1887,8 +2836,11 @@ int sqlite3BtreeNext(BtCursor *pCur, int *pRes){
     /* move to next node */
     coid.cid = pCur->rootCid;
     coid.oid = pCur->node[levelleaf].RightPtr();
-    res = auxReadReal(pCur->pBtree->tx, coid, pCur->node[levelleaf], 0, 0);
-    if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
+    if (!pCur->prefetch ||
+        !DtScanPrefetchNext(pCur, coid.oid, pCur->node[levelleaf])){
+      res = auxReadReal(pCur->pBtree->tx, coid, pCur->node[levelleaf], 0, 0);
+      if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
+    }
     pCur->nodetype[levelleaf] = 1; // mark as real node
     pCur->nodeIndex[levelleaf] = 0; // start at first cell
     assert(pCur->node[levelleaf].Ncells() > 0); // cannot be empty
@@ -1938,6 +2890,12 @@ int sqlite3BtreePrevious(BtCursor *pCur, int *pRes){
 
   assert(pCur->eState == CURSOR_VALID);
   int levelleaf = pCur->levelLeaf;
+  if (!pCur->node[levelleaf].coversIndex(pCur->nodeIndex[levelleaf])){
+    // moving past the cells of a partial leaf, so read all of them
+    int matches;
+    res = DtMoveToWholeLeaf(pCur, &matches);
+    if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
+  }
   if (pCur->nodeIndex[levelleaf] > 0){ /* still cells in this node */
     --pCur->nodeIndex[levelleaf];
     *pRes=0;
@@ -2328,6 +3286,8 @@ int sqlite3BtreePutData(BtCursor *pCur, u32 offset, u32 amt, void *z){
     return SQLITE_READONLY;
   }
   assert(!pCur->pBt->readOnly && pCur->pBt->inTransaction==TRANS_WRITE);
+  if (pCur->prefetch) DtScanPrefetchEnd(pCur); // fetched row will change
+  DtRowPrefetchEndTable(pCur->pBt, pCur->rootCid); // ditto
 
   if (!pCur->data.isset()){
     res = DtReadData(pCur);
@@ -2344,8 +3304,13 @@ int sqlite3BtreePutData(BtCursor *pCur, u32 offset, u32 amt, void *z){
   i64 nkey = pCur->node[levelleaf].Cells()[index].nKey;
 
   assert(pCur->data->type==0);
-  res = DtWriteData(pCur, nkey, (char*) pCur->data->u.buf+sizeof(DataHeader),
-                    pCur->data->len-sizeof(DataHeader)); // write to KV store
+  if (pCur->eState == CURSOR_VALID &&
+      pCur->node[levelleaf].Cells()[index].pData) // row is inline in cell
+    res = DtReplaceLeafCell(pCur, nkey, vbuf->u.buf+sizeof(DataHeader),
+                            vbuf->len-sizeof(DataHeader));
+  else
+    res = DtWriteData(pCur, nkey, (char*) pCur->data->u.buf+sizeof(DataHeader),
+                      pCur->data->len-sizeof(DataHeader)); // write to KV store
   if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
   pCur->data = vbuf;
 
@@ -2619,7 +3584,8 @@ int sqlite3BtreeBeginTrans(Btree *p, int wrflag){
     freeTx(p->tx);
     p->tx = 0;
   }
-  rc = beginTx(&p->tx, remote);
+  // read transactions may use a stale snapshot if the connection allows it
+  rc = beginTx(&p->tx, remote, false, wrflag ? 0 : p->readStaleness);
 
   if (rc==SQLITE_OK){
     if (p->inTrans==TRANS_NONE){
@@ -3137,6 +4103,10 @@ int sqlite3BtreeCloseCursor(BtCursor *pCur){
     BtShared *pBt = pCur->pBt;
     sqlite3BtreeEnter(pBtree);
     sqlite3BtreeClearCursor(pCur);
+    if (pCur->bulk){ // discard unfinished bulk load
+      delete pCur->bulk;
+      pCur->bulk = 0;
+    }
     if (pCur->pPrev){
       pCur->pPrev->pNext = pCur->pNext;
     }else{
@@ -3198,6 +4168,7 @@ static int saveCursorPosition(BtCursor *pCur){
   if (rc==0){
     pCur->data=0;
     pCur->eState = CURSOR_REQUIRESEEK;
+    if (pCur->prefetch) DtScanPrefetchEnd(pCur); // table is about to change
   }
 
   return rc;
@@ -3213,6 +4184,7 @@ static int saveAllCursors(BtShared *pBt, u64 cidTable, BtCursor *pExcept){
   BtCursor *p;
   assert(sqlite3_mutex_held(pBt->mutex));
   assert(pExcept==0 || pExcept->pBt==pBt);
+  DtRowPrefetchEndTable(pBt, cidTable); // table is about to change
   for(p=pBt->pCursor; p; p=p->pNext){
     if (p!=pExcept && (0==cidTable || p->rootCid==cidTable) && 
         p->eState==CURSOR_VALID){
@@ -3363,6 +4335,8 @@ void DtFreeCursorFields(BtCursor *pCur){
   int i;
   if (pCur->savepKey){ sqlite3_free(pCur->savepKey); pCur->savepKey=0; }
   pCur->data = 0;
+  if (pCur->prefetch) DtScanPrefetchEnd(pCur);
+  if (pCur->rowfetch) DtRowPrefetchEnd(pCur);
   for (i=0; i < DTREE_MAX_LEVELS; ++i)
     pCur->node[i].raw = 0; // zero out smart pointers
 }
@@ -3535,3 +4509,16 @@ int sqlite3BtreeSetCacheSize(Btree *p, int mxPage){
   DTREELOG("btree %p mxPage %d", p, mxPage);
   return 0;
 }
+
+// Sets how old, in ms, the snapshot of read transactions started
+// subsequently may be (see GAIA_STALE_READS). 0 means they read the latest
+// data, which is the default.
+int sqlite3BtreeSetReadStaleness(Btree *p, int ms){
+  DTREELOG("btree %p ms %d", p, ms);
+  p->readStaleness = ms;
+  return 0;
+}
+
+int sqlite3BtreeGetReadStaleness(Btree *p){
+  return p->readStaleness;
+}
@@ -70,19 +70,27 @@ void DTreeNode::InitSuperValue(SuperValue *sv, u8 celltype){
 // Puts a copy in NodeCache if read node is not leaf and it is more recent than
 //      the one there.
 // Puts the read node (not copy) in TxReadCache if it is not in TxWriteCache.
+// If cellonly is set and the node is a leaf, the read node may have just the
+// cells around cell (see Transaction::vsuperget).
 // Returns a status: 0 if ok, != 0 if problem.
 // The read node is returned in variable outptr.
 int auxReadReal(KVTransaction *tx, COid coid, DTreeNode &outptr,
-                ListCell *cell, Ptr<RcKeyInfo> prki){
+                ListCell *cell, Ptr<RcKeyInfo> prki, bool cellonly){
   DTreeNode dtn;
+  Ptr<Valbuf> base;
   int res;
 
-  res = KVreadSuperValue(tx, coid, dtn.raw, cell, prki);
+#ifdef GAIA_DELTA_READS
+  // if cache has a version read from the server, the server need only send
+  // what changed since then
+  GCache.lookupReal(coid, base);
+#endif
+  res = KVreadSuperValue(tx, coid, dtn.raw, cell, prki, &base, cellonly);
   if (res) return res;
 
   if (dtn.raw->type == 1 && dtn.isInner()){ // inner supernode
     // try to refresh cache if newer
-    GCache.refresh(dtn.raw);
+    GCache.refresh(dtn.raw, base.isset());
   }
 
   outptr = dtn;
@@ -112,15 +120,22 @@ void auxRemoveCache(COid coid){
 // change it since the value may be shared with other threads.
 // Otherwise, the data is private and the caller can change it.
 int auxReadCacheOrReal(KVTransaction *tx, COid coid, DTreeNode &outptr,
-                       int &real, ListCell *cell, Ptr<RcKeyInfo> prki){
+                       int &real, ListCell *cell, Ptr<RcKeyInfo> prki,
+                       bool cellonly){
   int res;
+#ifdef GAIA_LEASES
+  // a node with a lease is real and still read locally, so it is better than
+  // the global cache, whose nodes may be stale
+  if (KVcachedSuperValue(tx, coid)) res = -1;
+  else
+#endif
   res = auxReadCache(coid, outptr);
   if (res==0){ 
     assert(outptr.isInner()); // cannot read leaf nodes from cache
     real=0; 
     return 0; 
   } // found in cache
-  res = auxReadReal(tx, coid, outptr, cell, prki);
+  res = auxReadReal(tx, coid, outptr, cell, prki, cellonly);
   if (res) return res; // error
   real = 1;
   return 0;
@@ -306,11 +306,19 @@ int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
 
   // obtain new coid for left node
   leftcoid.oid = NewOid(remote);
+#ifdef DTREE_LOCAL_PLACEMENT
+  // place next to node being split, unless it is the root, which moves to
+  // a new oid below
+  if (toSplit.oid) setNeighborServerid(&leftcoid.oid, toSplit.oid);
+  else setRandomServerid(&leftcoid.oid);
+#else
   setRandomServerid(&leftcoid.oid); // random serverid policy
+#endif
 
   // copy splitindex cell, and set its pointer to the left node
   ListCell lc(nodesplit.Cells()[splitindex]);
   lc.value = leftcoid.oid;
+  lc.FreePayload(); // inner cells do not carry inline rows
 
   // create left node with cells first..splitindex-1, with last
   //     pointer = pointer of old splitindex cell,
@@ -348,7 +356,12 @@ int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
   if (splitroot){
     // change oid of node to be split
     nodesplit.raw->coid.oid = NewOid(remote);
+#ifdef DTREE_LOCAL_PLACEMENT
+    // place next to left node, the other child of the new root
+    setNeighborServerid(&nodesplit.raw->coid.oid, leftcoid.oid);
+#else
     setRandomServerid(&nodesplit.raw->coid.oid); // random serverid policy
+#endif
     parentcoid.oid = 0; //root is parent
 
     SuperValue newroot;
@@ -143,13 +143,21 @@ int PrepareRPCData::marshall(iovec *bufs, int maxbufs){
     bufs[nbufs].iov_len = data->readset_len * sizeof(COid);
     ++nbufs;
   }
+  if (data->nparticipants){
+    bufs[nbufs].iov_base = (char*) data->participants;
+    bufs[nbufs].iov_len = data->nparticipants * sizeof(IPPort);
+    ++nbufs;
+  }
   return nbufs;
 }
 
 void PrepareRPCData::demarshall(char *buf){
   data = (PrepareRPCParm*) buf;
   data->piggy_buf = (char*)(buf + sizeof(PrepareRPCParm));
-  data->readset = (COid*)(data->piggy_buf + data->piggy_len);
+  // piggy_len is -1 if there is no piggyback buffer
+  data->readset = (COid*)(data->piggy_buf +
+                          (data->piggy_len > 0 ? data->piggy_len : 0));
+  data->participants = (IPPort*)(data->readset + data->readset_len);
 }
 
 int PrepareRPCRespData::marshall(iovec *bufs, int maxbufs){ 
@@ -422,6 +430,12 @@ int ListAddRPCData::marshall(iovec *bufs, int maxbufs){
     bufs[nbufs].iov_len = (unsigned) data->cell.nKey;
     ++nbufs;
   }
+  // serialize the inline row in pData (if any)
+  if (data->cell.pData){
+    bufs[nbufs].iov_base = data->cell.pData;
+    bufs[nbufs].iov_len = (unsigned) data->cell.nData;
+    ++nbufs;
+  }
   return nbufs;
 }
 
@@ -443,6 +457,11 @@ void ListAddRPCData::demarshall(char *buf){
     data->cell.pKey = ptr; // actual data is at the end
     ptr += data->cell.nKey;
   }
+  // deserialize the inline row in pData (if any), same convention as pKey
+  if (data->cell.pData){
+    data->cell.pData = ptr;
+    ptr += data->cell.nData;
+  }
 }
 
 int ListAddRPCRespData::marshall(iovec *bufs, int maxbufs){
@@ -506,6 +525,9 @@ void ListDelRangeRPCData::demarshall(char *buf){
     data->cell2.pKey = ptr;
     ptr += data->cell2.nKey;
   }
+  // inline rows are not sent, since cells are used only as keys
+  data->cell1.pData = data->cell2.pData = 0;
+  data->cell1.nData = data->cell2.nData = 0;
 }
 
 int ListDelRangeRPCRespData::marshall(iovec *bufs, int maxbufs){
@@ -610,6 +632,9 @@ void FullReadRPCData::demarshall(char *buf){
     data->cell.pKey = ptr; // actual data is at the end
     ptr += data->cell.nKey;
   }
+  // inline row is not sent, since cell is used only as a key
+  data->cell.pData = 0;
+  data->cell.nData = 0;
 }
 
 FullReadRPCRespData::~FullReadRPCRespData(){
@@ -660,12 +685,22 @@ void CelloidsToListCells(char *celloids, int ncelloids, int celltype,
     u64 nkey;
     ptr += myGetVarint((unsigned char*) ptr, &nkey);
     lc->nKey = nkey;
-    if (celltype == 0) lc->pKey = 0; // integer cell, set pKey=0
+    if (celltype != 1) lc->pKey = 0; // integer cell, set pKey=0
     else { // non-integer key, so extract pKey (nkey has its length)
       lc->pKey = new char[(unsigned) nkey];
       memcpy(lc->pKey, ptr, (size_t)nkey);
       ptr += nkey;
     }
+    if (celltype == 2){ // extract inline row, if any
+      u64 ndata;
+      ptr += myGetVarint((unsigned char*) ptr, &ndata);
+      lc->nData = (int) ndata;
+      if (ndata){
+        lc->pData = (char*) malloc((size_t)ndata);
+        memcpy(lc->pData, ptr, (size_t)ndata);
+        ptr += ndata;
+      }
+    }
     // extract childOid
     lc->value = *(Oid*)ptr;
     ptr += sizeof(u64); // space for 64-bit value in cell
@@ -675,21 +710,22 @@ void CelloidsToListCells(char *celloids, int ncelloids, int celltype,
   }
 }
 
-int CellSize(ListCellPlus *lc){
+int CellSize(ListCellPlus *lc, int celltype){
   int len = myVarintLen(lc->nKey);
   if (lc->pKey == 0) ; // integer key (no pkey)
   else len += (int) lc->nKey; // space for pkey
+  if (celltype == 2) len += myVarintLen(lc->nData) + lc->nData; // inline row
   len += sizeof(u64); // spave for 64-bit value in cell
   return len;
 }
 
-int ListCellsSize(SkipListBK<ListCellPlus,int> &cells){
+int ListCellsSize(SkipListBK<ListCellPlus,int> &cells, int celltype){
   SkipListNodeBK<ListCellPlus,int> *ptr;
   int len = 0;
   // iterate to calculate length
   for (ptr = cells.getFirst(); ptr != cells.getLast();
        ptr = cells.getNext(ptr)){
-    len += CellSize(ptr->key);
+    len += CellSize(ptr->key, celltype);
   }
   return len;
 }
@@ -699,15 +735,15 @@ int ListCellsSize(SkipListBK<ListCellPlus,int> &cells){
 // - a pointer to an allocated buffer (allocated with new),
 // - the number of celloids in variable ncelloids
 // - the length of the buffer in variable lencelloids
-char *ListCellsToCelloids(SkipListBK<ListCellPlus,int> &cells, int &ncelloids,
-                          int &lencelloids){
+char *ListCellsToCelloids(SkipListBK<ListCellPlus,int> &cells, int celltype,
+                          int &ncelloids, int &lencelloids){
   SkipListNodeBK<ListCellPlus,int> *ptr;
   int len;
   char *buf, *p;
   int ncells=0;
   
   // first find length of listcells to determine length of buffer to allocate
-  len = ListCellsSize(cells);
+  len = ListCellsSize(cells, celltype);
   ncells = cells.getNitems();
   
   p = buf = new char[len];
@@ -720,6 +756,13 @@ char *ListCellsToCelloids(SkipListBK<ListCellPlus,int> &cells, int &ncelloids,
       memcpy(p, ptr->key->pKey, (int)ptr->key->nKey);
       p += ptr->key->nKey;
     }
+    if (celltype == 2){ // inline row
+      p += myPutVarint((unsigned char *)p, ptr->key->nData);
+      if (ptr->key->nData){
+        memcpy(p, ptr->key->pData, ptr->key->nData);
+        p += ptr->key->nData;
+      }
+    }
     memcpy(p, &ptr->key->value, sizeof(u64));
     p += sizeof(u64);
   }
@@ -729,6 +772,124 @@ char *ListCellsToCelloids(SkipListBK<ListCellPlus,int> &cells, int &ncelloids,
   return buf;
 }
 
+// Serialization of a cell within a list of deltas. Unlike celloids, this
+// does not depend on the celltype, since the cells delimiting a delrange
+// may have no key. The format is a byte with flags (1=has pKey, 2=has pData),
+// nKey as a varint, pKey (if any), nData as a varint and pData (if any), and
+// the 64-bit value.
+static int DeltaCellSize(ListCell *lc){
+  int len = 1 + myVarintLen(lc->nKey) + sizeof(u64);
+  if (lc->pKey) len += (int) lc->nKey;
+  if (lc->pData) len += myVarintLen(lc->nData) + lc->nData;
+  return len;
+}
+
+static char *DeltaCellPut(char *p, ListCell *lc){
+  *p++ = (lc->pKey ? 1 : 0) | (lc->pData ? 2 : 0);
+  p += myPutVarint((unsigned char *)p, lc->nKey);
+  if (lc->pKey){
+    memcpy(p, lc->pKey, (int)lc->nKey);
+    p += lc->nKey;
+  }
+  if (lc->pData){
+    p += myPutVarint((unsigned char *)p, lc->nData);
+    memcpy(p, lc->pData, lc->nData);
+    p += lc->nData;
+  }
+  memcpy(p, &lc->value, sizeof(u64));
+  return p + sizeof(u64);
+}
+
+static char *DeltaCellGet(char *p, ListCell *lc){
+  u64 n;
+  int flags = *p++;
+  p += myGetVarint((unsigned char *)p, &n);
+  lc->nKey = (i64) n;
+  lc->pKey = 0;
+  if (flags & 1){
+    lc->pKey = (char*) malloc((size_t)n);
+    memcpy(lc->pKey, p, (size_t)n);
+    p += n;
+  }
+  lc->pData = 0;
+  lc->nData = 0;
+  if (flags & 2){
+    p += myGetVarint((unsigned char *)p, &n);
+    lc->nData = (int) n;
+    lc->pData = (char*) malloc((size_t)n);
+    memcpy(lc->pData, p, (size_t)n);
+    p += n;
+  }
+  memcpy(&lc->value, p, sizeof(u64));
+  return p + sizeof(u64);
+}
+
+// converts the list operations in a sequence of tucoids into a buffer of
+// deltas. Each delta is a byte with its type (0=add, 1=delrange) followed by
+// the added cell, or by the interval type and the two cells of the range.
+// Returns:
+// - a pointer to an allocated buffer (allocated with new),
+// - the number of deltas in variable ndeltas
+// - the length of the buffer in variable lendeltas
+char *TucoidsToDeltas(Ptr<TxUpdateCoid> *tucoids, int ntucoids,
+                      int &ndeltas, int &lendeltas){
+  TxListItem *tli;
+  int i, len=0, n=0;
+  char *buf, *p;
+
+  for (i=0; i < ntucoids; ++i){
+    LinkList<TxListItem> &litems = tucoids[i]->Litems;
+    for (tli = litems.getFirst(); tli != litems.getLast();
+         tli = litems.getNext(tli)){
+      if (tli->type == 0){
+        TxListAddItem *tlai = dynamic_cast<TxListAddItem*>(tli);
+        len += 1 + DeltaCellSize(&tlai->item);
+      } else {
+        TxListDelRangeItem *tldri = dynamic_cast<TxListDelRangeItem*>(tli);
+        len += 2 + DeltaCellSize(&tldri->itemstart) +
+          DeltaCellSize(&tldri->itemend);
+      }
+      ++n;
+    }
+  }
+
+  p = buf = new char[len];
+  for (i=0; i < ntucoids; ++i){
+    LinkList<TxListItem> &litems = tucoids[i]->Litems;
+    for (tli = litems.getFirst(); tli != litems.getLast();
+         tli = litems.getNext(tli)){
+      *p++ = (char) tli->type;
+      if (tli->type == 0){
+        TxListAddItem *tlai = dynamic_cast<TxListAddItem*>(tli);
+        p = DeltaCellPut(p, &tlai->item);
+      } else {
+        TxListDelRangeItem *tldri = dynamic_cast<TxListDelRangeItem*>(tli);
+        *p++ = (char) tldri->intervalType;
+        p = DeltaCellPut(p, &tldri->itemstart);
+        p = DeltaCellPut(p, &tldri->itemend);
+      }
+    }
+  }
+  assert(p-buf == len);
+  ndeltas = n;
+  lendeltas = len;
+  return buf;
+}
+
+// extracts the delta at ptr from a buffer produced by TucoidsToDeltas.
+// Sets type and, for an add, cell1, or for a delrange, intervaltype,
+// cell1, and cell2. Cells are allocated as in ListCell::copy, so caller
+// should free them with ListCell::Free. Returns a pointer to the next delta.
+char *DeltasGetOne(char *ptr, int &type, int &intervaltype, ListCell *cell1,
+                   ListCell *cell2){
+  type = *ptr++;
+  if (type == 0) return DeltaCellGet(ptr, cell1);
+  assert(type == 1);
+  intervaltype = (u8) *ptr++;
+  ptr = DeltaCellGet(ptr, cell1);
+  return DeltaCellGet(ptr, cell2);
+}
+
 TxWriteSVItem *fullWriteRPCParmToTxWriteSVItem(FullWriteRPCParm *data){
   TxWriteSVItem *twsvi;
   COid coid;
@@ -787,3 +948,36 @@ int FullWriteRPCRespData::marshall(iovec *bufs, int maxbufs){
 void FullWriteRPCRespData::demarshall(char *buf){
   data = (FullWriteRPCResp*) buf;
 }
+
+// ------------------------------- REPLICATE RPC -------------------------------
+
+int ReplicateRPCData::marshall(iovec *bufs, int maxbufs){
+  assert(maxbufs >= 4);
+  int nbufs=0;
+  bufs[nbufs].iov_base = (char*) data;
+  bufs[nbufs++].iov_len = sizeof(ReplicateRPCParm);
+  bufs[nbufs].iov_base = data->buf;
+  bufs[nbufs++].iov_len = data->len;
+  bufs[nbufs].iov_base = (char*) data->attrs;
+  bufs[nbufs++].iov_len = sizeof(u64) * data->nattrs;
+  bufs[nbufs].iov_base = data->celloids;
+  bufs[nbufs++].iov_len = data->lencelloids;
+  if (serializeKeyinfoBuf) free(serializeKeyinfoBuf);
+  nbufs += marshall_keyinfo(data->prki, bufs+nbufs, maxbufs-nbufs,
+                            &serializeKeyinfoBuf);
+  return nbufs;
+}
+
+void ReplicateRPCData::demarshall(char *buf){
+  char *ptr = buf;
+  data = (ReplicateRPCParm*) ptr;
+  ptr += sizeof(ReplicateRPCParm);
+  data->buf = ptr; // buf follows parm
+  ptr += data->len;
+  data->attrs = (u64*) ptr; // attrs follows buf
+  ptr += data->nattrs * sizeof(u64);
+  data->celloids = ptr; // celloids follows attrs
+  ptr += data->lencelloids;
+  data->prki.init();
+  data->prki = demarshall_keyinfo(&ptr);
+}
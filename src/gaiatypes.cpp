@@ -112,6 +112,13 @@ void Timestamp::setHighest(void){
   d[1] = (u64)B16<<48 | (UniqueId::getUniqueId() & B48LL);
 }
 
+// set timestamp to one of the lowest timestamps that are bigger than all
+// timestamps whose first word is at most d1
+void Timestamp::setAfterd1(u64 d1){
+  d[0] = d1+1;
+  d[1] = UniqueId::getUniqueId() & B48LL;
+}
+
 int Timestamp::age(void){
   i64 t = (Time::nowus()+advance) & B48LL;
   return (int)(t - (d[0] & B48LL))/1000;
@@ -69,11 +69,12 @@ void RPCTcp::handleMsg(int handlerid, IPPort *dest, u32 req, u32 xid,
   if (handlerid == -1){ // client stuff
     OutstandingRPC *orpc;
     orpc = RequestLookupAndDelete(xid);
-    if (orpc && orpc->callback){
-      orpc->callback(data, len, orpc->callbackdata);
-    }
     if (orpc){
+      // free request data before invoking the callback, since the callback
+      // may wake up a caller who then frees objects referenced by the
+      // request data (e.g., the RcKeyInfo of a FULLREAD)
       delete orpc->dmsg.data;
+      if (orpc->callback) orpc->callback(data, len, orpc->callbackdata);
       delete orpc;
     }
 
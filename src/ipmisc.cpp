@@ -115,6 +115,25 @@ u32 IPMisc::getMyIP(u32 preferip, u32 prefermask){
    return firstip;
 }
 
+bool IPMisc::isLocal(u32 ip){
+  int res;
+  bool found = false;
+  struct ifaddrs *head, *ptr;
+
+  if ((ntohl(ip) >> 24) == 127) return true; // loopback
+  res = getifaddrs(&head);
+  if (res) return false;
+  for (ptr = head; ptr; ptr = ptr->ifa_next){
+    if (!ptr->ifa_addr) continue;
+    if ((ptr->ifa_addr->sa_family != AF_INET)) continue; // ipv4 please
+    if (*(u32*)&((sockaddr_in*)ptr->ifa_addr)->sin_addr.s_addr == ip){
+      found = true;
+      break;
+    }
+  }
+  freeifaddrs(head);
+  return found;
+}
 
 // Return printable string for given ip.
 // Returned value is overwritten on each call.
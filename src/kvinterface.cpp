@@ -94,24 +94,54 @@ int GlobalCache::lookup(COid &coid, Ptr<Valbuf> &vbuf){
   return res;
 }
 
+// auxiliary function to extract a vbuf from a GlobalCacheEntry if it is
+// exactly a version read from the server, to be used in lookupReal below.
+// The splitter may update cached nodes in place, but it then changes their
+// commitTs as well.
+int GlobalCache::auxExtractRealVbuf(COid &coid, GlobalCacheEntry *gce, int status, SkipList<COid,GlobalCacheEntry> *b, u64 parm){
+  Ptr<Valbuf> *vbuf = (Ptr<Valbuf> *) parm;
+  if (status==0 && !gce->realTs.isIllegal() &&
+      Timestamp::cmp(gce->realTs, gce->vbuf->commitTs) == 0){ // found
+    *vbuf = gce->vbuf;
+    return 0;
+  }
+  else return -1; // not found
+}
+
+int GlobalCache::lookupReal(COid &coid, Ptr<Valbuf> &vbuf){
+  int res;
+  res = Cache.lookupApply(coid, auxExtractRealVbuf, (u64) &vbuf);
+  return res;
+}
+
 // Removes the cache entry for coid.
 // Returns 0 if item was found and removed, non-zero if not found.
 int GlobalCache::remove(COid &coid){
   return Cache.remove(coid,0);
 }
 
+// parameters of refresh, passed to auxReplaceVbuf
+struct GlobalCacheRefreshParm {
+  Ptr<Valbuf> *vbuf;
+  bool real;
+};
+
 // auxilliary function to be called by refresh.
 // If gce is non-null, check if the passed vbuf (parm) has fresher timestamp; if so,
 //    replace gce->vbuf with a copy of the passed vbuf
 // If gce is null, add a new entry for coid to b, with a copy of the passed vbuf.
 // Returns 0 if the gce entry as created or refreshed, -1 if it was not modified
+
 int GlobalCache::auxReplaceVbuf(COid &coid, GlobalCacheEntry *gce, int status, SkipList<COid,GlobalCacheEntry> *b, u64 parm){
   int res;
-  Ptr<Valbuf> *vbuf = (Ptr<Valbuf> *) parm;
+  GlobalCacheRefreshParm *rp = (GlobalCacheRefreshParm *) parm;
+  Ptr<Valbuf> *vbuf = rp->vbuf;
   if (status){ // not there, insert
     GlobalCacheEntry newgce;
     //gce->coid = (*vbuf)->coid;
     newgce.vbuf = new Valbuf(**vbuf); // make a copy of data
+    if (rp->real) newgce.realTs = (*vbuf)->commitTs;
+    else newgce.realTs.setIllegal();
     assert(COid::cmp(coid, (*vbuf)->coid)==0);
     b->insert(coid, newgce);
     res = 0; // item refreshed
@@ -119,6 +149,8 @@ int GlobalCache::auxReplaceVbuf(COid &coid, GlobalCacheEntry *gce, int status, S
     if (Timestamp::cmp(gce->vbuf->readTs, (*vbuf)->readTs) < 0){ // replace item
       res = 0; // item refreshed
       gce->vbuf = new Valbuf(**vbuf); // make a copy of data
+      if (rp->real) gce->realTs = (*vbuf)->commitTs;
+      else gce->realTs.setIllegal();
     }
     else res = -1; // item not refreshed
   }
@@ -127,16 +159,21 @@ int GlobalCache::auxReplaceVbuf(COid &coid, GlobalCacheEntry *gce, int status, S
 
 // refresh cache if given vbuf is newer than what is in there.
 // Returns 0 if item was refreshed, non-zero if it was not
-int GlobalCache::refresh(Ptr<Valbuf> &vbuf){
+int GlobalCache::refresh(Ptr<Valbuf> &vbuf, bool real){
   int res;
-  res = Cache.lookupApply(vbuf->coid, auxReplaceVbuf, (u64) &vbuf);
+  GlobalCacheRefreshParm rp;
+  rp.vbuf = &vbuf;
+  rp.real = real;
+  res = Cache.lookupApply(vbuf->coid, auxReplaceVbuf, (u64) &rp);
   return res;
 }
 
 // Begins a transaction. If remote=0 then do an in-memory transaction.
 // Otherwise, do it remotely. The function can offset the start timestamp
 // by offsetms (positive means into the past, negative into the future).
-int beginTx(KVTransaction **txp, bool remote, bool deferred){
+// If stalems > 0, a remote transaction may read a snapshot up to stalems old
+// (see Transaction::startStale).
+int beginTx(KVTransaction **txp, bool remote, bool deferred, int stalems){
   KVTransaction *tx;
   tx = *txp = new KVTransaction;
   KVLOG("Tx %p", tx);
@@ -155,6 +192,11 @@ int beginTx(KVTransaction **txp, bool remote, bool deferred){
     if (deferred){
       tx->u.t->startDeferredTs();
     }
+#ifdef GAIA_STALE_READS
+    else if (stalems > 0){
+      tx->u.t->startStale(stalems);
+    }
+#endif
   }
   return 0;
 }
@@ -334,14 +376,17 @@ int KVput3(KVTransaction *tx, COid coid,  char *data1, int len1, char *data2,
 ////  -99 if value is not a supervalue
 ////  <0 for other errors
 int KVreadSuperValue(KVTransaction *tx, COid coid, Ptr<Valbuf> &buf,
-                     ListCell *cell, Ptr<RcKeyInfo> prki){
+                     ListCell *cell, Ptr<RcKeyInfo> prki, Ptr<Valbuf> *base,
+                     bool cellonly){
   int res=-1;
-  if (tx->type==0)
+  if (tx->type==0){
+    if (base) *base = 0; // local storage does not do deltas
     res =  tx->u.lt->vsuperget(coid, buf, cell, prki);
+  }
   else {
     assert(!(coid.cid >> 48 & EPHEMDB_CID_BIT)); // container should not
                                                  // be ephemeral for remote txs
-    res = tx->u.t->vsuperget(coid, buf, cell, prki);
+    res = tx->u.t->vsuperget(coid, buf, cell, prki, base, cellonly);
   }
   if (res) buf=0;
 
@@ -351,11 +396,27 @@ int KVreadSuperValue(KVTransaction *tx, COid coid, Ptr<Valbuf> &buf,
   return res;
 }
 
+int KVreadMany(KVTransaction *tx, int n, COid *coids, Ptr<Valbuf> *bufs,
+               int typ){
+  int i, res, status=0;
+  if (tx->type==0){ // local storage: nothing to gain from parallel reads
+    for (i=0; i < n; ++i){
+      if (typ) res = tx->u.lt->vsuperget(coids[i], bufs[i], 0, 0);
+      else res = tx->u.lt->vget(coids[i], bufs[i]);
+      if (res){ bufs[i]=0; if (!status) status = res; }
+    }
+  }
+  else status = tx->u.t->vgetMany(n, coids, bufs, typ);
+
+  KVLOG("Tx %p n %d typ %d status %d", tx, n, typ, status);
+  return status;
+}
+
 int KVwriteSuperValue(KVTransaction *tx, COid coid, SuperValue *sv){
   tx->readonly = 0;
   KVLOG("Tx %p cid %llx oid %llx nattrs %d ncells %d", tx,
         (long long)coid.cid, (long long)coid.oid, sv->Nattrs, sv->Ncells);
-  assert(sv->CellType == 0 || sv->Ncells == 0 || sv->prki.isset());
+  assert(sv->CellType != 1 || sv->Ncells == 0 || sv->prki.isset());
     // to write non-int cells, must provide prki
 
   if (tx->type==0)
@@ -443,6 +504,29 @@ int KVattrset(KVTransaction *tx, COid coid, u32 attrid, u64 attrval){
   }
   return res;
 }
+
+int KVattradd(KVTransaction *tx, COid coid, u32 attrid, u64 delta){
+  int res=-1;
+  tx->readonly = 0;
+  KVLOG("Tx %p cid %llx oid %llx attrid %d delta %llx", tx,
+        (long long)coid.cid, (long long)coid.oid, attrid, (long long)delta);
+
+  if (tx->type==0)
+    res = tx->u.lt->attrAdd(coid, attrid, delta);
+  else {
+    assert(!(coid.cid >> 48 & EPHEMDB_CID_BIT)); // container should not
+                                                 // be ephemeral for remote txs
+    res = tx->u.t->attrAdd(coid, attrid, delta);
+  }
+  return res;
+}
+
+int KVcachedSuperValue(KVTransaction *tx, COid coid){
+#ifdef GAIA_LEASES
+  if (tx->type != 0) return tx->u.t->hasCachedVersion(coid, 1);
+#endif
+  return 0;
+}
  
 // return whether transaction is read-only so far
 int KVtxreadonly(KVTransaction *tx){
@@ -278,13 +278,133 @@ LogOneObjectInMemory *LogInMemory::getAndLock(COid& coid, bool writelock,
   return looim;
 }
 
+#ifdef LOG_LOCKFREE_READS
+// Reads without the object lock use epochs to know when a withdrawn view
+// can be freed. A reader records the current epoch in its slot while it
+// looks at a view; a view withdrawn at epoch e can be freed once no slot
+// holds an epoch < e.
+static u64 ReadViewEpoch = 1;
+static volatile u64 ReadViewActive[LOG_LOCKFREE_READS_MAXTHREADS]; // 0 if
+                                                  // thread is not reading
+static u32 ReadViewNslots = 0;        // number of slots handed out
+static Tlocal int ReadViewSlot = -1;  // slot of thread, -1 if none yet,
+                                      // -2 if no slots were left
+static Tlocal LooimReadView *ReadViewRetired = 0; // views withdrawn by thread
+static Tlocal int ReadViewNretired = 0;           // and not yet freed
+
+// Per-thread cache of looims. Looims are never removed from COidMap, so a
+// cached pointer stays valid.
+struct LooimCacheEntry {
+  LogInMemory *owner;
+  COid coid;
+  LogOneObjectInMemory *looim;
+};
+static Tlocal LooimCacheEntry LooimCache[LOG_LOCKFREE_READS_LOOIMCACHE];
+
+// free the withdrawn views of this thread that no reader can be looking at
+static void reclaimReadViews(void){
+  LooimReadView *view, **prev;
+  u64 minactive = (u64)-1, e;
+  u32 nslots = ReadViewNslots;
+  if (nslots > LOG_LOCKFREE_READS_MAXTHREADS)
+    nslots = LOG_LOCKFREE_READS_MAXTHREADS;
+  for (u32 i=0; i < nslots; ++i){
+    e = ReadViewActive[i];
+    if (e && e < minactive) minactive = e;
+  }
+  prev = &ReadViewRetired;
+  while ((view = *prev) != 0){
+    if (view->retireepoch <= minactive){
+      *prev = view->next;
+      delete view;
+      --ReadViewNretired;
+    } else prev = &view->next;
+  }
+}
+
+void LogInMemory::retireReadView(LogOneObjectInMemory *looim){
+  LooimReadView *view = looim->readview;
+  if (!view) return;
+  looim->readview = 0;
+  // new readers start at the next epoch, so they cannot see view. This is
+  // also a full barrier, so that callers read LastReadFast only after
+  // withdrawing the view (see readCOidFast)
+  view->retireepoch = AtomicInc64(&ReadViewEpoch);
+  view->next = ReadViewRetired;
+  ReadViewRetired = view;
+  if (++ReadViewNretired >= LOG_LOCKFREE_READS_RECLAIM) reclaimReadViews();
+}
+
+void LogInMemory::publishReadView(LogOneObjectInMemory *looim, Timestamp ts,
+                                  Ptr<TxUpdateCoid> tucoid){
+  LooimReadView *view = new LooimReadView;
+  view->ts = ts;
+  view->tucoid = tucoid;
+  view->retireepoch = 0;
+  view->next = 0;
+  MemBarrier(); // view must be complete before readers can see it
+  looim->readview = view;
+}
+
+int LogInMemory::readCOidFast(COid& coid, Timestamp ts,
+                              Ptr<TxUpdateCoid> &rettucoid, Timestamp *readts){
+  LogOneObjectInMemory *looim;
+  LooimReadView *view;
+  LooimCacheEntry *lce;
+  u64 d1, last;
+  int retval = -1;
+
+  if (ReadViewSlot == -1){
+    u32 n = AtomicInc32(&ReadViewNslots);
+    ReadViewSlot = n <= LOG_LOCKFREE_READS_MAXTHREADS ? (int)n-1 : -2;
+  }
+  if (ReadViewSlot < 0) return -1;
+
+  lce = &LooimCache[COid::hash(coid) % LOG_LOCKFREE_READS_LOOIMCACHE];
+  if (lce->owner == this && COid::cmp(lce->coid, coid) == 0)
+    looim = lce->looim;
+  else {
+    if (COidMap.lookup(coid, looim)) return -1; // not in memory yet
+    lce->owner = this;
+    lce->coid = coid;
+    lce->looim = looim;
+  }
+
+  view = looim->readview;
+  if (!view || Timestamp::cmp(view->ts, ts) > 0) return -1;
+
+  // Record the read before looking at the view again. A transaction
+  // preparing to update the object withdraws the view before reading
+  // LastReadFast, so either it sees our read and commits after it, or we
+  // see the view gone and take the regular path, which waits for it.
+  d1 = ts.getd1();
+  last = looim->LastReadFast;
+  while (last < d1){
+    u64 prev = CompareSwap64(&looim->LastReadFast, last, d1);
+    if (prev == last) break;
+    last = prev;
+  }
+
+  ReadViewActive[ReadViewSlot] = ReadViewEpoch;
+  MemBarrier();
+  view = looim->readview;
+  if (view && Timestamp::cmp(view->ts, ts) <= 0){
+    rettucoid = view->tucoid;
+    if (readts) *readts = view->ts;
+    retval = 0;
+  }
+  MemBarrier();
+  ReadViewActive[ReadViewSlot] = 0;
+  return retval;
+}
+#endif
+
 #ifndef NDEBUG
 static int checkTucoid(Ptr<TxUpdateCoid> tucoid){
   int i;
   int someset=0;
   for (i=0; i < GAIA_MAX_ATTRS; ++i){
-    assert((tucoid->SetAttrs[i] & 1) == tucoid->SetAttrs[i]); // only lowest bit
-                                                              // should be set
+    assert(tucoid->SetAttrs[i] <= 2); // 0=unset, 1=set, 2=add
     if (tucoid->SetAttrs[i]) someset=1;
   }
   if (!someset && tucoid->Litems.empty())
@@ -387,7 +507,9 @@ LogInMemory::NUpdates LogInMemory::applyTucoid(TxWriteSVItem *twsvi,
   for (int i=0; i < GAIA_MAX_ATTRS; ++i){
     if (tucoid->SetAttrs[i]){ // setting attribute
       assert(twsvi->nattrs >= i);
-      twsvi->attrs[i] = tucoid->Attrs[i]; // apply the change
+      if (tucoid->SetAttrs[i] == 2) // adding to attribute
+        twsvi->attrs[i] += tucoid->Attrs[i];
+      else twsvi->attrs[i] = tucoid->Attrs[i]; // apply the change
     }
   }
   for (TxListItem *tli = tucoid->Litems.getFirst();
@@ -453,6 +575,12 @@ int LogInMemory::readCOid(COid& coid, Timestamp ts,
   int type = -1;
   int moveback=0, moveforward=0, moveforwardadd=0, moveforwarddel=0;
   SingleLogEntryInMemory *pendingsleim=0;  
+  Timestamp versionts;
+
+#ifdef LOG_LOCKFREE_READS
+  if (!ts.isIllegal() && readCOidFast(coid, ts, rettucoid, readts) == 0)
+    return 0;
+#endif
 
   // try to find COid in memory
   looim = getAndLock(coid, true, true); assert(looim);
@@ -535,6 +663,7 @@ int LogInMemory::readCOid(COid& coid, Timestamp ts,
 
   proceed_with_read:
 
+  versionts = sleim->ts;
   if (readts) *readts = sleim->ts; // record the timestamp
 
   // now keep moving backwards in log until we find a checkpoint (a full write
@@ -590,8 +719,10 @@ int LogInMemory::readCOid(COid& coid, Timestamp ts,
       // Here update twsvi with the updates in the sleim
       //tucoid = sleim->tucoid;
 
-      if (!twsvi) twsvi = new TxWriteSVItem(*tucoid->WriteSV); // copy WriteSV
-                                                               // in checkpoint
+      // copy WriteSV in checkpoint. The copy shares the bytes of its cells
+      // with the checkpoint, so this costs a walk of the cells, not a copy
+      // of each key and row
+      if (!twsvi) twsvi = new TxWriteSVItem(*tucoid->WriteSV);
       
       NUpdates nupdates = applyTucoid(twsvi, sleim->tucoid);
       assert(nupdates.res==0);
@@ -619,6 +750,14 @@ int LogInMemory::readCOid(COid& coid, Timestamp ts,
     }
   }
 
+#ifdef LOG_LOCKFREE_READS
+  // if we read the newest version and no transaction is preparing to change
+  // it, let subsequent reads take it without the lock
+  if (!looim->readview && looim->pendingentries.empty() &&
+      Timestamp::cmp(looim->logentries.rGetFirst()->ts, versionts) == 0)
+    publishReadView(looim, versionts, tucoid);
+#endif
+
   if (Timestamp::cmp(looim->LastRead, ts) < 0) looim->LastRead = ts;
   rettucoid = tucoid;
   gClog(looim, ts);
@@ -629,6 +768,67 @@ end:
   return retval;
 }
 
+int LogInMemory::readCOidDeltas(COid& coid, Timestamp sincets, Timestamp ts,
+                                Ptr<TxUpdateCoid> *tucoids, int maxtucoids){
+  LogOneObjectInMemory *looim;
+  SingleLogEntryInMemory *sleim;
+  int n = 0;
+
+  looim = getAndLock(coid, false, true); assert(looim);
+
+  // move backwards in log to the last entry <= sincets, which must be at
+  // sincets exactly; otherwise it has been garbage collected
+  for (sleim = looim->logentries.rGetFirst();
+       sleim != looim->logentries.rGetLast();
+       sleim = looim->logentries.rGetNext(sleim)){
+    if (Timestamp::cmp(sleim->ts, sincets) <= 0) break;
+  }
+  if (sleim == looim->logentries.rGetLast() ||
+      Timestamp::cmp(sleim->ts, sincets) != 0){
+    n = -1; goto end;
+  }
+
+  // now move forward collecting the updates up to ts
+  for (sleim = looim->logentries.getNext(sleim);
+       sleim != looim->logentries.getLast() &&
+         Timestamp::cmp(sleim->ts, ts) <= 0;
+       sleim = looim->logentries.getNext(sleim)){
+    if (sleim->flags & SLEIM_FLAG_SNAPSHOT) continue; // subsumed by the
+                                       // entries before it, nothing new
+    if (sleim->tucoid->Writevalue || sleim->tucoid->WriteSV ||
+        n == maxtucoids){
+      n = -1; goto end;
+    }
+    tucoids[n++] = sleim->tucoid;
+  }
+
+ end:
+  looim->unlockRead();
+  return n;
+}
+
+#ifdef GAIA_LEASES
+int LogInMemory::grantLease(COid& coid, Timestamp versionts,
+                            Timestamp leasets){
+  LogOneObjectInMemory *looim;
+  SingleLogEntryInMemory *sleim;
+  int retval = -1;
+
+  looim = getAndLock(coid, true, true); assert(looim);
+  sleim = looim->logentries.rGetFirst();
+  if (looim->pendingentries.empty() && sleim != looim->logentries.rGetLast() &&
+      Timestamp::cmp(sleim->ts, versionts) == 0){
+    // a transaction that prepares later picks a commit timestamp after
+    // LastRead, and one that prepared already would be in pendingentries
+    if (Timestamp::cmp(looim->LastRead, leasets) < 0) looim->LastRead = leasets;
+    if (Timestamp::cmp(looim->LeaseTs, leasets) < 0) looim->LeaseTs = leasets;
+    retval = 0;
+  }
+  looim->unlock();
+  return retval;
+}
+#endif
+
 // after writing, buf will be owned by LogInMemory. Caller should have
 // allocated it and should not free it.
 int LogInMemory::writeCOid(COid& coid, Timestamp ts, Ptr<TxUpdateCoid> tucoid){
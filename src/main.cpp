@@ -89,6 +89,7 @@
 #include "storageserver-splitter.h"
 #include "splitter-client.h"
 #include "clientdir.h"
+#include "replica-server.h"
 extern StorageConfig *SC;
 
 #include "util-more.h"
@@ -113,12 +114,23 @@ RPCProc RPCProcs[] = {  nullRpcStub,         // RPC 0
                         shutdownRpcStub,     // RPC 12
                         startsplitterRpcStub,// RPC 13
                         flushfileRpcStub,    // RPC 14
-                        loadfileRpcStub      // RPC 15
-
+                        loadfileRpcStub,     // RPC 15
 #ifdef STORAGESERVER_SPLITTER
-                        ,
-                        ss_getrowidRpcStub   // RPC 16
+                        ss_getrowidRpcStub,  // RPC 16
+#else
+                        nullRpcStub,         // RPC 16 (unused)
+#endif
+#if defined(STORAGESERVER_SPLITTER) && defined(GAIA_RESOLVE_ORPHANS)
+                        txstatusRpcStub,     // RPC 17
+#else
+                        nullRpcStub,         // RPC 17 (unused)
 #endif
+#if defined(STORAGESERVER_SPLITTER) && defined(GAIA_REPLICAS)
+                        replicateRpcStub,    // RPC 18
+#else
+                        nullRpcStub,         // RPC 18 (unused)
+#endif
+                        attraddRpcStub       // RPC 19
                      };
   
 struct ConsoleCmdMap {
@@ -331,6 +343,9 @@ protected:
     RPCTcp::startupWorkerThread();
 #ifdef STORAGESERVER_SPLITTER
     initServerTask(tgetTaskScheduler());
+#endif
+#ifdef SERVER_REPLICAS
+    replicaInitThread();
 #endif
   }
   
@@ -480,6 +495,9 @@ int main(int argc, char **argv)
 #endif
 
   initStorageServer(hc);
+#ifdef SERVER_REPLICAS
+  replicaInit(cs, myipport);
+#endif
   int myrealport = hc->port; assert(myrealport != 0);
 
   RPCServer = new RPCServerGaia(RPCProcs, sizeof(RPCProcs)/sizeof(RPCProc),
@@ -71,6 +71,30 @@ void ConfigState::addServer(int server, char *hostname, int port, u32 preferip,
   }
 }
 
+void ConfigState::addReplica(int server, char *hostname, int port,
+                             u32 preferip, u32 prefermask){
+  u32 chosenip;
+  IPPort ipport;
+
+  chosenip = IPMisc::resolveName(hostname, preferip, prefermask);
+  if (!chosenip){
+    fprintf(stderr, "Config error: cannot resolve '%s' for replica of "
+            "server %d\n", hostname, server);
+    ++nerrors;
+  } else {
+    ipport.set(chosenip, htons(port));
+    replicaDecls.push_back(pair<int,IPPort>(server, ipport));
+  }
+}
+
+int ConfigState::replicaOf(IPPort ipport){
+  ServerHT *s;
+  for (s = Servers.getFirst(); s != Servers.getLast(); s = Servers.getNext(s))
+    for (int i=0; i < s->nreplicas; ++i)
+      if (IPPort::cmp(s->replicas[i], ipport) == 0) return s->id;
+  return -1;
+}
+
 void ConfigState::addHost(HostConfig *toadd)
 {
   IPPort ipport;
@@ -149,6 +173,24 @@ int ConfigState::check(void){
       ++retval;
     }
   }
+
+  // attach replicas to their servers
+  for (list<pair<int,IPPort>>::iterator it = replicaDecls.begin();
+       it != replicaDecls.end();
+       ++it)
+  {
+    ServerHT *s = Servers.lookup(it->first);
+    if (!s){
+      fprintf(stderr, "Config error: replica of undefined server %d\n",
+              it->first);
+      ++retval;
+    } else if (s->nreplicas == MAX_REPLICAS){
+      fprintf(stderr, "Config error: more than %d replicas for server %d\n",
+              MAX_REPLICAS, it->first);
+      ++retval;
+    } else s->replicas[s->nreplicas++] = it->second;
+  }
+  replicaDecls.clear();
   return retval;
 }
 
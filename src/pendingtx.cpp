@@ -86,6 +86,9 @@ void TxListItem::printShort(COid expectedcoid){
   case 5: // read item
     dynamic_cast<TxReadItem*>(this)->printShort(expectedcoid);
     break;
+  case 6: // attradd
+    dynamic_cast<TxAttrAddItem*>(this)->printShort(expectedcoid);
+    break;
   default:
     printf("*BADTYPE*\n");
     break;
@@ -118,6 +121,9 @@ bool TxListItem::applyItemToTucoid(Ptr<TxUpdateCoid> tucoid, bool cancapture){
   case 5: // read item
     return dynamic_cast<TxReadItem*>(this)->applyItemToTucoid(tucoid,
                                                               cancapture);
+  case 6: // attradd
+    return dynamic_cast<TxAttrAddItem*>(this)->applyItemToTucoid(tucoid,
+                                                                 cancapture);
   default:
     assert(0);
   }
@@ -151,7 +157,7 @@ bool TxWriteItem::applyItemToTucoid(Ptr<TxUpdateCoid> tucoid, bool cancapture){
 
 TxWriteSVItem::TxWriteSVItem(const TxWriteSVItem &r) :
   TxListItem(r.coid, 3, r.level),
-  cells(r.cells, 0)
+  cells(r.cells, 0, ListCellPlus::share, &prki) // cells share bytes with r's
 {
   prki = r.prki;
   nattrs = r.nattrs;
@@ -185,7 +191,8 @@ void TxWriteSVItem::setPrkiSticky(Ptr<RcKeyInfo> prki_arg){
 }
 
 char *TxWriteSVItem::getCelloids(int &retncelloids, int &retlencelloids){
-  if (!celloids) celloids = ListCellsToCelloids(cells, ncelloids, lencelloids);
+  if (!celloids) celloids = ListCellsToCelloids(cells, celltype, ncelloids,
+                                                lencelloids);
   retncelloids = ncelloids;
   retlencelloids = lencelloids;
   return celloids;
@@ -349,6 +356,30 @@ bool TxSetAttrItem::applyItemToTucoid(Ptr<TxUpdateCoid> tucoid,
   return false;
 }
 
+void TxAttrAddItem::printShort(COid expectedcoid){
+  putchar('+');
+}
+
+bool TxAttrAddItem::applyItemToTucoid(Ptr<TxUpdateCoid> tucoid,
+                                      bool cancapture){
+  TxWriteSVItem *twsvi;
+  if (tucoid->Writevalue){ assert(0); return false; }
+  assert(attrid < GAIA_MAX_ATTRS);
+  twsvi = tucoid->WriteSV;
+  if (twsvi) // if there is already a supervalue, change it
+    twsvi->attrs[attrid] += delta;
+  else if (tucoid->SetAttrs[attrid] == 1) // attribute set earlier
+    tucoid->Attrs[attrid] += delta;
+  else {
+    if (!tucoid->SetAttrs[attrid]){
+      tucoid->SetAttrs[attrid] = 2; // mark attribute as added to
+      tucoid->Attrs[attrid] = 0;
+    }
+    tucoid->Attrs[attrid] += delta; // accumulate delta
+  }
+  return false;
+}
+
 void TxReadItem::printShort(COid expectedcoid){
   putchar('R');
 }
@@ -517,7 +548,8 @@ bool TxUpdateCoid::hasConflicts(Ptr<TxUpdateCoid> tucoid,
     return true; // write the value or supervalue
   }
   for (i=0; i < GAIA_MAX_ATTRS; ++i)
-    if (SetAttrs[i] && tucoid->SetAttrs[i]){
+    if (SetAttrs[i] && tucoid->SetAttrs[i] &&
+        (SetAttrs[i] != 2 || tucoid->SetAttrs[i] != 2)){ // adds commute
       dprintf(2, "  vote no because %llx set the same attributes",
               (long long)sleim->ts.getd1());
       return true; // modify the same attributes
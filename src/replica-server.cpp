@@ -0,0 +1,559 @@
+//
+// replica-server.cpp
+//
+// Read-only replicas of a storage server (see GAIA_REPLICAS). The server
+// ships the value of each object it commits to its replicas, which keep the
+// values in memory and serve reads below a safe timestamp that the server
+// advances periodically. Messages belong to an epoch of the server; when a
+// message to a replica fails, or the replica restarts, the server starts a
+// new epoch and the replica drops everything it had.
+//
+
+/*
+  Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <set>
+
+#include "tmalloc.h"
+#include "os.h"
+#include "options.h"
+#include "debug.h"
+#include "util.h"
+#include "datastruct.h"
+#include "datastructmt.h"
+#include "task.h"
+#include "gaiarpcaux.h"
+#include "storageserverstate.h"
+#include "replica-server.h"
+
+#ifdef SERVER_REPLICAS
+#include "clientdir.h"
+#include "clientlib.h"
+
+extern StorageConfig *SC;
+extern StorageServerState *S;
+
+int ReplicaRole = REPLICA_ROLE_NONE;
+
+// ------------------------------ server with replicas -------------------------
+//
+// The safe timestamp sent to replicas is the smallest of (a) a floor that
+// transactions voting yes must propose commit timestamps above, (b) the
+// proposed commit timestamps of transactions that voted yes and have not
+// ended, and (c) the commit timestamps of values not yet acked by all
+// replicas. A new epoch starts with a cutoff above every value sent before,
+// since those values may be lost; the replicas then serve reads from the
+// cutoff on.
+
+static int NReplicas;                 // number of replicas of this server
+static IPPort Replicas[MAX_REPLICAS]; // the replicas
+static RWLock ReplicaLock;            // protects the variables below
+static std::multiset<u64> PendingD1;  // proposed commit timestamps (d1) of
+                                      // transactions that voted yes
+static std::multiset<u64> InflightD1; // commit timestamps (d1) of values not
+                                      // yet acked by all replicas
+static u64 FloorD1;   // transactions voting yes propose a larger d1
+static u64 MaxSentD1; // largest d1 of a value sent to replicas
+static u64 Epoch;     // current epoch
+static u64 CutoffD1;  // cutoff of current epoch
+static u64 Incarnation[MAX_REPLICAS]; // incarnation of each replica in epoch,
+                                      // or 0 if not known yet
+static u64 SentSafeD1[MAX_REPLICAS];  // safe d1 sent to each replica in epoch
+static u64 AckedSafeD1[MAX_REPLICAS]; // safe d1 acked by each replica in epoch
+
+// a committed value that could not be read yet because of pending updates
+// of another transaction; retried periodically
+struct ReplicaRetry {
+  COid coid;
+  Timestamp ts;
+  ReplicaRetry *next, *prev;
+};
+static LinkList<ReplicaRetry> Retries; // protected by ReplicaLock
+
+// a value sent to all replicas
+struct ReplicaShipment {
+  u64 d1;          // d1 of timestamp of value
+  bool inflight;   // whether d1 is in InflightD1
+  Align4 u32 left; // number of replicas yet to answer
+};
+
+// callback data of a REPLICATE RPC
+struct ReplicaCallbackData {
+  ReplicaShipment *ship; // value sent, or 0 if just a safe timestamp
+  int replica;           // index of replica
+  u64 epoch;             // epoch of RPC
+  u64 safed1;            // if ship==0: safe d1 sent, or 0 if none
+};
+
+// Starts a new epoch. Assumes ReplicaLock is held
+static void replicaNewEpoch(void){
+  ++Epoch;
+  CutoffD1 = MaxSentD1+1;
+  for (int i=0; i < NReplicas; ++i)
+    Incarnation[i] = SentSafeD1[i] = AckedSafeD1[i] = 0;
+  dprintf(1, "Replicas: new epoch %llx cutoff %016llx",
+          (long long)Epoch, (long long)CutoffD1);
+}
+
+static void replicaCallback(char *data, int len, void *callbackdata){
+  ReplicaCallbackData *cd = (ReplicaCallbackData*) callbackdata;
+  ReplicateRPCRespData rpcresp;
+  int i = cd->replica;
+  bool ok = false;
+
+  ReplicaLock.lock();
+  if (data){
+    rpcresp.demarshall(data);
+    ok = rpcresp.data->status == 0 &&
+      (!Incarnation[i] || Incarnation[i] == rpcresp.data->incarnation);
+  }
+  if (cd->epoch == Epoch){ // ignore answers from older epochs
+    if (!ok) replicaNewEpoch(); // replica may have lost something
+    else {
+      Incarnation[i] = rpcresp.data->incarnation;
+      if (!cd->ship && AckedSafeD1[i] < cd->safed1)
+        AckedSafeD1[i] = cd->safed1;
+    }
+  }
+  if (cd->ship && AtomicDec32(&cd->ship->left) == 0){
+    if (cd->ship->inflight) InflightD1.erase(InflightD1.find(cd->ship->d1));
+    delete cd->ship;
+  }
+  ReplicaLock.unlock();
+  delete cd;
+}
+
+// sends parm to replica i
+static void replicaSend(int i, ReplicateRPCParm &parm, Ptr<TxUpdateCoid> tucoid,
+                        ReplicaCallbackData *cd){
+  ReplicateRPCData *rpcdata = new ReplicateRPCData;
+  COid coid;
+  coid.cid = parm.cid;
+  coid.oid = parm.oid;
+  rpcdata->data = new ReplicateRPCParm(parm);
+  rpcdata->freedata = true;
+  rpcdata->tucoid = tucoid;
+  SC->Rpcc->asyncRPC(Replicas[i], REPLICATE_RPCNO,
+                     FLAG_HID((u32)COid::hash(coid)),
+                     rpcdata, replicaCallback, cd);
+}
+
+// Sends the value of coid at ts to all replicas. If inflight is set, then
+// the d1 of ts is in InflightD1, to be removed when all replicas answer
+static void replicaShip(COid &coid, Timestamp &ts, Ptr<TxUpdateCoid> tucoid,
+                        bool inflight){
+  ReplicateRPCParm parm;
+  ReplicaShipment *ship;
+  int i;
+
+  parm.cid = coid.cid;
+  parm.oid = coid.oid;
+  parm.ts = ts;
+  parm.safed1 = 0;
+  parm.incarnation = 0;
+  if (tucoid->Writevalue){
+    parm.type = 0;
+    parm.len = tucoid->Writevalue->len;
+    parm.buf = tucoid->Writevalue->buf;
+    parm.nattrs = 0;
+    parm.celltype = 0;
+    parm.ncelloids = parm.lencelloids = 0;
+    parm.attrs = 0;
+    parm.celloids = 0;
+  } else {
+    TxWriteSVItem *twsvi = tucoid->WriteSV;
+    int ncelloids, lencelloids;
+    assert(twsvi);
+    parm.type = 1;
+    parm.len = 0;
+    parm.buf = 0;
+    parm.nattrs = twsvi->nattrs;
+    parm.celltype = twsvi->celltype;
+    parm.celloids = twsvi->getCelloids(ncelloids, lencelloids);
+    parm.ncelloids = twsvi->cells.getNitems();
+    parm.lencelloids = lencelloids;
+    parm.attrs = twsvi->attrs;
+    parm.prki = twsvi->prki;
+  }
+
+  ship = new ReplicaShipment;
+  ship->d1 = ts.getd1();
+  ship->inflight = inflight;
+  ship->left = NReplicas;
+
+  ReplicaLock.lock();
+  if (MaxSentD1 < ship->d1) MaxSentD1 = ship->d1;
+  parm.epoch = Epoch;
+  parm.cutoffd1 = CutoffD1;
+  if (!SC){ // no connections to replicas yet (splitter not started)
+    replicaNewEpoch();
+    if (inflight) InflightD1.erase(InflightD1.find(ship->d1));
+    ReplicaLock.unlock();
+    delete ship;
+    return;
+  }
+  ReplicaLock.unlock();
+
+  for (i=0; i < NReplicas; ++i){
+    ReplicaCallbackData *cd = new ReplicaCallbackData;
+    cd->ship = ship;
+    cd->replica = i;
+    cd->epoch = parm.epoch;
+    cd->safed1 = 0;
+    replicaSend(i, parm, tucoid, cd);
+  }
+}
+
+// Ships the value of coid committed at ts, whose d1 is in InflightD1
+static void replicaShipCommitted(COid &coid, Timestamp &ts){
+  Ptr<TxUpdateCoid> tucoid;
+  int res;
+
+  res = S->cLogInMemory.readCOid(coid, ts, tucoid, 0, 0);
+  if (res == GAIAERR_PENDING_DATA){ // another tx prepared with a smaller ts;
+                                    // retry after it ends
+    ReplicaRetry *retry = new ReplicaRetry;
+    retry->coid = coid;
+    retry->ts = ts;
+    ReplicaLock.lock();
+    Retries.pushTail(retry);
+    ReplicaLock.unlock();
+    return;
+  }
+  if (res){ // cannot read value, so replicas will not get it
+    printf("Warning: readCOid returned %d when replicating\n", res);
+    ReplicaLock.lock();
+    if (MaxSentD1 < ts.getd1()) MaxSentD1 = ts.getd1();
+    replicaNewEpoch();
+    InflightD1.erase(InflightD1.find(ts.getd1()));
+    ReplicaLock.unlock();
+    return;
+  }
+  replicaShip(coid, ts, tucoid, true);
+}
+
+// returns whether tucoid changes the object
+static bool replicaTucoidWrites(Ptr<TxUpdateCoid> tucoid){
+  if (tucoid->Writevalue || tucoid->WriteSV || !tucoid->Litems.empty())
+    return true;
+  for (int i=0; i < GAIA_MAX_ATTRS; ++i) if (tucoid->SetAttrs[i]) return true;
+  return false;
+}
+
+void replicaPrepared(Timestamp &proposecommitts){
+  ReplicaLock.lock();
+  if (proposecommitts.getd1() <= FloorD1) proposecommitts.setAfterd1(FloorD1);
+  PendingD1.insert(proposecommitts.getd1());
+  ReplicaLock.unlock();
+}
+
+void replicaEnded(Ptr<PendingTxInfo> pti, bool committed, Timestamp &committs){
+  SkipListNode<COid,Ptr<TxRawCoid> > *ptr;
+
+  ReplicaLock.lock();
+  if (committed){ // hold back safe timestamp until replicas get the values
+    for (ptr = pti->coidinfo.getFirst(); ptr != pti->coidinfo.getLast();
+         ptr = pti->coidinfo.getNext(ptr))
+      if (replicaTucoidWrites(ptr->value->getTucoid(ptr->key)))
+        InflightD1.insert(committs.getd1());
+  }
+  PendingD1.erase(PendingD1.find(pti->replicats.getd1()));
+  ReplicaLock.unlock();
+  pti->replicats.setIllegal();
+
+  if (!committed) return;
+  for (ptr = pti->coidinfo.getFirst(); ptr != pti->coidinfo.getLast();
+       ptr = pti->coidinfo.getNext(ptr))
+    if (replicaTucoidWrites(ptr->value->getTucoid(ptr->key)))
+      replicaShipCommitted(ptr->key, committs);
+}
+
+void replicaShipRead(COid &coid, Timestamp &ts, Ptr<TxUpdateCoid> tucoid){
+  if (ReplicaRole != REPLICA_ROLE_PRIMARY || ts.isIllegal()) return;
+  replicaShip(coid, ts, tucoid, false);
+}
+
+// periodic event: advances safe timestamp and retries values
+static int replicaTick(void *parm){
+  LinkList<ReplicaRetry> retries;
+  ReplicaRetry *retry;
+  ReplicateRPCParm safeparm[MAX_REPLICAS];
+  Timestamp now;
+  u64 safed1;
+  int i;
+
+  now.setNew();
+  ReplicaLock.lock();
+  if (FloorD1 < now.getd1()) FloorD1 = now.getd1();
+  while (!Retries.empty()) retries.pushTail(Retries.popHead());
+
+  safed1 = FloorD1+1;
+  if (!PendingD1.empty() && *PendingD1.begin() < safed1)
+    safed1 = *PendingD1.begin();
+  if (!InflightD1.empty() && *InflightD1.begin() < safed1)
+    safed1 = *InflightD1.begin();
+
+  for (i=0; i < NReplicas; ++i){
+    safeparm[i].type = -1;
+    safeparm[i].epoch = Epoch;
+    safeparm[i].cutoffd1 = CutoffD1;
+    safeparm[i].safed1 = safeparm[i].incarnation = 0;
+    safeparm[i].cid = safeparm[i].oid = 0;
+    safeparm[i].ts.setIllegal();
+    safeparm[i].len = safeparm[i].nattrs = safeparm[i].celltype = 0;
+    safeparm[i].ncelloids = safeparm[i].lencelloids = 0;
+    safeparm[i].buf = safeparm[i].celloids = 0;
+    safeparm[i].attrs = 0;
+    if (!Incarnation[i]) continue; // send just to learn incarnation
+    if (SentSafeD1[i] >= safed1){ safeparm[i].type = -2; continue; }
+    safeparm[i].safed1 = SentSafeD1[i] = safed1;
+    safeparm[i].incarnation = Incarnation[i];
+  }
+  ReplicaLock.unlock();
+
+  if (SC){
+    for (i=0; i < NReplicas; ++i){
+      if (safeparm[i].type == -2) continue; // nothing new to send
+      ReplicaCallbackData *cd = new ReplicaCallbackData;
+      cd->ship = 0;
+      cd->replica = i;
+      cd->epoch = safeparm[i].epoch;
+      cd->safed1 = safeparm[i].safed1;
+      replicaSend(i, safeparm[i], Ptr<TxUpdateCoid>(), cd);
+    }
+  }
+
+  while (!retries.empty()){
+    retry = retries.popHead();
+    replicaShipCommitted(retry->coid, retry->ts);
+    delete retry;
+  }
+  return 0;
+}
+
+// ----------------------------------- replica ---------------------------------
+
+// a value of an object at a replica
+struct ReplicaVersion {
+  Timestamp ts;
+  Ptr<TxUpdateCoid> tucoid;
+  ReplicaVersion *next, *prev;
+};
+
+// values of an object at a replica, sorted by timestamp
+class ReplicaObject {
+  friend class Ptr<ReplicaObject>;
+private:
+  Align4 int refcount;
+public:
+  RWLock lock;                      // protects versions
+  LinkList<ReplicaVersion> versions;
+  ReplicaObject(){ refcount = 0; }
+  ~ReplicaObject(){
+    while (!versions.empty()) delete versions.popHead();
+  }
+};
+
+static RWLock StoreLock;      // held when changing the variables below or
+                              // adding to Store
+static u64 StoreIncarnation;  // chosen when replica starts
+static u64 StoreEpoch;        // epoch of server
+static u64 StoreCutoffD1;     // cutoff of epoch
+static u64 StoreSafeD1;       // safe d1 in epoch
+static HashTableMT<COid,Ptr<ReplicaObject> > *Store;
+
+static void replicaNewObject(int notfound, Ptr<ReplicaObject> *obj){
+  if (notfound) *obj = new ReplicaObject;
+}
+
+// adds a value of coid at ts. Assumes StoreLock is held
+static void replicaAddVersion(COid &coid, Timestamp &ts,
+                              Ptr<TxUpdateCoid> &tucoid){
+  Ptr<ReplicaObject> *pobj;
+  Ptr<ReplicaObject> obj;
+  ReplicaVersion *v, *first;
+
+  Store->lookupInsert(coid, pobj, replicaNewObject);
+  obj = *pobj; // ok since no one removes from Store without StoreLock
+
+  obj->lock.lock();
+  for (v = obj->versions.rGetFirst(); v != obj->versions.rGetLast();
+       v = obj->versions.rGetNext(v))
+    if (Timestamp::cmp(v->ts, ts) <= 0) break;
+  if (v == obj->versions.rGetLast() || Timestamp::cmp(v->ts, ts) != 0){
+    ReplicaVersion *toadd = new ReplicaVersion;
+    toadd->ts = ts;
+    toadd->tucoid = tucoid;
+    obj->versions.addAfter(toadd, v);
+  }
+  // remove values subsumed by a newer one that is older than LOG_STALE_GC_MS
+  while ((first = obj->versions.getFirst()) != obj->versions.getLast() &&
+         (v = obj->versions.getNext(first)) != obj->versions.getLast() &&
+         v->ts.age() > LOG_STALE_GC_MS){
+    obj->versions.popHead();
+    delete first;
+  }
+  obj->lock.unlock();
+}
+
+int replicaApply(ReplicateRPCParm *parm, u64 &incarnation){
+  Ptr<TxUpdateCoid> tucoid;
+  COid coid;
+  int res=0;
+
+  incarnation = StoreIncarnation;
+  coid.cid = parm->cid;
+  coid.oid = parm->oid;
+
+  // build value before taking lock
+  if (parm->type == 0){
+    TxWriteItem *twi = new TxWriteItem(coid, 0);
+    twi->alloctype = 1;
+    twi->len = parm->len;
+    twi->buf = (char*) malloc(parm->len);
+    memcpy(twi->buf, parm->buf, parm->len);
+    tucoid = new TxUpdateCoid(twi);
+  } else if (parm->type == 1){
+    FullWriteRPCParm fwparm;
+    fwparm.cid = parm->cid;
+    fwparm.oid = parm->oid;
+    fwparm.level = 0;
+    fwparm.nattrs = parm->nattrs;
+    fwparm.celltype = parm->celltype;
+    fwparm.ncelloids = parm->ncelloids;
+    fwparm.lencelloids = parm->lencelloids;
+    fwparm.attrs = parm->attrs;
+    fwparm.celloids = parm->celloids;
+    fwparm.prki = parm->prki;
+    tucoid = new TxUpdateCoid(fullWriteRPCParmToTxWriteSVItem(&fwparm));
+  }
+
+  StoreLock.lock();
+  if (parm->epoch < StoreEpoch) res = GAIAERR_REPLICA_BEHIND; // old message
+  else {
+    if (parm->epoch > StoreEpoch){ // server started new epoch
+      StoreEpoch = parm->epoch;
+      StoreCutoffD1 = parm->cutoffd1;
+      StoreSafeD1 = 0;
+      Store->clear(0, 0);
+    }
+    if (parm->type == -1){
+      if (parm->incarnation && parm->incarnation != StoreIncarnation)
+        res = GAIAERR_REPLICA_BEHIND; // sent to an earlier incarnation
+      else if (parm->incarnation && StoreSafeD1 < parm->safed1)
+        StoreSafeD1 = parm->safed1;
+    }
+    else if (parm->ts.getd1() >= StoreCutoffD1)
+      replicaAddVersion(coid, parm->ts, tucoid);
+  }
+  StoreLock.unlock();
+  return res;
+}
+
+int replicaRead(COid &coid, Timestamp &ts, Ptr<TxUpdateCoid> &tucoid,
+                Timestamp &readts){
+  Ptr<ReplicaObject> obj;
+  ReplicaVersion *v;
+  u64 d1 = ts.getd1();
+  int res;
+
+  if (ts.isIllegal() || d1 < StoreCutoffD1 || d1 >= StoreSafeD1)
+    return GAIAERR_REPLICA_BEHIND;
+  if (Store->lookup(coid, obj)) return GAIAERR_REPLICA_MISS;
+
+  res = GAIAERR_REPLICA_MISS;
+  obj->lock.lockRead();
+  for (v = obj->versions.rGetFirst(); v != obj->versions.rGetLast();
+       v = obj->versions.rGetNext(v)){
+    if (Timestamp::cmp(v->ts, ts) <= 0){
+      tucoid = v->tucoid;
+      readts = v->ts;
+      res = 0;
+      break;
+    }
+  }
+  obj->lock.unlockRead();
+  return res;
+}
+
+// ------------------------------------ common ---------------------------------
+
+void replicaInit(ConfigState *cs, IPPort myipport){
+  ServerHT *s;
+  Timestamp now;
+
+  for (s = cs->Servers.getFirst(); s != cs->Servers.getLast();
+       s = cs->Servers.getNext(s)){
+    if (IPPort::cmp(s->ipport, myipport) == 0 && s->nreplicas){
+      ReplicaRole = REPLICA_ROLE_PRIMARY;
+      NReplicas = s->nreplicas;
+      memcpy(Replicas, s->replicas, NReplicas * sizeof(IPPort));
+      now.setNew();
+      FloorD1 = MaxSentD1 = now.getd1();
+      Epoch = Time::nowus(); // bigger than epochs of earlier runs
+      replicaNewEpoch();
+      printf("Replicas %d\n", NReplicas);
+    }
+  }
+  if (cs->replicaOf(myipport) >= 0){
+    ReplicaRole = REPLICA_ROLE_REPLICA;
+    StoreIncarnation = Time::nowus() ^ UniqueId::getUniqueId();
+    if (!StoreIncarnation) StoreIncarnation = 1;
+    Store = new HashTableMT<COid,Ptr<ReplicaObject> >(COID_CACHE_HASHTABLE_SIZE);
+    printf("Replica of server %d\n", cs->replicaOf(myipport));
+  }
+}
+
+void replicaInitThread(void){
+  static Align4 u32 started = 0;
+  if (ReplicaRole != REPLICA_ROLE_PRIMARY) return;
+  if (CompareSwap32(&started, 0, 1) == 0) // just one thread
+    TaskEventScheduler::AddEvent(tgetThreadNo(), replicaTick, 0, 1,
+                                 GAIA_REPLICAS_SAFETS_MS);
+}
+
+u64 replicaSafeD1(void){
+  u64 safed1;
+  switch(ReplicaRole){
+  case REPLICA_ROLE_REPLICA:
+    return StoreSafeD1;
+  case REPLICA_ROLE_PRIMARY:
+    safed1 = AckedSafeD1[0];
+    for (int i=1; i < NReplicas; ++i)
+      if (AckedSafeD1[i] < safed1) safed1 = AckedSafeD1[i];
+    return safed1;
+  default:
+    return 0;
+  }
+}
+
+#endif
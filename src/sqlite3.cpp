@@ -28834,10 +28834,13 @@ static void sqlite3RefillIndex(Parse *pParse, Index *pIndex, int memRootPage){
   pKey = sqlite3IndexKeyinfo(pParse, pIndex);
   sqlite3VdbeAddOp4(v, OP_OpenWrite, iIdx, tnum, iDb, 
                     (char *)pKey, P4_KEYINFO_HANDOFF);
-  if( memRootPage>=0 ){
-    sqlite3VdbeChangeP5(v, 1);
-  }
+  /* YESQUEL CH: build non-unique indices bottom-up. Unique indices are
+  ** filled one entry at a time since OP_IsUnique must see prior entries */
+  sqlite3VdbeChangeP5(v, (memRootPage>=0 ? 1 : 0) |
+                      (pIndex->onError==OE_None ? OPFLAG_BULKLOAD : 0));
   sqlite3OpenTable(pParse, iTab, iDb, pTab, OP_OpenRead);
+  sqlite3VdbeChangeP5(v, OPFLAG_PREFETCH); /* YESQUEL CH: table is read in
+                                           ** full, so fetch it ahead */
   addr1 = sqlite3VdbeAddOp2(v, OP_Rewind, iTab, 0);
   regRecord = sqlite3GetTempReg(pParse);
   regIdxKey = sqlite3GenerateIndexKey(pParse, pIndex, iTab, regRecord, 1);
@@ -35899,6 +35902,8 @@ static int xferOptimization(
     pKey = sqlite3IndexKeyinfo(pParse, pDestIdx);
     sqlite3VdbeAddOp4(v, OP_OpenWrite, iDest, pDestIdx->tnum, iDbDest,
                       (char*)pKey, P4_KEYINFO_HANDOFF);
+    sqlite3VdbeChangeP5(v, OPFLAG_BULKLOAD); /* YESQUEL CH: source index is
+                                   ** sorted, so build empty index bottom-up */
     VdbeComment((v, "%s", pDestIdx->zName));
     addr1 = sqlite3VdbeAddOp2(v, OP_Rewind, iSrc, 0);
     sqlite3VdbeAddOp2(v, OP_RowKey, iSrc, regData);
@@ -37847,6 +37852,25 @@ SQLITE_PRIVATE void sqlite3Pragma(
     }
   }else
 
+  /*
+  **  PRAGMA [database.]read_staleness
+  **  PRAGMA [database.]read_staleness=N
+  **
+  ** YESQUEL CH: added this pragma. Read transactions may read a snapshot up
+  ** to N ms old, so that they can be served from data that the client read
+  ** recently. 0 (the default) means they read the latest data.
+  */
+  if( sqlite3StrICmp(zLeft,"read_staleness")==0 ){
+    if( !pDb->pBt ) goto pragma_out;
+    if( !zRight ){
+      returnSingleInt(pParse, "read_staleness",
+                      sqlite3BtreeGetReadStaleness(pDb->pBt));
+    }else{
+      sqlite3BtreeSetReadStaleness(pDb->pBt,
+                                   sqlite3AbsInt32(sqlite3Atoi(zRight)));
+    }
+  }else
+
   /*
   **   PRAGMA temp_store
   **   PRAGMA temp_store = "default"|"memory"|"file"
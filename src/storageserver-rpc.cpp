@@ -161,6 +161,15 @@ int attrsetRpcStub(RPCTaskInfo *rti){
   return SchedulerTaskStateEnding;
 }
 
+int attraddRpcStub(RPCTaskInfo *rti){
+  AttrAddRPCData d;
+  Marshallable *resp;
+  d.demarshall(rti->data);
+  resp = attraddRpc(&d);
+  rti->setResp(resp);
+  return SchedulerTaskStateEnding;
+}
+
 int prepareRpcStub(RPCTaskInfo *rti){
   PrepareRPCData d;
   Marshallable *resp;
@@ -240,6 +249,30 @@ int loadfileRpcStub(RPCTaskInfo *rti){
   return SchedulerTaskStateEnding;
 }
 
+#if defined(GAIA_RESOLVE_ORPHANS) && defined(STORAGESERVER_SPLITTER) && \
+    !defined(LOCALSTORAGE)
+int txstatusRpcStub(RPCTaskInfo *rti){
+  TxStatusRPCData d;
+  Marshallable *resp;
+  d.demarshall(rti->data);
+  resp = txstatusRpc(&d);
+  rti->setResp(resp);
+  return SchedulerTaskStateEnding;
+}
+#endif
+
+#if defined(GAIA_REPLICAS) && defined(STORAGESERVER_SPLITTER) && \
+    !defined(LOCALSTORAGE)
+int replicateRpcStub(RPCTaskInfo *rti){
+  ReplicateRPCData d;
+  Marshallable *resp;
+  d.demarshall(rti->data);
+  resp = replicateRpc(&d);
+  rti->setResp(resp);
+  return SchedulerTaskStateEnding;
+}
+#endif
+
 // Auxilliary function to be used by server implementation
 // Wake up a task that was deferred, by sending a wake-up message to it
 void serverAuxWakeDeferred(void *handle){
@@ -74,9 +74,16 @@
 #include "splitter-client.h"
 #include "clientdir.h"
 #include "kvinterface.h"
+#include "clientlib.h"
+#include "replica-server.h"
 extern StorageConfig *SC;
 #endif
 
+#if defined(GAIA_RESOLVE_ORPHANS) && defined(STORAGESERVER_SPLITTER) && \
+    !defined(LOCALSTORAGE)
+#define RESOLVE_ORPHANS // uses the splitter's connections to other servers
+#endif
+
 StorageServerState *S=0;
 
 // if hc==0 then this is for the local storage server
@@ -201,6 +208,11 @@ Marshallable *readRpc(ReadRPCData *d, void *handle, bool &defer){
   coid.cid=d->data->cid;
   coid.oid=d->data->oid;
 
+#ifdef SERVER_REPLICAS
+  if (ReplicaRole == REPLICA_ROLE_REPLICA)
+    res = replicaRead(coid, d->data->ts, tucoid, readts);
+  else
+#endif
   res = S->cLogInMemory.readCOid(coid, d->data->ts, tucoid, &readts, handle);
 
   if (res == GAIAERR_DEFER_RPC){ // defer the RPC
@@ -208,6 +220,10 @@ Marshallable *readRpc(ReadRPCData *d, void *handle, bool &defer){
     return 0;
   }
   if (!res && tucoid->WriteSV) res = GAIAERR_WRONG_TYPE; // wrong type
+#ifdef SERVER_REPLICAS
+  // a replica did not have the object, so send it there
+  if (!res && d->data->replicamiss) replicaShipRead(coid, d->data->ts, tucoid);
+#endif
   resp = new ReadRPCRespData;
   resp->data = new ReadRPCResp;
   if (res<0){
@@ -243,6 +259,11 @@ Marshallable *readRpc(ReadRPCData *d, void *handle, bool &defer){
   }
 
   updateRPCResp(resp->data); // updated piggybacked fields for client caching
+#ifdef SERVER_REPLICAS
+  resp->data->replicasafed1 = replicaSafeD1();
+#else
+  resp->data->replicasafed1 = 0;
+#endif
   
 #ifndef SHORT_OP_LOG
   dprintf(1, "READR    tid %016llx:%016llx coid %016llx:%016llx "
@@ -345,9 +366,18 @@ Marshallable *fullreadRpc(FullReadRPCData *d, void *handle, bool &defer){
     //   (long long) d->data->cell.nKey, (long long) d->data->cell.nKey,
     //   d->data->cell.pKey);
     cell = new ListCellPlus(d->data->cell, d->data->prki);
+#ifdef SERVER_REPLICAS
+    if (ReplicaRole == REPLICA_ROLE_REPLICA) delete cell; // server decides
+    else
+#endif
     ReportAccess(coid, cell);
   }
 #endif  
+#ifdef SERVER_REPLICAS
+  if (ReplicaRole == REPLICA_ROLE_REPLICA)
+    res = replicaRead(coid, d->data->ts, tucoid, readts);
+  else
+#endif
   res = S->cLogInMemory.readCOid(coid, d->data->ts, tucoid, &readts, handle);
 
   if (res == GAIAERR_DEFER_RPC){ // defer the RPC
@@ -355,15 +385,23 @@ Marshallable *fullreadRpc(FullReadRPCData *d, void *handle, bool &defer){
     return 0;
   }
   if (!res && tucoid->Writevalue) res = GAIAERR_WRONG_TYPE; // wrong type
+#ifdef SERVER_REPLICAS
+  // a replica did not have the object, so send it there
+  if (!res && d->data->replicamiss) replicaShipRead(coid, d->data->ts, tucoid);
+#endif
   resp = new FullReadRPCRespData;
   resp->data = new FullReadRPCResp;
   if (res<0){
     resp->data->status = res;
+    resp->data->delta = 0;
     resp->data->readts.setIllegal();
+    resp->data->leasets.setIllegal();
     resp->data->nattrs = 0;
     resp->data->celltype = 0;
     resp->data->ncelloids = 0;
     resp->data->lencelloids = 0;
+    resp->data->cellsbefore = 0;
+    resp->data->cellsafter = 0;
     resp->data->attrs = 0;
     resp->data->celloids = 0;
     resp->freedata = 1;
@@ -386,11 +424,15 @@ Marshallable *fullreadRpc(FullReadRPCData *d, void *handle, bool &defer){
     char *buf = twsvi->getCelloids(ncelloids, lencelloids);
 
     resp->data->status = 0;
+    resp->data->delta = 0;
     resp->data->readts = readts;
+    resp->data->leasets.setIllegal();
     resp->data->nattrs = twsvi->nattrs;
     resp->data->celltype = twsvi->celltype;
     resp->data->ncelloids = twsvi->cells.getNitems();
     resp->data->lencelloids = lencelloids;
+    resp->data->cellsbefore = 0;
+    resp->data->cellsafter = 0;
     resp->data->attrs = twsvi->attrs;
     resp->data->celloids = buf;
     resp->data->prki = twsvi->prki;
@@ -399,9 +441,98 @@ Marshallable *fullreadRpc(FullReadRPCData *d, void *handle, bool &defer){
     resp->deletecelloids = 0; // do not free celloids since it belongs to twsvi
     resp->twsvi = 0;
     resp->tucoid = tucoid;
+
+#if defined(GAIA_LEASES) && !defined(LOCALSTORAGE)
+    // give a lease on the upper levels of a DTree (only SQL tables have
+    // a dbid). Replicas do not see prepares, so they cannot give leases
+    if (
+#ifdef SERVER_REPLICAS
+        ReplicaRole != REPLICA_ROLE_REPLICA &&
+#endif
+        getDbid(coid.cid) != 0 &&
+        twsvi->nattrs >= DTREENODE_NATTRIBS &&
+        !(twsvi->attrs[DTREENODE_ATTRIB_FLAGS] & DTREENODE_FLAG_LEAF) &&
+        twsvi->attrs[DTREENODE_ATTRIB_HEIGHT] >= GAIA_LEASES_MIN_HEIGHT){
+      Timestamp leasets;
+      leasets.setOld(-GAIA_LEASES_MS); // in the future
+      if (Timestamp::cmp(d->data->ts, leasets) < 0 &&
+          !S->cLogInMemory.grantLease(coid, readts, leasets))
+        resp->data->leasets = leasets;
+    }
+#endif
+
+#ifdef GAIA_DELTA_READS
+    // if client has an older copy and log still has the updates since then,
+    // send just those updates (attributes are always sent whole). Replicas
+    // have no log
+    if (!d->data->cachedts.isIllegal() &&
+#ifdef SERVER_REPLICAS
+        ReplicaRole != REPLICA_ROLE_REPLICA &&
+#endif
+        Timestamp::cmp(d->data->cachedts, readts) <= 0){
+      Ptr<TxUpdateCoid> deltas[GAIA_DELTA_READS_MAXENTRIES];
+      int ntucoids, ndeltas, lendeltas;
+      ntucoids = S->cLogInMemory.readCOidDeltas(coid, d->data->cachedts,
+                                       readts, deltas,
+                                       GAIA_DELTA_READS_MAXENTRIES);
+      if (ntucoids >= 0){
+        buf = TucoidsToDeltas(deltas, ntucoids, ndeltas, lendeltas);
+        if (lendeltas < lencelloids){
+          resp->data->delta = 1;
+          resp->data->ncelloids = ndeltas;
+          resp->data->lencelloids = lendeltas;
+          resp->data->celloids = buf;
+          resp->deletecelloids = buf;
+        } else delete [] buf; // no smaller than the whole list
+      }
+    }
+#endif
+
+#ifdef GAIA_POINT_READS
+    // if client seeks a key in a large leaf, send just the last cell before
+    // the key and the cells that follow, which are a piece of celloids
+    if (!resp->data->delta && d->data->cellOnly && d->data->cellPresent &&
+        twsvi->nattrs > DTREENODE_ATTRIB_FLAGS &&
+        (twsvi->attrs[DTREENODE_ATTRIB_FLAGS] & DTREENODE_FLAG_LEAF) &&
+        ncelloids > GAIA_POINT_READS_CELLS &&
+        (!d->data->cell.pKey ||                 // empty keys cannot be
+         d->data->cell.nKey > 0 && d->data->prki.isset())){ // unpacked
+      SkipListNodeBK<ListCellPlus,int> *ptr;
+      ListCellPlus key(d->data->cell, &d->data->prki);
+      int index, first, n, off, prevoff, len;
+
+      // find first cell >= key and its offset within celloids
+      index = off = prevoff = 0;
+      for (ptr = twsvi->cells.getFirst(); ptr != twsvi->cells.getLast() &&
+             ListCellPlus::cmp(*ptr->key, key) < 0;
+           ptr = twsvi->cells.getNext(ptr)){
+        prevoff = off;
+        off += CellSize(ptr->key, twsvi->celltype);
+        ++index;
+      }
+      first = index ? index-1 : 0;
+      n = index-first;
+      len = off-prevoff;
+      for (; n < GAIA_POINT_READS_CELLS && ptr != twsvi->cells.getLast();
+           ptr = twsvi->cells.getNext(ptr)){
+        len += CellSize(ptr->key, twsvi->celltype);
+        ++n;
+      }
+      resp->data->ncelloids = n;
+      resp->data->lencelloids = len;
+      resp->data->celloids = buf + prevoff;
+      resp->data->cellsbefore = first;
+      resp->data->cellsafter = ncelloids - first - n;
+    }
+#endif
   }
 
   updateRPCResp(resp->data); // updated piggybacked fields for client caching
+#ifdef SERVER_REPLICAS
+  resp->data->replicasafed1 = replicaSafeD1();
+#else
+  resp->data->replicasafed1 = 0;
+#endif
 
 #ifndef SHORT_OP_LOG
   dprintf(1, "READSVR  tid %016llx:%016llx coid %016llx:%016llx "
@@ -606,7 +737,8 @@ Marshallable *listaddRpc(ListAddRPCData *d, void *&state){
       goto end;
     }
 
-    if (c2 && ListCellPlus::cmp(*c2,c) == 0){ // found item
+    if (c2 && ListCellPlus::cmp(*c2,c) == 0 &&
+        ListCell::samePayload(*c2, c)){ // found item
       status = 0;
       goto end;
     }
@@ -630,11 +762,12 @@ Marshallable *listaddRpc(ListAddRPCData *d, void *&state){
     size = 0;
   } else {
     ncells = 1; // the add we just did is not included in tucoidcurr
-    size = CellSize(&tlai->item);
+    size = CellSize(&tlai->item, tucoidcurr->WriteSV->celltype);
   }
     
   ncells += tucoidcurr->WriteSV->cells.getNitems();
-  size += ListCellsSize(tucoidcurr->WriteSV->cells);
+  size += ListCellsSize(tucoidcurr->WriteSV->cells,
+                        tucoidcurr->WriteSV->celltype);
 #endif
 
  end:
@@ -748,6 +881,327 @@ Marshallable *attrsetRpc(AttrSetRPCData *d){
   return resp;
 }
 
+Marshallable *attraddRpc(AttrAddRPCData *d){
+  Ptr<PendingTxInfo> pti;
+  AttrAddRPCRespData *resp;
+  Ptr<TxRawCoid> *trcoidptr;
+  Ptr<TxRawCoid> trcoid;
+  COid coid;
+  int res;
+  int status=0;
+
+  assert(S); // if this assert fails, forgot to call initStorageServer()
+  dshowchar('+');
+#ifndef SHORT_OP_LOG
+  dprintf(1, "ATTRADD  tid %016llx:%016llx coid %016llx:%016llx attrid %x "
+          "delta %llx lev %d",
+          (long long)d->data->tid.d1, (long long)d->data->tid.d2,
+          (long long)d->data->cid, (long long)d->data->oid, d->data->attrid,
+          (long long)d->data->attrvalue, d->data->level);
+#else
+  dshortprintf(1, "ATTRADD  %016llx:%016llx attrid %x delta %llx lev %d",
+              (long long)d->data->cid, (long long)d->data->oid, d->data->attrid,
+              (long long)d->data->attrvalue, d->data->level);
+#endif
+
+  coid.cid = d->data->cid;
+  coid.oid = d->data->oid;
+
+  S->cPendingTx.getInfo(d->data->tid, pti);
+
+  res = pti->coidinfo.lookupInsert(coid, trcoidptr);
+  if (res){ *trcoidptr = new TxRawCoid; }
+  trcoid = *trcoidptr;
+  assert(d->data->attrid < GAIA_MAX_ATTRS);
+  TxAttrAddItem *taai = new TxAttrAddItem(coid, d->data->attrid,
+                                          d->data->attrvalue, d->data->level);
+  trcoid->add(taai);
+  resp = new AttrAddRPCRespData;
+  resp->data = new AttrAddRPCResp;
+  resp->data->status = status;
+  resp->freedata = true;
+
+  return resp;
+}
+
+#ifdef RESOLVE_ORPHANS
+//--------------------------- orphan resolution ---------------------------
+// A transaction that voted yes here but whose outcome never arrives (e.g.,
+// because its client died) holds pending entries that defer reads forever.
+// Each server thread keeps the transactions it prepared; if no outcome
+// arrives within GAIA_RESOLVE_ORPHANS_MS, it asks every participant (itself
+// included) about the transaction, determines the outcome, and sends it to
+// all participants. Everything below runs in the thread that owns the tid
+// (see TID_TO_RPCHASHID), so no locks are needed.
+
+struct OrphanQuery;
+
+struct OrphanQueryAnswer {
+  OrphanQuery *query;
+  int status;           // -1 if no answer yet, otherwise TXSTATUS_...
+  Timestamp committs;   // commit ts, or proposed commit ts if prepared
+};
+
+// outstanding TXSTATUS queries for one transaction. Freed when the worker
+// and the callbacks of all RPCs have released it
+struct OrphanQuery {
+  Align4 u32 refcount;
+  int n;
+  OrphanQueryAnswer *answers;
+  OrphanQuery(int nn){
+    n = nn;
+    refcount = n+1;
+    answers = new OrphanQueryAnswer[n];
+    for (int i=0; i < n; ++i){ answers[i].query = this; answers[i].status = -1; }
+  }
+  ~OrphanQuery(){ delete [] answers; }
+  void release(void){ if (AtomicDec32(&refcount) == 0) delete this; }
+};
+
+struct OrphanItem {
+  Tid tid;
+  u64 when;             // deadline of the item in its list
+  OrphanQuery *query;   // outstanding queries, if in OrphanAsked
+  OrphanItem *next, *prev;
+  OrphanItem(){ query = 0; }
+};
+
+// the lists below are ordered by deadline, since each list uses a fixed delay
+Tlocal LinkList<OrphanItem> *OrphanPrepared=0; // voted yes, waiting outcome
+Tlocal LinkList<OrphanItem> *OrphanAsked=0;    // waiting for TXSTATUS answers
+Tlocal LinkList<OrphanItem> *OrphanOutcomes=0; // outcomes to forget
+
+#define ORPHAN_TICK_MS (GAIA_RESOLVE_ORPHANS_MS/10)
+
+static int orphanHandler(void *parm);
+
+static void orphanInit(void){
+  if (OrphanPrepared) return;
+  OrphanPrepared = new LinkList<OrphanItem>(true);
+  OrphanAsked = new LinkList<OrphanItem>(true);
+  OrphanOutcomes = new LinkList<OrphanItem>(true);
+  TaskEventScheduler::AddEvent(tgetThreadNo(), orphanHandler, 0, 1,
+                               ORPHAN_TICK_MS);
+}
+
+static void orphanAdd(LinkList<OrphanItem> *list, Tid &tid, u64 delay){
+  OrphanItem *item = new OrphanItem;
+  item->tid = tid;
+  item->when = Time::now() + delay;
+  list->pushTail(item);
+}
+
+// called when tid votes yes here in a transaction with several servers
+static void orphanWatch(Tid &tid){
+  orphanInit();
+  orphanAdd(OrphanPrepared, tid, GAIA_RESOLVE_ORPHANS_MS);
+}
+
+// called when tid gets an outcome that must be kept for other servers
+static void orphanRememberOutcome(Tid &tid){
+  orphanInit();
+  orphanAdd(OrphanOutcomes, tid, GAIA_RESOLVE_ORPHANS_KEEP_MS);
+}
+
+static void orphanQueryCallback(char *data, int len, void *callbackdata){
+  OrphanQueryAnswer *answer = (OrphanQueryAnswer*) callbackdata;
+  TxStatusRPCRespData rpcresp;
+  if (data){
+    rpcresp.demarshall(data);
+    answer->committs = rpcresp.data->committs;
+    MemBarrier();
+    answer->status = rpcresp.data->status;
+  }
+  answer->query->release();
+}
+
+// returns true if tid still voted yes here without an outcome
+static bool orphanStillPending(Tid &tid, Ptr<PendingTxInfo> &pti){
+  if (S->cPendingTx.getInfoNoCreate(tid, pti)) return false;
+  return pti->status == PTISTATUS_VOTEDYES;
+}
+
+static void orphanAsk(OrphanItem *item, Ptr<PendingTxInfo> &pti){
+  OrphanQuery *query = new OrphanQuery(pti->nparticipants);
+  TxStatusRPCData *rpcdata;
+  item->query = query;
+  for (int i=0; i < pti->nparticipants; ++i){
+    rpcdata = new TxStatusRPCData;
+    rpcdata->data = new TxStatusRPCParm;
+    rpcdata->freedata = true;
+    rpcdata->data->tid = item->tid;
+    SC->Rpcc->asyncRPC(pti->participants[i], TXSTATUS_RPCNO,
+                       FLAG_HID(TID_TO_RPCHASHID(item->tid)), rpcdata,
+                       orphanQueryCallback, &query->answers[i]);
+  }
+}
+
+// Returns the outcome from the answers: 0=commit, 1=abort, or -1 if some
+// answer is missing. If some participant knows the outcome, use it. If all
+// participants voted yes, the client decides to commit with the largest
+// proposed timestamp plus epsilon (see Transaction::auxprepare), so do the
+// same. Releases the query.
+static int orphanOutcome(OrphanItem *item, Timestamp &committs){
+  OrphanQuery *query = item->query;
+  int outcome = 0, status;
+  Timestamp proposedts;
+  proposedts.setLowest();
+  for (int i=0; i < query->n; ++i){
+    status = query->answers[i].status;
+    MemBarrier();
+    if (status == TXSTATUS_COMMITTED){
+      committs = query->answers[i].committs;
+      outcome = 2;
+      break;
+    }
+    if (status == TXSTATUS_ABORTED) outcome = 1;
+    else if (status == TXSTATUS_PREPARED){
+      if (Timestamp::cmp(query->answers[i].committs, proposedts) > 0)
+        proposedts = query->answers[i].committs;
+    }
+    else if (outcome == 0) outcome = -1; // no answer
+  }
+  if (outcome == 2) outcome = 0; // committed somewhere
+  else if (outcome == 0){ // all voted yes
+    committs = proposedts;
+    committs.addEpsilon();
+  }
+  item->query = 0;
+  query->release();
+  return outcome;
+}
+
+static void orphanSendOutcome(Tid &tid, Ptr<PendingTxInfo> &pti, int outcome,
+                              Timestamp &committs){
+  CommitRPCData *rpcdata;
+  dprintf(1, "Resolving orphan tid %016llx:%016llx outcome %d",
+          (long long)tid.d1, (long long)tid.d2, outcome);
+  for (int i=0; i < pti->nparticipants; ++i){
+    rpcdata = new CommitRPCData;
+    rpcdata->data = new CommitRPCParm;
+    rpcdata->freedata = true;
+    rpcdata->data->tid = tid;
+    rpcdata->data->committs = committs;
+    rpcdata->data->commit = outcome;
+    SC->Rpcc->asyncRPC(pti->participants[i], COMMIT_RPCNO,
+                       FLAG_HID(TID_TO_RPCHASHID(tid)), rpcdata, 0, 0);
+  }
+}
+
+// periodic event in each server thread that has prepared some transaction
+static int orphanHandler(void *parm){
+  u64 now = Time::now();
+  OrphanItem *item;
+  Ptr<PendingTxInfo> pti;
+  Timestamp committs;
+  int outcome;
+
+  while (!OrphanOutcomes->empty() &&
+         (item = OrphanOutcomes->getFirst())->when <= now){
+    OrphanOutcomes->popHead();
+    if (!S->cPendingTx.getInfoNoCreate(item->tid, pti) &&
+        (pti->status == PTISTATUS_COMMITTED ||
+         pti->status == PTISTATUS_ABORTED))
+      S->cPendingTx.removeInfo(item->tid);
+    delete item;
+  }
+
+  while (!OrphanAsked->empty() &&
+         (item = OrphanAsked->getFirst())->when <= now){
+    OrphanAsked->popHead();
+    committs.setIllegal();
+    outcome = orphanOutcome(item, committs);
+    if (!orphanStillPending(item->tid, pti)){ delete item; continue; }
+    if (outcome >= 0){
+      orphanSendOutcome(item->tid, pti, outcome, committs);
+      delete item;
+    } else { // some participant did not answer; ask again later
+      item->when = now + GAIA_RESOLVE_ORPHANS_MS;
+      OrphanPrepared->pushTail(item);
+    }
+  }
+
+  while (!OrphanPrepared->empty() &&
+         (item = OrphanPrepared->getFirst())->when <= now){
+    OrphanPrepared->popHead();
+    if (!orphanStillPending(item->tid, pti)){ delete item; continue; }
+    if (!SC){ // no connections to other servers yet (splitter not started)
+      item->when = now + GAIA_RESOLVE_ORPHANS_MS;
+      OrphanPrepared->pushTail(item);
+      continue;
+    }
+    orphanAsk(item, pti);
+    item->when = now + ORPHAN_TICK_MS;
+    OrphanAsked->pushTail(item);
+  }
+  return 0;
+}
+
+// Answers whether tid committed or aborted here. If tid has not voted here,
+// aborts it so that it can no longer commit.
+Marshallable *txstatusRpc(TxStatusRPCData *d){
+  TxStatusRPCRespData *resp;
+  Ptr<PendingTxInfo> pti;
+  int status;
+
+  assert(S); // if this assert fails, forgot to call initStorageServer()
+  dshortprintf(1, "TXSTATUS %016llx:%016llx",
+               (long long)d->data->tid.d1, (long long)d->data->tid.d2);
+
+  resp = new TxStatusRPCRespData;
+  resp->data = new TxStatusRPCResp;
+  resp->data->committs.setIllegal();
+
+  S->cPendingTx.getInfo(d->data->tid, pti); // create if not found
+  switch (pti->status){
+  case PTISTATUS_INPROGRESS: // has not voted; prevent it from voting yes
+    pti->clear();
+    pti->status = PTISTATUS_ABORTED;
+    orphanRememberOutcome(d->data->tid);
+    status = TXSTATUS_ABORTED;
+    break;
+  case PTISTATUS_VOTEDYES:
+    status = TXSTATUS_PREPARED;
+    resp->data->committs = pti->committs; // proposed commit ts
+    break;
+  case PTISTATUS_COMMITTED:
+    status = TXSTATUS_COMMITTED;
+    resp->data->committs = pti->committs;
+    break;
+  default: // voted no or aborted
+    status = TXSTATUS_ABORTED;
+    break;
+  }
+
+  resp->data->status = status;
+  resp->freedata = true;
+  return resp;
+}
+#endif
+
+#ifdef SERVER_REPLICAS
+// Applies a value or safe timestamp sent by the server this host replicates
+Marshallable *replicateRpc(ReplicateRPCData *d){
+  ReplicateRPCRespData *resp;
+
+  assert(S); // if this assert fails, forgot to call initStorageServer()
+  dshortprintf(1, "REPLICATE %016llx:%016llx type %d",
+               (long long)d->data->cid, (long long)d->data->oid,
+               d->data->type);
+
+  resp = new ReplicateRPCRespData;
+  resp->data = new ReplicateRPCResp;
+  if (ReplicaRole != REPLICA_ROLE_REPLICA){ // not a replica
+    resp->data->status = GAIAERR_REPLICA_BEHIND;
+    resp->data->incarnation = 0;
+  } else
+    resp->data->status = replicaApply(d->data, resp->data->incarnation);
+  d->data->prki = Ptr<RcKeyInfo>(); // parm is not destructed
+  resp->freedata = true;
+  return resp;
+}
+#endif
+
 int doCommitWork(CommitRPCParm *parm, Ptr<PendingTxInfo> pti,
                  Timestamp &waitingts); // forward definition
 
@@ -776,6 +1230,9 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
   int vote;
   Timestamp startts, proposecommitts;
   Timestamp dummywaitingts;
+#ifdef GAIA_LEASES
+  Timestamp now;
+#endif
   SkipListNode<COid,Ptr<TxRawCoid> > *ptr;
   SimpleLinkList<LogOneObjectInMemory*> looim_list;
   SimpleLinkListItem<LogOneObjectInMemory*> *looim_list_it;
@@ -811,6 +1268,8 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
     } 
     if (pti->status == PTISTATUS_VOTEDYES){ vote=0; goto end; }
     if (pti->status == PTISTATUS_VOTEDNO){ vote=1; goto end; }
+    if (pti->status == PTISTATUS_COMMITTED ||
+        pti->status == PTISTATUS_ABORTED){ vote=1; goto end; } // see txstatusRpc
     if (pti->status == PTISTATUS_CLEAREDABORT){
       printf("Yesquel critical error: tx status os cleared abort on prepare\n");
       fflush(stdout);
@@ -912,6 +1371,9 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
     }
 #endif
 
+#ifdef GAIA_LEASES
+    now.setNew();
+#endif
     // for each oid in transaction's write set, in order
     for (ptr = pti->coidinfo.getFirst(); ptr != pti->coidinfo.getLast();
          ptr = pti->coidinfo.getNext(ptr)){
@@ -922,9 +1384,19 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
       //looim->printdetail(ptr->key, false);
       looim_list.pushTail(looim); // looims that we locked
 
+#ifdef LOG_LOCKFREE_READS
+      // stop reads without the object lock before checking the last-read
+      // timestamp, so that they are all reflected there
+      LogInMemory::retireReadView(looim);
+#endif
       // check last-read timestamp
-      if (Timestamp::cmp(proposecommitts, looim->LastRead) < 0) 
-        proposecommitts = looim->LastRead; // track largest read timestamp seen
+      if (Timestamp::cmp(proposecommitts, looim->getLastRead()) < 0)
+        proposecommitts = looim->getLastRead(); // track largest read
+                                                // timestamp seen
+#ifdef GAIA_LEASES
+      // LastRead covers the lease, so the tx commits after it ends
+      if (Timestamp::cmp(looim->LeaseTs, now) > 0) pti->updatesLeased = true;
+#endif
 
       // check for conflicts with other transactions in log
       LinkList<SingleLogEntryInMemory> *entries = &looim->logentries; 
@@ -981,6 +1453,22 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
     }
     else { // vote is to commit
       pti->status = PTISTATUS_VOTEDYES;
+#ifdef SERVER_REPLICAS
+      if (ReplicaRole == REPLICA_ROLE_PRIMARY){
+        replicaPrepared(proposecommitts);
+        pti->replicats = proposecommitts;
+      }
+#endif
+#ifdef RESOLVE_ORPHANS
+      if (d->data->nparticipants && !d->data->onephasecommit){
+        pti->nparticipants = d->data->nparticipants;
+        pti->committs = proposecommitts;
+        pti->participants = new IPPort[pti->nparticipants];
+        memcpy(pti->participants, d->data->participants,
+               pti->nparticipants * sizeof(IPPort));
+        orphanWatch(d->data->tid);
+      }
+#endif
       // (4) add entry to in-memory pendingentries
       ptr = pti->coidinfo.getFirst();
       looim_list_it = looim_list.getFirst();
@@ -1073,6 +1561,7 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
   resp->data->vote = vote;
   resp->data->status = status;
   resp->data->mincommitts = proposecommitts;
+  resp->data->leased = pti->updatesLeased;
   resp->freedata = true;
   updateRPCResp(resp->data); // updated piggybacked fields for client caching
 
@@ -1170,7 +1659,7 @@ int doCommitWork(CommitRPCParm *parm, Ptr<PendingTxInfo> pti,
               // split if too many cells
               if (ncells > DTREE_SPLIT_SIZE) toSplit.insert(ptr->key);
               else {
-                int sizecells = ListCellsSize(twsvi->cells);
+                int sizecells = ListCellsSize(twsvi->cells, twsvi->celltype);
                 // split if cell size is too large, but not if too few cells
                 if (sizecells > DTREE_SPLIT_SIZE_BYTES && ncells >= 2)
                   toSplit.insert(ptr->key);
@@ -1221,6 +1710,21 @@ int doCommitWork(CommitRPCParm *parm, Ptr<PendingTxInfo> pti,
     // tucoid in the object's logentries.
   }
 
+#ifdef SERVER_REPLICAS
+  if (!pti->replicats.isIllegal())
+    replicaEnded(pti, parm->commit == 0, parm->committs);
+#endif
+
+#ifdef RESOLVE_ORPHANS
+  if (pti->nparticipants){ // keep outcome for other servers, without writes
+    pti->coidinfo.clear(0,0);
+    pti->status = parm->commit == 0 ? PTISTATUS_COMMITTED : PTISTATUS_ABORTED;
+    pti->committs = parm->committs;
+    orphanRememberOutcome(parm->tid);
+    return status;
+  }
+#endif
+
   // remove information about tid, freeing up memory
   S->cPendingTx.removeInfo(parm->tid);
   return status;
@@ -1254,7 +1758,11 @@ Marshallable *commitRpc(CommitRPCData *d){
     ; // did not find tid. Nothing to do. This is likely because of
       // the GAIA_WRITE_ON_PREPARE optimization
   else {
-    if (pti->status == PTISTATUS_CLEAREDABORT){
+    if (pti->status == PTISTATUS_COMMITTED ||
+        pti->status == PTISTATUS_ABORTED)
+      ; // outcome already applied; both the client and a server resolving
+        // an orphan may send it (see GAIA_RESOLVE_ORPHANS)
+    else if (pti->status == PTISTATUS_CLEAREDABORT){
       printf("Yesquel critical error: tx status is cleared abort on commit\n");
       fflush(stdout);
       abort();
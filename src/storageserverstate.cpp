@@ -63,5 +63,7 @@ StorageServerState::StorageServerState(HostConfig *hc) :
       cDiskStorage(hc->storedir),
       cLogInMemory(&cDiskStorage)
       {
+        for (int i=1; i < hc->nlogfiles; ++i)
+          cDiskLog.addStripe(hc->logfiles[i]);
         cDiskLog.launch();
       }
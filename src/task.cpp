@@ -145,6 +145,8 @@ void TaskInfo::TaskInfoInit(){
   MoreMessages = 0;
   TaskData = 0;
   State = 0;
+  TimerList = 0;
+  TimerLevel = 0;
   next = prev = 0;
 }
 
@@ -203,7 +205,10 @@ TaskScheduler::TaskScheduler(u8 tno, ChannelManager *cmanager){
     ImmediateFuncMap[i] = 0;
   }
   //overflowRetry = 0;
-  TimeOfNextTimedWaiting = ULLONG_MAX;
+  for (i=0; i <= TASKSCHEDULER_TIMERWHEEL_LEVELS; ++i) NTimerLevel[i] = 0;
+  NTimedWaiting = 0;
+  WheelTime = Time::now();
+  for (i=0; i < TASKSCHEDULER_MAX_THREADS/64; ++i) ReadyChannels[i] = 0;
 
   SleepEventFd = eventfd(0, EFD_NONBLOCK); assert(SleepEventFd != -1);
   Asleep = 0;
@@ -277,8 +282,121 @@ void TaskScheduler::createTask(TaskInfo *ti){
 //   return 0;
 // }
 
+#define TW_BITS TASKSCHEDULER_TIMERWHEEL_BITS
+#define TW_LEVELS TASKSCHEDULER_TIMERWHEEL_LEVELS
+#define TW_SLOTS (1<<TW_BITS)
+#define TW_MASK (TW_SLOTS-1)
+
+// adds timed waiting task to timer wheel
+void TaskScheduler::timerAdd(TaskInfo *ti){
+  u64 when = ti->getWakeUpTime();
+  u64 delta;
+  int level;
+
+  ++NTimedWaiting;
+  if (when < WheelTime){ // time already passed
+    ti->TimerList = &TimerDue;
+    ti->TimerLevel = -1;
+    TimerDue.pushTail(ti);
+    return;
+  }
+  delta = when - WheelTime;
+  for (level = 0; level < TW_LEVELS; ++level){
+    if (delta < ((u64)1 << (TW_BITS*(level+1)))) break;
+  }
+  if (level < TW_LEVELS)
+    ti->TimerList = &TimerWheel[level][(when >> (TW_BITS*level)) & TW_MASK];
+  else ti->TimerList = &TimerOverflow;
+  ti->TimerLevel = level;
+  ++NTimerLevel[level];
+  ti->TimerList->pushTail(ti);
+}
+
+// removes timed waiting task from timer wheel
+void TaskScheduler::timerRemove(TaskInfo *ti){
+  assert(ti->TimerList);
+  ti->TimerList->remove(ti);
+  if (ti->TimerLevel >= 0) --NTimerLevel[ti->TimerLevel];
+  --NTimedWaiting;
+  ti->TimerList = 0;
+}
+
+// re-adds the tasks in a list of a given level, which places them in
+// lower levels since the wheel time has advanced
+void TaskScheduler::timerCascade(LinkList<TaskInfo> *list, int level){
+  TaskInfo *ti;
+  int n = list->getNitems(); // tasks may be re-added to the same list
+  while (n--){
+    ti = list->popHead();
+    --NTimerLevel[level];
+    --NTimedWaiting;
+    timerAdd(ti);
+  }
+}
+
+// processes the wheel up to time now, waking up tasks whose time has come
+void TaskScheduler::timerAdvance(u64 now){
+  int level;
+  u64 next, mask;
+  LinkList<TaskInfo> *list;
+
+  while (WheelTime <= now){
+    if (NTimedWaiting == TimerDue.getNitems()){ // nothing in wheel
+      WheelTime = now+1;
+      break;
+    }
+    // skip ahead to the next slot boundary of the lowest non-empty level
+    for (level = 0; level < TW_LEVELS; ++level)
+      if (NTimerLevel[level]) break;
+    if (level > 0){
+      mask = ((u64)1 << (TW_BITS*level))-1;
+      next = (WheelTime & mask) ? (WheelTime | mask) + 1 : WheelTime;
+      if (next > now+1) next = now+1;
+      WheelTime = next;
+      if (WheelTime > now) break;
+    }
+
+    // at a boundary, move tasks from higher levels down
+    if ((WheelTime & TW_MASK) == 0){
+      for (level = 1; level < TW_LEVELS; ++level){
+        list = &TimerWheel[level][(WheelTime >> (TW_BITS*level)) & TW_MASK];
+        timerCascade(list, level);
+        if ((WheelTime >> (TW_BITS*level)) & TW_MASK) break;
+      }
+      if (level == TW_LEVELS) timerCascade(&TimerOverflow, TW_LEVELS);
+    }
+
+    // expire tasks in current slot of level 0
+    list = &TimerWheel[0][WheelTime & TW_MASK];
+    while (!list->empty()) wakeUpTask(list->getFirst());
+    ++WheelTime;
+  }
+
+  while (!TimerDue.empty()) wakeUpTask(TimerDue.getFirst());
+}
+
+// returns a time no later than when the next timed waiting task wakes up,
+// or ULLONG_MAX if there are no such tasks
+u64 TaskScheduler::timerNextWakeUp(){
+  int i, level;
+  u64 t, mask;
+  if (NTimedWaiting == 0) return ULLONG_MAX;
+  if (!TimerDue.empty()) return 0;
+  if (NTimerLevel[0]){
+    for (i=0, t=WheelTime; i < TW_SLOTS; ++i, ++t)
+      if (!TimerWheel[0][t & TW_MASK].empty()) return t;
+    assert(0);
+  }
+  // tasks are in higher levels, so wake up at next boundary where they
+  // cascade down
+  for (level = 1; level < TW_LEVELS; ++level)
+    if (NTimerLevel[level]) break;
+  mask = ((u64)1 << (TW_BITS*level))-1;
+  return (WheelTime & mask) ? (WheelTime | mask) + 1 : WheelTime;
+}
+
 void TaskScheduler::setTaskState(TaskInfo *ti, int newstate){
-  u64 wakeuptime;
+  u64 now;
   if (ti->CurrSchedulerTaskState == newstate) return;
   switch(ti->CurrSchedulerTaskState){
   case SchedulerTaskStateNew:
@@ -290,7 +408,7 @@ void TaskScheduler::setTaskState(TaskInfo *ti, int newstate){
     WaitingTasks.remove(ti);
     break;
   case SchedulerTaskStateTimedWaiting: 
-    TimedWaitingTasks.remove(ti);
+    timerRemove(ti);
     break;
   case SchedulerTaskStateEnding: 
     break;
@@ -309,10 +427,11 @@ void TaskScheduler::setTaskState(TaskInfo *ti, int newstate){
     WaitingTasks.pushTail(ti);
     break;
   case SchedulerTaskStateTimedWaiting: 
-    TimedWaitingTasks.pushTail(ti);
-    wakeuptime = ti->getWakeUpTime();
-    if (wakeuptime < TimeOfNextTimedWaiting)
-      TimeOfNextTimedWaiting = wakeuptime;
+    if (NTimedWaiting == 0){ // wheel is empty, so bring it to current time
+      now = Time::now();
+      if (now > WheelTime) WheelTime = now;
+    }
+    timerAdd(ti);
     break;
   case SchedulerTaskStateEnding:
     break;
@@ -327,27 +446,20 @@ void TaskScheduler::wakeUpTask(TaskInfo *ti){
     RunningTasks.pushTail(ti);
     ti->CurrSchedulerTaskState = SchedulerTaskStateRunning;
   } else if (ti->CurrSchedulerTaskState == SchedulerTaskStateTimedWaiting){
-    TimedWaitingTasks.remove(ti);
+    timerRemove(ti);
     RunningTasks.pushTail(ti);
     ti->CurrSchedulerTaskState = SchedulerTaskStateRunning;
   }
 }
 
 // returns 0 if no incoming messages, != 0 otherwise
+// Senders set a bit in ReadyChannels after enqueuing, so there can only
+// be messages in channels whose bit is set.
 int TaskScheduler::hasIncomingMessages(){
-  int srcthread;
-  int nthreads = CManager->getNthreads();
-  int threadno = tgetThreadNo();
-  Channel<TaskMsg> *ch;
-  int empty;
-
-  for (srcthread=0; srcthread < nthreads; ++srcthread){
-    ch = CManager->getChannel(threadno, srcthread);
-    if (!ch) continue;
-
-    empty = ch->empty();
-    if (!empty) return -1;
-  }
+  int i;
+  int nwords = (CManager->getNthreads()+63)/64;
+  for (i=0; i < nwords; ++i)
+    if (ReadyChannels[i]) return -1;
   return 0;
 }
 
@@ -371,8 +483,19 @@ int TaskScheduler::processIncomingMessages(){
   TaskMsg *msg;
   ImmediateFunc itf;
   int something = 0; // whether some message was processed or not
+  int word;
+  u64 ready = 0;
 
   for (srcthread=0; srcthread < nthreads; ++srcthread){
+    // consult the bitmap of ready channels, one word at a time. The word is
+    // cleared before the channels are drained, so a message enqueued after
+    // this point sets its bit again and is not missed
+    if ((srcthread & 63) == 0){
+      word = srcthread / 64;
+      if (!ReadyChannels[word]){ srcthread += 63; continue; }
+      ready = AtomicExchange64(&ReadyChannels[word], 0);
+    }
+    if (!(ready & ((u64)1 << (srcthread & 63)))) continue;
     ch = CManager->getChannel(threadno, srcthread);
     if (!ch) continue;
 
@@ -429,7 +552,6 @@ int TaskScheduler::runOnce(){
   int tstate;
   TaskInfo *ti, *nextti;
   int nrunning;
-  u64 now;
   int something = 0; // whether something happened or not
   int res;
 
@@ -438,23 +560,7 @@ int TaskScheduler::runOnce(){
   if (res) something = 1;
 
   // check tasks that are waiting for some specific time
-  now = Time::now();
-  if (now >= TimeOfNextTimedWaiting){
-    u64 nextearliest=ULLONG_MAX;
-    u64 taskwakeup;
-    // loop over all timed waiting tasks to see which ones should execute
-    ti = TimedWaitingTasks.getFirst();
-    while (ti != TimedWaitingTasks.getLast()){
-      nextti = TimedWaitingTasks.getNext(ti);
-      taskwakeup = ti->getWakeUpTime();
-      if (taskwakeup <= now){
-        wakeUpTask(ti);
-      } else if (taskwakeup < nextearliest)
-        nextearliest = taskwakeup; // remember the next earliest one
-      ti = nextti;
-    }
-    TimeOfNextTimedWaiting = nextearliest;
-  }
+  if (NTimedWaiting) timerAdvance(Time::now());
 
   // execute running tasks
   nrunning = 0;
@@ -509,7 +615,7 @@ int TaskScheduler::runOnce(){
 
 // assumes that tinit() has been previously executed once by thread
 void TaskScheduler::run(){
-  int n, something, timeout=0;
+  int n, something, timeout, idle=0;
   eventfd_t eventdummy;
   int sleepeventfd = getSleepEventFd();
   struct pollfd ev;
@@ -518,14 +624,16 @@ void TaskScheduler::run(){
 
   while (!ForceEnd){
     something = runOnce();
-    if (!something){ // start sleep cycle
-      setAsleep(1);
-      timeout = findSleepTimeout();
-      //printf("TaskScheduler::run() going to sleep for %d\n", timeout);
-    } else timeout = 0;
+    // while busy or only briefly idle, keep running without system calls
+    if (something){ idle = 0; continue; }
+    if (++idle < TASKSCHEDULER_IDLE_SPIN) continue;
+    idle = 0;
+    setAsleep(1); // start sleep cycle
+    timeout = findSleepTimeout();
+    //printf("TaskScheduler::run() going to sleep for %d\n", timeout);
     n = poll(&ev, 1, timeout);
     //printf("TaskScheduler::run() woke up\n");
-    if (!something) setAsleep(0);
+    setAsleep(0);
 
     if (n==1){
       assert(ev.fd == sleepeventfd);
@@ -535,7 +643,7 @@ void TaskScheduler::run(){
 }
 
 int TaskScheduler::findSleepTimeout(){
-  u64 now;
+  u64 now, next;
   int res = -1; // by default, can sleep forever
   if (hasIncomingMessages()) return 0; // no sleeping since there are
                                         // incoming messages
@@ -545,9 +653,10 @@ int TaskScheduler::findSleepTimeout(){
   if (NewTasks.getFirst() != NewTasks.getLast()) return 0; //there are new tasks
   
   // check for timed waiting tasks
-  if (TimeOfNextTimedWaiting != ULLONG_MAX){
+  next = timerNextWakeUp();
+  if (next != ULLONG_MAX){
     now = Time::now();
-    res = TimeOfNextTimedWaiting - now;
+    res = next > now ? (int)(next - now) : 0;
   }
   return res;
 }
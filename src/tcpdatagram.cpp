@@ -45,6 +45,10 @@
 #include <sys/eventfd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <math.h>
@@ -92,10 +96,9 @@ void TCPDatagramCommunication::updateState(int handlerid, ReceiveState &s,
 
   if (s.Filled == totalsize){   // we filled everything exactly
     // call application handler
-    tmb =  new TaskMultiBuffer(s.Buf, 1); // TaskMultiBuffer is used to
-                                          // later free s.Buf
-    handleMsg(handlerid, &src, header->req, header->xid, header->flags,
-              tmb, s.Buf+sizeof(DatagramMsgHeader), header->size);
+    tmb =  new TaskMultiBuffer(s.Buf, countMsgs(header)); // TaskMultiBuffer
+                                          // is used to later free s.Buf
+    deliverMsg(handlerid, src, tmb, s.Buf);
     
     s.Buf = (char*) malloc(TCP_RECLEN_DEFAULT); assert(s.Buf);
     s.Ptr = s.Buf;
@@ -113,10 +116,11 @@ void TCPDatagramCommunication::updateState(int handlerid, ReceiveState &s,
 #define MAXREQUESTSPERRECEIVE 10000
   char *bufs[MAXREQUESTSPERRECEIVE];
   int bufindex = 0;
-  char *bufnewreq;
+  int nmsgs; // number of messages, counting those inside batch frames
 
   bufs[bufindex] = s.Buf;
   ++bufindex; assert(bufindex < MAXREQUESTSPERRECEIVE);
+  nmsgs = countMsgs(header);
 
   while (extrasize > sizeof(DatagramMsgHeader) &&
          extrasize >= sizeof(DatagramMsgHeader) +
@@ -128,13 +132,14 @@ void TCPDatagramCommunication::updateState(int handlerid, ReceiveState &s,
     assert(((DatagramMsgHeader*) extraptr)->cookie == REQ_HEADER_COOKIE);
     bufs[bufindex] = extraptr;
     ++bufindex; assert(bufindex < MAXREQUESTSPERRECEIVE);
+    nmsgs += countMsgs((DatagramMsgHeader*) extraptr);
     extrasize -= sizenewreq;
     extraptr += sizenewreq;
   }
 
   // now extraptr and extrasize still refers to an incomplete chunk at the end
-  tmb = new TaskMultiBuffer(s.Buf, bufindex); // TaskMultiBuffer is used to
-                   // later free s.Buf. It will expect bufindex requests
+  tmb = new TaskMultiBuffer(s.Buf, nmsgs); // TaskMultiBuffer is used to
+                   // later free s.Buf. It will expect nmsgs requests
                    // before freeing s.Buf
   if (extrasize <= TCP_RECLEN_DEFAULT){
     newlen = TCP_RECLEN_DEFAULT;
@@ -153,31 +158,46 @@ void TCPDatagramCommunication::updateState(int handlerid, ReceiveState &s,
   s.Filled = (int)(s.Ptr-s.Buf);
 
   // call application handler for all complete requests
-  for (int i=0; i < bufindex; ++i){
-    bufnewreq = bufs[i];
-    header = (DatagramMsgHeader*) bufnewreq;
-    assert(header->cookie == REQ_HEADER_COOKIE);
-    sizenewreq = sizeof(DatagramMsgHeader) + header->size;
+  for (int i=0; i < bufindex; ++i)
+    deliverMsg(handlerid, src, tmb, bufs[i]);
+}
 
-    // call application handler
-    header = (DatagramMsgHeader*) bufnewreq;
+void TCPDatagramCommunication::deliverMsg(int handlerid, IPPort src,
+                                          TaskMultiBuffer *tmb, char *buf){
+  DatagramMsgHeader *header = (DatagramMsgHeader*) buf;
+  char *end, *next;
+  assert(header->cookie == REQ_HEADER_COOKIE);
+  if (!(header->flags & FLAG_BATCH)){
     handleMsg(handlerid, &src, header->req, header->xid, header->flags,
-              tmb, bufnewreq+sizeof(DatagramMsgHeader), header->size);
-
-    //if ((int)header->size < minsize) minsize = header->size;
-    //if ((int)header->size > maxsize) maxsize = header->size;
+              tmb, buf+sizeof(DatagramMsgHeader), header->size);
+    return;
+  }
+  // batch frame
+  end = buf + sizeof(DatagramMsgHeader) + header->size;
+  buf += sizeof(DatagramMsgHeader);
+  while (buf < end){
+    header = (DatagramMsgHeader*) buf;
+    assert(header->cookie == REQ_HEADER_COOKIE &&
+           !(header->flags & FLAG_BATCH));
+    // find next message before calling handler, which may free buffer
+    next = buf + sizeof(DatagramMsgHeader) + header->size;
+    handleMsg(handlerid, &src, header->req, header->xid, header->flags,
+              tmb, buf+sizeof(DatagramMsgHeader), header->size);
+    buf = next;
   }
 }
 
 struct TaskMsgDataAddIPPortFd {
-  TaskMsgDataAddIPPortFd(IPPort i, i64 f, i64 h){
+  TaskMsgDataAddIPPortFd(IPPort i, i64 f, i64 h, ShmConn *s){
     ipport = i;
     fd = f;
     handlerid = h;
+    shm = s;
   }
   IPPort ipport;
   i64 fd;
   i64 handlerid;
+  ShmConn *shm;
 };
 
 // add fd to list of fds being monitored by one of the worker threads,
@@ -186,9 +206,10 @@ struct TaskMsgDataAddIPPortFd {
 // workerno indicates which of the workers will handle this fd. That number
 // will be mod'ed by the actual number of workers in the system.
 void TCPDatagramCommunication::startReceiving(IPPort ipport, int fd,
-                                              int handlerid, int workerno){
+                                              int handlerid, int workerno,
+                                              ShmConn *shm){
   // ask worker thread to start handling fd+ipport
-  TaskMsgDataAddIPPortFd addmsg(ipport, fd, handlerid);
+  TaskMsgDataAddIPPortFd addmsg(ipport, fd, handlerid, shm);
   sendIFMsg(gContext.hashThread(TCLASS_WORKER, workerno),
             IMMEDIATEFUNC_ADDIPPORTFD, (void*) &addmsg,
             sizeof(TaskMsgDataAddIPPortFd));
@@ -205,6 +226,7 @@ void TCPDatagramCommunication::immediateFuncAddIPPortFd(TaskMsgData &msgdata,
     tgetSharedSpace(THREADCONTEXT_SPACE_TCPDATAGRAM);
   int epfd = (int) (long long)
     tgetSharedSpace(THREADCONTEXT_SPACE_TCPDATAGRAM_WORKER);
+  int myworkerno = gContext.indexWithinClass(TCLASS_WORKER, tgetThreadNo());
   int res;
 
   // initialize TCPSTreamState for this new connection
@@ -218,17 +240,73 @@ void TCPDatagramCommunication::immediateFuncAddIPPortFd(TaskMsgData &msgdata,
   tss->rstate.Filled = 0;
   tss->sendeagain = 0;
 
-  tdc->IPPortMap.insert(addmsg->ipport, tss); // associate ip-port with
-                                              // TCPStreamState just created
+  tdc->IPPortMap[myworkerno].insert(addmsg->ipport, tss); // associate ip-port
+                                      // with TCPStreamState just created
   
   // add fd to list of things being watched
   struct epoll_event ev;
+  if (addmsg->shm){ // shared-memory connection
+    tss->shm = addmsg->shm;
+    // watch doorbell, and Unix socket to learn if other end goes away
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = (void*) tss;
+    res = epoll_ctl(epfd, EPOLL_CTL_ADD, tss->shm->wakefd, &ev);
+    assert(res==0);
+    ev.events = EPOLLRDHUP | EPOLLHUP | EPOLLET;
+    res = epoll_ctl(epfd, EPOLL_CTL_ADD, addmsg->fd, &ev); assert(res==0);
+    tdc->ShmConns[myworkerno].insert(TCPStreamStatePtr(tss));
+    return;
+  }
   ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLHUP | EPOLLET;
   ev.data.ptr = (void*) tss;
   res = epoll_ctl(epfd, EPOLL_CTL_ADD, addmsg->fd, &ev); assert(res==0);
 }
 
-void TCPDatagramCommunication::sendTss(TCPStreamState *tss){
+// Groups entries of the send queue that were not yet placed in a batch.
+// Each group of consecutive entries becomes a batch frame: its first entry
+// gets an extra iovec at the beginning with the batch header. Since
+// placement never changes, an entry that was partially sent is later
+// resent with the same layout.
+void TCPDatagramCommunication::assignBatches(TCPStreamState *tss){
+  SendQueueEntry *sqe, *first;
+  int nmsgs, size;
+
+  // skip entries already placed (they are at the beginning of the queue)
+  sqe = tss->sendQueue.getFirst();
+  while (sqe && sqe->batched) sqe = tss->sendQueue.getNext(sqe);
+
+  while (sqe){
+    first = sqe;
+    nmsgs = 0;
+    size = 0;
+    // an entry without a spare iovec cannot start a batch
+    if (first->nbufs < MAXIOVECSERIALIZE){
+      while (sqe && nmsgs < TCP_BATCH_MAXMSGS && size < TCP_RECLEN_DEFAULT){
+        ++nmsgs;
+        size += sqe->nbytes;
+        sqe->batched = 1;
+        sqe = tss->sendQueue.getNext(sqe);
+      }
+    }
+    if (nmsgs <= 1){ // goes alone
+      first->batched = 1;
+      sqe = tss->sendQueue.getNext(first);
+      continue;
+    }
+    first->batchheader.cookie = REQ_HEADER_COOKIE;
+    first->batchheader.flags = FLAG_BATCH;
+    first->batchheader.size = size;
+    first->batchheader.req = nmsgs;
+    first->batchheader.xid = 0;
+    memmove(first->bufs+1, first->bufs, first->nbufs * sizeof(iovec));
+    first->bufs[0].iov_base = (char*) &first->batchheader;
+    first->bufs[0].iov_len = sizeof(DatagramMsgHeader);
+    ++first->nbufs;
+    first->nbytes += sizeof(DatagramMsgHeader);
+  }
+}
+
+int TCPDatagramCommunication::sendTss(TCPStreamState *tss){
   int firstbuf, firstoff;
   int byteslefttoskip; // bytes left to skip
   SendQueueEntry *sqe;
@@ -237,8 +315,12 @@ void TCPDatagramCommunication::sendTss(TCPStreamState *tss){
   int currbuf;
   int nreqscombined;
   int nbufscombined;
+  int nsent = 0;
 
-  if (!tss->sendQueue.getFirst()) return;
+  if (!tss->sendQueue.getFirst()) return 0;
+#if TCP_BATCH_MAXMSGS > 1
+  assignBatches(tss);
+#endif
   bufs = new iovec[SEND_IOVEC_QUEUESIZE];
   
   do {
@@ -288,7 +370,13 @@ void TCPDatagramCommunication::sendTss(TCPStreamState *tss){
     assert(currbuf >= 1);
     tss->sendeagain = 0;
 
-    nbytes = writev(tss->fd, bufs, currbuf);
+    if (tss->shm){
+      nbytes = tss->shm->write(bufs, currbuf);
+      if (nbytes == 0){ // ring is full; other end will ring doorbell
+        tss->sendeagain = 1;
+        break;
+      }
+    } else nbytes = writev(tss->fd, bufs, currbuf);
     if (nbytes <= 0){ // could not write anything
       if (errno == EAGAIN) tss->sendeagain = 1;
       if (nbytes == 0 || errno == EAGAIN) break;
@@ -303,6 +391,7 @@ void TCPDatagramCommunication::sendTss(TCPStreamState *tss){
         if (sqe->dmsg.freedata) delete sqe->dmsg.data;
         tss->sendQueue.popHead();
         delete sqe;
+        ++nsent;
       } else { // nbytes < sqe->nbytes
         tss->sendQueueBytesSkip = nbytes;
         break;
@@ -315,6 +404,7 @@ void TCPDatagramCommunication::sendTss(TCPStreamState *tss){
   } while (!tss->sendQueue.empty());
  end:
   delete [] bufs;
+  return nsent;
 }
 
 // these are intended to be overloaded by child classes
@@ -330,6 +420,8 @@ OSTHREAD_FUNC TCPDatagramCommunication::workerThread(void *parm){
   TaskScheduler *ts = tgetTaskScheduler();
   int epfd = epoll_create1(0); assert(epfd != -1);
   eventfd_t eventdummy;
+  tdc->workerRegSync.wait(INFINITE); // gContext must know us before we
+                                     // compute our index
   int myworkerno = gContext.indexWithinClass(TCLASS_WORKER, tgetThreadNo());
   
   tsetSharedSpace(THREADCONTEXT_SPACE_TCPDATAGRAM, tdc);
@@ -338,6 +430,7 @@ OSTHREAD_FUNC TCPDatagramCommunication::workerThread(void *parm){
   
   ts->assignImmediateFunc(IMMEDIATEFUNC_ADDIPPORTFD, immediateFuncAddIPPortFd);
   ts->assignImmediateFunc(IMMEDIATEFUNC_SEND, immediateFuncSend);
+  ts->assignImmediateFunc(IMMEDIATEFUNC_DELSHMCONN, immediateFuncDelShmConn);
 
   tdc->startupWorkerThread(); // invokes startup code
 
@@ -357,6 +450,13 @@ OSTHREAD_FUNC TCPDatagramCommunication::workerThread(void *parm){
   
   int something;
   int timeout=0;
+  int lastnsent=0; // most messages sent to a connection in last iteration
+  int shmidle=0;    // idle iterations while polling shared-memory rings
+  int shmpolling=1; // whether peers know we are polling our rings
+  // spinning only helps if peers can run on other processors meanwhile
+  int shmspin = getNProcessors() > 1 ? TCP_SHM_IDLE_SPIN : 0;
+  Set<TCPStreamStatePtr> *shmconns = &tdc->ShmConns[myworkerno];
+  SetNode<TCPStreamStatePtr> *shmit;
 
   tdc->workerInitSync.signal(); // indicate that we have initialized
   
@@ -366,22 +466,56 @@ OSTHREAD_FUNC TCPDatagramCommunication::workerThread(void *parm){
                   // things to the epoll set:
                   //     after adding, must receive anything that already exists
 
+    // poll rings of shared-memory connections
+    for (shmit = shmconns->getFirst(); shmit != shmconns->getLast();
+         shmit = shmconns->getNext(shmit))
+      if (tdc->receiveShm(shmit->key.tssptr)) something = 1;
+
     // go through pendingsends and send anything for which we did not get
     // EAGAIN before
     if (!tdc->PendingSendsBeforeEpoll[myworkerno].empty()){
       SetNode<TCPStreamStatePtr> *it;
       TCPStreamState *tssptr;
+      int nsent;
+#if TCP_BATCH_WINDOW_US > 0
+      // under load, collect more messages so they go in the same batch
+      if (lastnsent > 1){
+        u64 deadline = Time::nowus() + TCP_BATCH_WINDOW_US;
+        while (Time::nowus() < deadline && !tdc->ForceEndThreads)
+          something |= ts->runOnce();
+      }
+#endif
+      lastnsent = 0;
       for (it = tdc->PendingSendsBeforeEpoll[myworkerno].getFirst();
            it != tdc->PendingSendsBeforeEpoll[myworkerno].getLast();
            it = tdc->PendingSendsBeforeEpoll[myworkerno].getNext(it)){
         tssptr = it->key.tssptr;
         assert(!tssptr->sendeagain);
-        tdc->sendTss(tssptr);
+        nsent = tdc->sendTss(tssptr);
+        if (nsent > lastnsent) lastnsent = nsent;
       }
       tdc->PendingSendsBeforeEpoll[myworkerno].clear();
     }
     
+    if (!shmconns->empty()){
+      if (something) shmidle = 0;
+      else if (++shmidle < shmspin) something = 1; // keep polling
+      else {
+        // about to sleep: ask peers to ring doorbell, then check rings
+        // again in case they wrote before seeing this
+        for (shmit = shmconns->getFirst(); shmit != shmconns->getLast();
+             shmit = shmconns->getNext(shmit))
+          shmit->key.tssptr->shm->recvring->consumerPolling = 0;
+        shmpolling = 0;
+        MemBarrier();
+        for (shmit = shmconns->getFirst(); shmit != shmconns->getLast();
+             shmit = shmconns->getNext(shmit))
+          if (tdc->receiveShm(shmit->key.tssptr)) something = 1;
+      }
+    }
+
     if (!something){ // start sleep cycle
+      lastnsent = 0; // not under load
       ts->setAsleep(1);
       timeout = ts->findSleepTimeout();
       //printf("Going to sleep for %d\n", timeout);
@@ -389,6 +523,13 @@ OSTHREAD_FUNC TCPDatagramCommunication::workerThread(void *parm){
     
     n = epoll_wait(epfd, epevents, MAX_EPOLL_EVENTS, timeout);
     if (!something) ts->setAsleep(0);
+    if (!shmpolling){ // poll rings again
+      for (shmit = shmconns->getFirst(); shmit != shmconns->getLast();
+           shmit = shmconns->getNext(shmit))
+        shmit->key.tssptr->shm->recvring->consumerPolling = 1;
+      shmpolling = 1;
+      shmidle = 0;
+    }
       
     for (i=0; i < n; ++i){
       tss = (TCPStreamState*) epevents[i].data.ptr;
@@ -397,6 +538,18 @@ OSTHREAD_FUNC TCPDatagramCommunication::workerThread(void *parm){
         eventfd_read(sleepeventfd, &eventdummy);
         continue;
       }
+      if (tss->fd < 0) continue; // connection was closed
+      if (tss->shm){ // shared-memory connection
+        if (epevents[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
+          tdc->closeShm(tss); // other end went away
+          continue;
+        }
+        // doorbell: data arrived or space freed up
+        eventfd_read(tss->shm->wakefd, &eventdummy);
+        tdc->receiveShm(tss);
+        tdc->sendTss(tss);
+        continue;
+      }
           
       if (epevents[i].events & EPOLLIN){ // read available
         //if (ts->checkSendQueuesAlmostFull()){
@@ -434,6 +587,288 @@ OSTHREAD_FUNC TCPDatagramCommunication::workerThread(void *parm){
   return 0;
 }
 
+//------------------------------- SHARED MEMORY ------------------------------
+
+static void setnonblock(int fd);
+
+ShmConn::~ShmConn(){
+  if (base) munmap(base, maplen);
+  if (wakefd >= 0) close(wakefd);
+  if (peerfd >= 0) close(peerfd);
+}
+
+void ShmConn::ring(void){
+  eventfd_write(peerfd, 1);
+}
+
+int ShmConn::write(iovec *bufs, int nbufs){
+  ShmRing *r = sendring;
+  u64 head = r->head; // only we change head
+  u64 space, off, len, chunk;
+  int i, written = 0;
+
+  space = TCP_SHM_RINGSIZE - (head - __atomic_load_n(&r->tail,__ATOMIC_ACQUIRE));
+  if (space == 0){ // full: ask consumer for a doorbell, then check again
+    r->producerWaiting = 1;
+    MemBarrier();
+    space = TCP_SHM_RINGSIZE -
+      (head - __atomic_load_n(&r->tail,__ATOMIC_ACQUIRE));
+    if (space == 0) return 0;
+  }
+  for (i=0; i < nbufs && space > 0; ++i){
+    len = bufs[i].iov_len;
+    if (len > space) len = space;
+    off = head & (TCP_SHM_RINGSIZE-1);
+    chunk = TCP_SHM_RINGSIZE - off; // bytes until end of ring
+    if (chunk >= len) memcpy(r->data + off, bufs[i].iov_base, len);
+    else {
+      memcpy(r->data + off, bufs[i].iov_base, chunk);
+      memcpy(r->data, (char*) bufs[i].iov_base + chunk, len - chunk);
+    }
+    head += len;
+    space -= len;
+    written += (int) len;
+  }
+  __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+  MemBarrier(); // order store of head with load of consumerPolling
+  if (!r->consumerPolling) ring();
+  return written;
+}
+
+int ShmConn::read(char *buf, int len){
+  ShmRing *r = recvring;
+  u64 tail = r->tail; // only we change tail
+  u64 avail, off, chunk;
+
+  avail = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;
+  if (avail == 0) return 0;
+  if ((u64) len < avail) avail = len;
+  off = tail & (TCP_SHM_RINGSIZE-1);
+  chunk = TCP_SHM_RINGSIZE - off;
+  if (chunk >= avail) memcpy(buf, r->data + off, avail);
+  else {
+    memcpy(buf, r->data + off, chunk);
+    memcpy(buf + chunk, r->data, avail - chunk);
+  }
+  __atomic_store_n(&r->tail, tail + avail, __ATOMIC_RELEASE);
+  MemBarrier(); // order store of tail with load of producerWaiting
+  if (r->producerWaiting){
+    r->producerWaiting = 0;
+    ring();
+  }
+  return (int) avail;
+}
+
+int TCPDatagramCommunication::receiveShm(TCPStreamState *tss){
+  int nread, got = 0;
+  while ((nread = tss->shm->read(tss->rstate.Ptr,
+                          tss->rstate.Buflen - tss->rstate.Filled)) > 0){
+    got = 1;
+    updateState(tss->handlerid, tss->rstate, tss->ipport, nread);
+  }
+  return got;
+}
+
+// sets sun to the name of the Unix socket for shared-memory connections to
+// port (in network order) and returns the length of the name
+static socklen_t shmSockName(sockaddr_un *sun, u32 port){
+  memset(sun, 0, sizeof(sockaddr_un));
+  sun->sun_family = AF_UNIX;
+  // abstract name (starts with a 0 byte)
+  snprintf(sun->sun_path+1, sizeof(sun->sun_path)-1, "yesquel-shm-%d",
+           (int) ntohs((u16) port));
+  return offsetof(sockaddr_un, sun_path) + 1 + strlen(sun->sun_path+1);
+}
+
+int TCPDatagramCommunication::shmListen(int port){
+  sockaddr_un sun;
+  socklen_t sunlen;
+  int fd, res;
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) return -1;
+  sunlen = shmSockName(&sun, htons((u16) port));
+  res = ::bind(fd, (sockaddr*) &sun, sunlen);
+  if (res == -1){
+    printf("bind() of shared-memory socket failed: %d\n", errno);
+    close(fd);
+    return -1;
+  }
+  setnonblock(fd);
+  return fd;
+}
+
+ShmConn *TCPDatagramCommunication::shmConnect(IPPort dest, int &fd){
+  sockaddr_un sun;
+  socklen_t sunlen;
+  ShmConn *shm;
+  int memfd=-1, res;
+  int fds[3];
+  char c = 0;
+  iovec iov;
+  msghdr msg;
+  char cbuf[CMSG_SPACE(sizeof(fds))];
+  cmsghdr *cmsg;
+  struct timeval tv;
+
+  if (!IPMisc::isLocal(dest.ip)) return 0;
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) return 0;
+  sunlen = shmSockName(&sun, dest.port);
+  if (connect(fd, (sockaddr*) &sun, sunlen) == -1){ // no server listening
+    close(fd);
+    return 0;
+  }
+
+  shm = new ShmConn;
+  shm->maplen = 2 * sizeof(ShmRing);
+#ifdef TCP_SHM_HUGETLB
+  memfd = memfd_create("yesquel-shm", MFD_CLOEXEC | MFD_HUGETLB);
+  if (memfd != -1){
+    int hugelen = (shm->maplen + (2<<20)-1) & ~((2<<20)-1);
+    if (ftruncate(memfd, hugelen) == -1){ close(memfd); memfd = -1; }
+    else shm->maplen = hugelen;
+  }
+#endif
+  if (memfd == -1){
+    memfd = memfd_create("yesquel-shm", MFD_CLOEXEC);
+    if (memfd == -1 || ftruncate(memfd, shm->maplen) == -1) goto error;
+  }
+  shm->base = (char*) mmap(0, shm->maplen, PROT_READ | PROT_WRITE, MAP_SHARED,
+                           memfd, 0);
+  if (shm->base == MAP_FAILED){ shm->base = 0; goto error; }
+  // first ring goes from client to server, second from server to client
+  shm->sendring = (ShmRing*) shm->base;
+  shm->recvring = (ShmRing*) (shm->base + sizeof(ShmRing));
+  shm->sendring->consumerPolling = shm->recvring->consumerPolling = 1;
+  shm->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  shm->peerfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (shm->wakefd == -1 || shm->peerfd == -1) goto error;
+
+  // pass memfd and doorbells to server
+  fds[0] = memfd;
+  fds[1] = shm->wakefd;
+  fds[2] = shm->peerfd;
+  iov.iov_base = &c;
+  iov.iov_len = 1;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  if (sendmsg(fd, &msg, 0) != 1) goto error;
+
+  // wait for server to acknowledge
+  tv.tv_sec = 5;
+  tv.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  do {
+    res = ::read(fd, &c, 1);
+  } while (res == -1 && errno == EINTR);
+  if (res != 1) goto error;
+  close(memfd);
+  setnonblock(fd);
+  return shm;
+
+ error:
+  if (memfd != -1) close(memfd);
+  delete shm;
+  close(fd);
+  fd = -1;
+  return 0;
+}
+
+ShmConn *TCPDatagramCommunication::shmAccept(int fd){
+  ShmConn *shm;
+  int fds[3];
+  char c;
+  iovec iov;
+  msghdr msg;
+  char cbuf[CMSG_SPACE(sizeof(fds))];
+  cmsghdr *cmsg;
+  struct timeval tv;
+  struct stat st;
+  int res;
+
+  tv.tv_sec = 1;
+  tv.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  iov.iov_base = &c;
+  iov.iov_len = 1;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+  do {
+    res = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+  } while (res == -1 && errno == EINTR);
+  if (res != 1) return 0;
+  cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) return 0;
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+  shm = new ShmConn;
+  shm->wakefd = fds[2]; // client's peer is us
+  shm->peerfd = fds[1];
+  if (fstat(fds[0], &st) == -1 || st.st_size < (off_t) (2*sizeof(ShmRing))){
+    close(fds[0]);
+    delete shm;
+    return 0;
+  }
+  shm->maplen = (int) st.st_size;
+  shm->base = (char*) mmap(0, shm->maplen, PROT_READ | PROT_WRITE, MAP_SHARED,
+                           fds[0], 0);
+  close(fds[0]);
+  if (shm->base == MAP_FAILED){ shm->base = 0; delete shm; return 0; }
+  shm->recvring = (ShmRing*) shm->base;
+  shm->sendring = (ShmRing*) (shm->base + sizeof(ShmRing));
+
+  c = 1;
+  if (::write(fd, &c, 1) != 1){ delete shm; return 0; }
+  setnonblock(fd);
+  return shm;
+}
+
+void TCPDatagramCommunication::closeShm(TCPStreamState *tss){
+  int myworkerno = gContext.indexWithinClass(TCLASS_WORKER, tgetThreadNo());
+  int epfd = (int) (long long)
+    tgetSharedSpace(THREADCONTEXT_SPACE_TCPDATAGRAM_WORKER);
+  TCPStreamStatePtr tssp(tss);
+  SendQueueEntry *sqe;
+  ShmConns[myworkerno].remove(tssp);
+  PendingSendsBeforeEpoll[myworkerno].remove(tssp);
+  // remove fds from epoll explicitly, since the other end may still hold
+  // the doorbells
+  epoll_ctl(epfd, EPOLL_CTL_DEL, tss->shm->wakefd, 0);
+  epoll_ctl(epfd, EPOLL_CTL_DEL, tss->fd, 0);
+  close(tss->fd);
+  tss->fd = -1;
+  delete tss->shm;
+  tss->shm = 0;
+  while (!tss->sendQueue.empty()){
+    sqe = tss->sendQueue.popHead();
+    if (sqe->dmsg.freedata) delete sqe->dmsg.data;
+    delete sqe;
+  }
+}
+
+// deletes a shared-memory connection, called by clientdisconnect
+void TCPDatagramCommunication::immediateFuncDelShmConn(TaskMsgData &msgdata,
+                                     TaskScheduler *ts, int srcthread){
+  TCPStreamState *tss = *(TCPStreamState**) &msgdata;
+  TCPDatagramCommunication *tdc = (TCPDatagramCommunication*)
+    tgetSharedSpace(THREADCONTEXT_SPACE_TCPDATAGRAM);
+  if (tss->shm) tdc->closeShm(tss);
+  delete tss;
+}
+
 //------------------------------------ SENDING -------------------------------
 
 void TCPDatagramCommunication::SendQueueEntry::marshallRPC(){
@@ -472,17 +907,22 @@ void TCPDatagramCommunication::immediateFuncSend(TaskMsgData &msgdata,
   tdc->sendMsgFromWorker(dmsg);
 }
 
-// chooses which worker thread will handle a given client
+// chooses which worker thread will handle a given client. Different
+// connections to the same server go to different workers
 int TCPDatagramCommunication::chooseWorkerForClient(IPPort client){
-  return client.ip;
+  return client.ip + (client.port >> 16);
 }
 
 void TCPDatagramCommunication::sendMsgFromWorker(DatagramMsg *dmsg){
   int res;
   TCPStreamState *tss, **rettss = 0;
   int myworkerno = gContext.indexWithinClass(TCLASS_WORKER, tgetThreadNo());
-  res = IPPortMap.lookup(dmsg->ipport, rettss); assert(res==0);
+  res = IPPortMap[myworkerno].lookup(dmsg->ipport, rettss); assert(res==0);
   tss = *rettss;
+  if (tss->fd < 0){ // shared-memory connection was closed; drop message
+    if (dmsg->freedata) delete dmsg->data;
+    return;
+  }
   SendQueueEntry *sqe = new SendQueueEntry(*dmsg);
   tss->sendQueue.pushTail(sqe);
   if (!tss->sendeagain){ // if didn't get EAGAIN, then must send before epoll
@@ -496,12 +936,19 @@ void TCPDatagramCommunication::sendMsg(DatagramMsg *dmsg){
   // the client.
   assert(sizeof(DatagramMsg) <= TASKSCHEDULER_TASKMSGDATA_SIZE);
   TaskMsg msg;
+  DatagramMsg *copy = (DatagramMsg*) &msg.data;
   int workerthread; // which of the worker threads to make the request to
+  u32 hid;
 
-  *(DatagramMsg*)&msg.data = *dmsg; // copy dmsg
+  *copy = *dmsg; // copy dmsg
+  if (ClientConns > 1){ // pick connection by hash id, or by xid if none
+    hid = FLAG_GET_HID(dmsg->flags);
+    copy->ipport = connKey(dmsg->ipport,
+                           (int) ((hid ? hid : dmsg->xid) % ClientConns));
+  }
 
   workerthread = gContext.hashThread(TCLASS_WORKER,
-                                     chooseWorkerForClient(dmsg->ipport));
+                                     chooseWorkerForClient(copy->ipport));
   msg.dest = TASKID_CREATE(workerthread, IMMEDIATEFUNC_SEND);
   msg.flags = TMFLAG_FIXDEST | TMFLAG_IMMEDIATEFUNC;
   tgetTaskScheduler()->sendMessage(msg);    
@@ -514,9 +961,13 @@ TCPDatagramCommunication::TCPDatagramCommunication() : newServerQueue(1024)
 {
   ServerThr = 0;
   ClientCount = 0;
+  ShmClientCount = 0;
+  ClientConns = 1;
   ServerEventFd = eventfd(0, EFD_NONBLOCK); assert(ServerEventFd != -1);
   ForceEndThreads = false;
   PendingSendsBeforeEpoll = 0;
+  ShmConns = 0;
+  IPPortMap = 0;
 }
 
 TCPDatagramCommunication::~TCPDatagramCommunication(){
@@ -524,6 +975,8 @@ TCPDatagramCommunication::~TCPDatagramCommunication(){
     // ensures exitThreads is not called twice
     exitThreads();
   if (PendingSendsBeforeEpoll) delete [] PendingSendsBeforeEpoll;
+  if (ShmConns) delete [] ShmConns;
+  if (IPPortMap) delete [] IPPortMap;
 }
 
 static void setnonblock(int fd){
@@ -567,8 +1020,21 @@ int TCPDatagramCommunication::addServer(int handlerid, int port){
   NewServer *ns = new NewServer;
   ns->fd = fdlisten;
   ns->handlerid = handlerid;
+  ns->shm = 0;
   newServerQueue.enqueue(ns);
 
+#ifdef TCP_SHM
+  // also listen for shared-memory connections from clients on this host
+  fdlisten = shmListen(port);
+  if (fdlisten != -1){
+    ns = new NewServer;
+    ns->fd = fdlisten;
+    ns->handlerid = handlerid;
+    ns->shm = 1;
+    newServerQueue.enqueue(ns);
+  }
+#endif
+
   // unblock server from epoll
   res = eventfd_write(ServerEventFd, 1); assert(res==0);
   return 0;
@@ -630,7 +1096,24 @@ OSTHREAD_FUNC TCPDatagramCommunication::serverThread(void *parm){
         continue;
       }
 
-      if (epevents[i].events & EPOLLIN){
+      if ((epevents[i].events & EPOLLIN) && epollptr->shm){
+        // new shared-memory connection
+        ShmConn *shm;
+        IPPort ipport;
+        fdaccept = accept4(epollptr->fd, 0, 0, SOCK_CLOEXEC);
+        if (fdaccept == -1) continue;
+        shm = shmAccept(fdaccept);
+        if (!shm){
+          close(fdaccept);
+          continue;
+        }
+        // give client a distinct IPPort with an ip that is never used by
+        // TCP clients
+        ipport.set(0, ++tdc->ShmClientCount);
+        workerno = tdc->ClientCount++;
+        tdc->startReceiving(ipport, fdaccept, epollptr->handlerid, workerno,
+                            shm);
+      } else if (epevents[i].events & EPOLLIN){
         // read available, new connection to accept
         ud.sockaddr_len = sizeof(sockaddr_in);
         fdaccept = accept(epollptr->fd, (sockaddr*) &ud.destaddr,
@@ -678,12 +1161,31 @@ OSTHREAD_FUNC TCPDatagramCommunication::serverThread(void *parm){
 }
 
 // should be called at the beginning by a single thread.
-// This is because there are no locks protecting IPPortMap
+// This is because there are no locks protecting IPPortMap; connections are
+// added to it by worker threads
 int TCPDatagramCommunication::clientconnect(IPPort dest) {
+  int i, res;
+  for (i=0; i < ClientConns; ++i){
+    res = clientconnect1(dest, connKey(dest, i));
+    if (res) return res;
+  }
+  return 0;
+}
+
+// opens a connection to dest, which is known by key in IPPortMap
+int TCPDatagramCommunication::clientconnect1(IPPort dest, IPPort key) {
   int fd;
   int res;
   UDPDest udpdest(dest);
 
+#ifdef TCP_SHM
+  ShmConn *shm = shmConnect(dest, fd); // use shared memory if server is local
+  if (shm){
+    startReceiving(key, fd, -1, chooseWorkerForClient(key), shm);
+    return 0;
+  }
+#endif
+
   fd = socket(AF_INET, SOCK_STREAM, 0);
   if (fd == -1){
     printf("socket() failed: %d\n", errno);
@@ -706,23 +1208,34 @@ int TCPDatagramCommunication::clientconnect(IPPort dest) {
   if (res) printf("setsockopt on connect socket: error %d\n", errno);
 #endif  
 
-  startReceiving(dest, fd, -1, chooseWorkerForClient(dest));
+  startReceiving(key, fd, -1, chooseWorkerForClient(key));
   return 0;
 }
 
 int TCPDatagramCommunication::clientdisconnect(IPPort dest) {
-  // lookup dest in IPPortMap
   TCPStreamState **tss;
-  int res;
-  res = IPPortMap.lookup(dest, tss);
-  if (res) return -1; // no such client
-  if (*tss){
-    delete *tss; // FIXME: potential race: deleting tss will free
-                 // (*tss)->rstate.Buf and (*tss)->sendQueue, but worker thread
-                 // may be using this if it is receiving data on this
-                 // connection. The fix is to wait for worker to be done
-                 // receiving anything before deleting *tss
-    *tss = 0; // associate empty TCPStreamState with dest in IPPortMap
+  IPPort key;
+  int i, res;
+  for (i=0; i < ClientConns; ++i){
+    // lookup connection in IPPortMap of its worker
+    key = connKey(dest, i);
+    res = IPPortMap[gContext.hashThreadIndex(TCLASS_WORKER,
+                                chooseWorkerForClient(key))].lookup(key, tss);
+    if (res) return -1; // no such client
+    if (*tss && (*tss)->shm){ // worker thread must delete it
+      TCPStreamState *tssptr = *tss;
+      sendIFMsg(gContext.hashThread(TCLASS_WORKER, chooseWorkerForClient(key)),
+                IMMEDIATEFUNC_DELSHMCONN, (void*) &tssptr,
+                sizeof(TCPStreamState*));
+      *tss = 0;
+    } else if (*tss){
+      delete *tss; // FIXME: potential race: deleting tss will free
+                   // (*tss)->rstate.Buf and (*tss)->sendQueue, but worker
+                   // thread may be using this if it is receiving data on this
+                   // connection. The fix is to wait for worker to be done
+                   // receiving anything before deleting *tss
+      *tss = 0; // associate empty TCPStreamState with key in IPPortMap
+    }
   }
   return 0;
 }
@@ -760,9 +1273,12 @@ int TCPDatagramCommunication::launch(int workerthreads, int wait){
   // server has thread that listens for connections
   res = OSCreateThread(&ServerThr, serverThread, (void*) this); assert(res==0);
   nWorkerThreads = workerthreads;
+  ClientConns = workerthreads; // one connection to each server per worker
 
   // allocate array of Set<TCPStreamStatePtr>
   PendingSendsBeforeEpoll = new Set<TCPStreamStatePtr>[workerthreads];
+  ShmConns = new Set<TCPStreamStatePtr>[workerthreads];
+  IPPortMap = new SkipList<IPPort,TCPStreamState*>[workerthreads];
   
   // **!** need gContext.setNThreads and setThread for TCLASS_SERVER?
   // This is so that threads can communicate with it for disk I/O later
@@ -774,6 +1290,7 @@ int TCPDatagramCommunication::launch(int workerthreads, int wait){
                                        (void*) this, true);
     gContext.setThread(TCLASS_WORKER, i, threadno);
   }
+  for (i = 0; i < nWorkerThreads; ++i) workerRegSync.signal();
 
   for (i = 0; i < nWorkerThreads; ++i){
     workerInitSync.wait(INFINITE);
@@ -162,6 +162,41 @@ int DdInsert(DdTable *table, i64 key, const char *value, int valuelen){
   return 0;
 }
 
+int DdBulkBegin(DdTable *table){
+  int res;
+  res = DdInitCursor(table);
+  if (res) return res;
+  res = sqlite3BtreeBulkBegin(table->pCur);
+  if (res){
+    dprintf(1, "sqlite3BtreeBulkBegin fails: %d\n", res);
+    DdCloseCursor(table);
+    return res;
+  }
+  return 0;
+}
+
+int DdBulkInsert(DdTable *table, i64 key, const char *value, int valuelen){
+  int res;
+  assert(table->pCur);
+  res = sqlite3BtreeInsert(table->pCur, 0, key, (void*) value, valuelen, 0, 1,
+                           0);
+  if (res){
+    dprintf(1, "sqlite3BtreeInsert fails: %d\n", res);
+    DdCloseCursor(table);
+    return res;
+  }
+  return 0;
+}
+
+int DdBulkEnd(DdTable *table){
+  int res;
+  if (!table->pCur) return 0;
+  res = sqlite3BtreeBulkEnd(table->pCur);
+  if (res) dprintf(1, "sqlite3BtreeBulkEnd fails: %d\n", res);
+  DdCloseCursor(table);
+  return res;
+}
+
 
 int DdDelete(DdTable *table, i64 key){
   int res;
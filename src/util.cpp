@@ -83,6 +83,62 @@ void DumpDataShort(char *ptr, int n){
   }
 }
 
+// ------------------------------- CRC32C -----------------------------------
+
+static u32 crc32cTable[256];
+
+static void crc32cInitTable(void){
+  u32 crc;
+  int i, j;
+  for (i=0; i < 256; ++i){
+    crc = i;
+    for (j=0; j < 8; ++j) crc = (crc >> 1) ^ (0x82f63b78 & (0-(crc & 1)));
+    crc32cTable[i] = crc;
+  }
+}
+
+static u32 crc32cSoft(u32 crc, const u8 *buf, int len){
+  while (len--) crc = crc32cTable[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static u32 crc32cHard(u32 crc, const u8 *buf, int len){
+  u64 crc64 = crc;
+  u64 v;
+  // process 8 bytes at a time, then the rest one byte at a time
+  while (len >= 8){
+    memcpy(&v, buf, 8);
+    crc64 = __builtin_ia32_crc32di(crc64, v);
+    buf += 8;
+    len -= 8;
+  }
+  crc = (u32) crc64;
+  while (len--) crc = __builtin_ia32_crc32qi(crc, *buf++);
+  return crc;
+}
+#endif
+
+u32 crc32c(u32 crc, const void *buf, int len){
+  static int hashard = -1; // whether CPU has crc32 instruction; -1=unknown
+  if (hashard == -1){
+#if defined(__x86_64__)
+    hashard = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+#else
+    hashard = 0;
+#endif
+    if (!hashard) crc32cInitTable();
+  }
+  crc = ~crc;
+#if defined(__x86_64__)
+  if (hashard) crc = crc32cHard(crc, (const u8*) buf, len);
+  else
+#endif
+    crc = crc32cSoft(crc, (const u8*) buf, len);
+  return ~crc;
+}
+
 #ifdef GETOPT
 // Parse command-line options
 int optind=1;  // current argv being processed
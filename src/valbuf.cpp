@@ -53,7 +53,9 @@
 
 static SuperValue tmpdummySV;
 
-Valbuf::Valbuf(){ refcount=0; type=1; u.raw = &tmpdummySV; }
+Valbuf::Valbuf(){
+  refcount=0; type=1; cellsBefore = cellsAfter = 0; u.raw = &tmpdummySV;
+}
 
 Valbuf::Valbuf(const Valbuf& c){
   memcpy(this, &c, sizeof(Valbuf));
@@ -77,6 +79,7 @@ Valbuf::Valbuf(const SuperValue& sv, COid c, bool im, Timestamp *ts){
   if (ts){ commitTs = *ts; readTs = *ts; }
   else { commitTs.setLowest(); readTs.setLowest(); }
   len = 0;
+  cellsBefore = cellsAfter = 0;
   u.raw = new SuperValue(sv);
 }
 
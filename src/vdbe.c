@@ -848,6 +848,7 @@ SQLITE_PRIVATE int sqlite3VdbeExec(
     } az;
     struct OP_Seek_stack_vars {
       VdbeCursor *pC;
+      VdbeCursor *pIdx;
     } ba;
     struct OP_Found_stack_vars {
       int alreadyExists;
@@ -3543,8 +3544,12 @@ case OP_VerifyCookie: {
 ** values need not be contiguous but all P1 values should be small integers.
 ** It is an error for P1 to be negative.
 **
-** If P5!=0 then use the content of register P2 as the root page, not
-** the value of P2 itself.
+** If P5 (ignoring the OPFLAG_BULKLOAD and OPFLAG_PREFETCH bits) is not zero
+** then use the content of register P2 as the root page, not the value of P2
+** itself.
+**
+** If the OPFLAG_PREFETCH bit of P5 is set, then a full scan of the cursor
+** reads the tree ahead with parallel reads. YESQUEL CH: added OPFLAG_PREFETCH
 **
 ** There will be a read lock on the database whenever there is an
 ** open cursor.  If the database was unlocked prior to this instruction
@@ -3569,6 +3574,10 @@ case OP_VerifyCookie: {
 ** page is P2.  Or if P5!=0 use the content of register P2 to find the
 ** root page.
 **
+** If the OPFLAG_BULKLOAD bit of P5 is set and the tree is empty, then
+** inserts through the cursor are buffered and the tree is built bottom-up
+** when the cursor is closed. YESQUEL CH: added OPFLAG_BULKLOAD
+**
 ** The P4 value may be either an integer (P4_INT32) or a pointer to
 ** a KeyInfo structure (P4_KEYINFO). If it is a pointer to a KeyInfo 
 ** structure, then said structure defines the content and collating 
@@ -3618,7 +3627,7 @@ case OP_OpenWrite: {
   }else{
     u.aw.wrFlag = 0;
   }
-  if( pOp->p5 ){
+  if( pOp->p5 & ~(OPFLAG_BULKLOAD|OPFLAG_PREFETCH) ){
     assert( u.aw.p2>0 );
     assert( (int)u.aw.p2<=p->nMem );
     pIn2 = &aMem[u.aw.p2];
@@ -3659,6 +3668,14 @@ case OP_OpenWrite: {
     u.aw.pCur->pCursor = 0;
     rc = SQLITE_OK;
   }
+  if( (pOp->p5 & OPFLAG_BULKLOAD) && u.aw.pCur->pCursor ){
+    rc = sqlite3BtreeBulkBegin(u.aw.pCur->pCursor);
+    if( rc ) goto abort_due_to_error;
+  }
+  if( (pOp->p5 & OPFLAG_PREFETCH) && u.aw.pCur->pCursor ){
+    rc = sqlite3BtreeScanPrefetch(u.aw.pCur->pCursor);
+    if( rc ) goto abort_due_to_error;
+  }
 
   /* Set the VdbeCursor.isTable and isIndex variables. Previous versions of
   ** SQLite used to check if the root-page flags were sane at this point
@@ -3783,6 +3800,11 @@ case OP_OpenPseudo: {
 */
 case OP_Close: {
   assert( pOp->p1>=0 && pOp->p1<p->nCursor );
+  if( p->apCsr[pOp->p1] && p->apCsr[pOp->p1]->pCursor ){
+    /* install tree if bulk loading */
+    rc = sqlite3BtreeBulkEnd(p->apCsr[pOp->p1]->pCursor);
+    if( rc ) goto abort_due_to_error;
+  }
   sqlite3VdbeFreeCursor(p, p->apCsr[pOp->p1]);
   p->apCsr[pOp->p1] = 0;
   break;
@@ -3994,7 +4016,7 @@ case OP_SeekGt: {       /* jump, in3 */
   break;
 }
 
-/* Opcode: Seek P1 P2 * * *
+/* Opcode: Seek P1 P2 P3 * P5
 **
 ** P1 is an open table cursor and P2 is a rowid integer.  Arrange
 ** for P1 to move so that it points to the rowid given by P2.
@@ -4002,10 +4024,16 @@ case OP_SeekGt: {       /* jump, in3 */
 ** This is actually a deferred seek.  Nothing actually happens until
 ** the cursor is used to read a record.  That way, if no reads
 ** occur, no unnecessary I/O happens.
+**
+** If P3 is not zero, then the rowid was taken from the entry of index
+** cursor P3-1, and the rows of the next entries of that index cursor are
+** fetched ahead. P5 is 1 if the index is scanned in reverse order.
+** YESQUEL CH: added P3 and P5
 */
 case OP_Seek: {    /* in2 */
 #if 0  /* local variables moved into u.ba */
   VdbeCursor *pC;
+  VdbeCursor *pIdx;
 #endif /* local variables moved into u.ba */
 
   assert( pOp->p1>=0 && pOp->p1<p->nCursor );
@@ -4018,6 +4046,15 @@ case OP_Seek: {    /* in2 */
     u.ba.pC->movetoTarget = sqlite3VdbeIntValue(pIn2);
     u.ba.pC->rowidIsValid = 0;
     u.ba.pC->deferredMoveto = 1;
+    if( pOp->p3 ){ /* YESQUEL CH: fetch rows of next index entries ahead */
+      assert( pOp->p3>0 && pOp->p3<=p->nCursor );
+      u.ba.pIdx = p->apCsr[pOp->p3-1];
+      if( u.ba.pIdx && u.ba.pIdx->pCursor ){
+        rc = sqlite3BtreeRowPrefetch(u.ba.pC->pCursor, u.ba.pIdx->pCursor,
+                                     u.ba.pC->movetoTarget, pOp->p5);
+        if( rc ) goto abort_due_to_error;
+      }
+    }
   }
   break;
 }
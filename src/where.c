@@ -4013,7 +4013,14 @@ static Bitmask codeOneLoopStart(
       iRowidReg = iReleaseReg = sqlite3GetTempReg(pParse);
       sqlite3VdbeAddOp2(v, OP_IdxRowid, iIdxCur, iRowidReg);
       sqlite3ExprCacheStore(pParse, iCur, -1, iRowidReg);
-      sqlite3VdbeAddOp2(v, OP_Seek, iCur, iRowidReg);  /* Deferred seek */
+      if( pLevel->plan.wsFlags & WHERE_UNIQUE ){
+        sqlite3VdbeAddOp2(v, OP_Seek, iCur, iRowidReg);  /* Deferred seek */
+      }else{
+        /* YESQUEL CH: the index scan visits several rows, so let the seek
+        ** fetch the rows of the next index entries ahead */
+        sqlite3VdbeAddOp3(v, OP_Seek, iCur, iRowidReg, iIdxCur+1);
+        sqlite3VdbeChangeP5(v, bRev ? 1 : 0);
+      }
     }
 
     /* Record the instruction used to terminate the loop. Disable 